@@ -0,0 +1,52 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "clipping.h"
+
+/*
+ * Bounding volume hierarchy over the world-space boxes of the scene instances. Moved instances are refit
+ * into the tree every frame, the tree is rebuilt on a background thread once the refits have made it too
+ * loose, and from scratch whenever instances are added or removed. Frustum queries only descend into the
+ * nodes crossing the frustum, so they cost about as much as the number of instances they find.
+ */
+
+/* Most instances kept in a leaf */
+#define BVH_LEAF_SIZE 4
+
+/* Buckets the instance centers are sorted into when looking for the cheapest split of a node */
+#define BVH_SPLIT_BUCKETS 12
+
+/* The tree is rebuilt once its surface area cost has grown this many times beyond the one it was built with */
+#define BVH_REBUILD_RATIO 1.5f
+
+/* Node of the tree, the instances below it are a contiguous range of the instance order */
+typedef struct
+{
+	vec3_t min;
+	vec3_t max;
+	int first;      /* first instance of the range */
+	int count;      /* number of instances in the range */
+	int left;       /* first of the two children, which are next to each other, -1 for a leaf */
+	int parent;     /* -1 for the root */
+} bvh_node_t;
+
+/* Instance found by a frustum query, and whether its box is inside every plane */
+typedef struct
+{
+	int instance;
+	enum frustum_visibility visibility;
+} bvh_hit_t;
+
+/* Function to bring the tree up to date with the scene: rebuild it if instances were added or removed,
+   refit the moved ones, and start or pick up a background rebuild */
+bool bvh_update(void);
+
+/* Function to find the instances whose boxes are not outside the frustum, returns their number */
+int bvh_query_frustum(const frustum_t* frustum, const bvh_hit_t** hits);
+
+/* Function to wait for a background rebuild and free the tree */
+void bvh_destroy(void);
+
+#endif // !BVH_H
@@ -1,35 +1,73 @@
 #ifndef CLIPPING_H
 #define CLIPPING_H
 
+#include <stdint.h>
 #include "vector.h"
+#include "matrix.h"
+#include "texture.h"
+#include "vertex.h"
 
+/* A triangle clipped against every plane gains at most one vertex per plane */
 #define MAX_NUM_POLY_VERTICES 10
 
-enum 
-{
-	LEFT_FRUSTUM_PLANE,
-	RIGHT_FRUSTUM_PLANE,
-	BOTTOM_FRUSTUM_PLANE,
-	TOP_FRUSTUM_PLANE,
-	NEAR_FRUSTUM_PLANE,
-	FAR_FRUSTUM_PLANE
-};
+/* Clip-space x and y are only clipped this many times beyond the viewport, the rasterizer scissors everything
+   closer to the screen rectangle, and the band keeps the vertices far inside the range of its fixed point */
+#define CLIP_GUARD_BAND 4.0f
 
+/* Vertex of a polygon being clipped, everything in it is interpolated linearly in clip space */
 typedef struct
 {
-	vec3_t point;
-	vec3_t normal;
-} plane_t;
+	vec4_t position;
+	tex2_t uv;
+} clip_vertex_t;
 
 typedef struct
 {
-	vec3_t vertices[MAX_NUM_POLY_VERTICES];
+	clip_vertex_t vertices[MAX_NUM_POLY_VERTICES];
 	int num_vertices;
 } polygon_t;
 
-void init_frustum_planes(float fov, float z_near, float z_far);
-polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2);
-void clip_polygon(polygon_t* polygon);
+/* Bounds of a mesh in model space: a box, and the sphere around it for the quick test */
+typedef struct
+{
+	vec3_t min;
+	vec3_t max;
+	vec3_t center;
+	float radius;
+} bounds_t;
 
-#endif // !CLIPPING_H
+/* The six planes of the view frustum, in the space of the matrix they were extracted from, as (normal, distance) with unit normals */
+typedef struct
+{
+	vec4_t planes[6];
+} frustum_t;
+
+/* Where a volume lies relative to the frustum */
+enum frustum_visibility
+{
+	FRUSTUM_OUTSIDE,        /* entirely outside one plane, nothing of it can be seen */
+	FRUSTUM_INTERSECTING,   /* crossing a plane, its faces may need clipping */
+	FRUSTUM_INSIDE          /* inside every plane, none of its faces need clipping */
+};
+
+/* Function to compute the box and sphere around count points */
+bounds_t bounds_from_points(const float* x, const float* y, const float* z, int count);
+
+/* Function to extract the frustum planes from a model-view-projection matrix, they come out in model space */
+frustum_t frustum_from_matrix(const mat4_t* model_view_projection);
+
+/* Function to test bounds against the frustum, the sphere first and the box only when the sphere crosses a plane */
+enum frustum_visibility frustum_test_bounds(const frustum_t* frustum, const bounds_t* bounds);
+
+/* Function to test an axis aligned box against the frustum */
+enum frustum_visibility frustum_test_box(const frustum_t* frustum, vec3_t min, vec3_t max);
 
+/* Function to find the planes a clip-space position lies outside of, as outcode bits with the sides moved out to the guard band */
+uint8_t clip_planes_outside(vec4_t position);
+
+polygon_t create_polygon_from_triangle(clip_vertex_t v0, clip_vertex_t v1, clip_vertex_t v2);
+
+/* Function to clip a polygon against the planes in a mask of outcode bits, it becomes a convex fan around its first vertex, or empty */
+void clip_polygon(polygon_t* polygon, uint8_t planes);
+
+#endif // !CLIPPING_H
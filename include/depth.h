@@ -0,0 +1,108 @@
+#ifndef DEPTH_H
+#define DEPTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "display.h"
+
+/* Formats the depth buffer can be stored in, picked once at setup */
+enum depth_format
+{
+	DEPTH_FLOAT32,      /* 32 bit float */
+	DEPTH_UNORM24,      /* 24 bit unsigned normalized, packed in the low bits of 32 bit words */
+	DEPTH_UNORM16,      /* 16 bit unsigned normalized, half the memory traffic of the others */
+	DEPTH_FORMAT_COUNT
+};
+
+/* Largest stored value of the unsigned normalized formats, the far plane */
+#define DEPTH_UNORM24_MAX 0xFFFFFF
+#define DEPTH_UNORM16_MAX 0xFFFF
+
+/*
+ * Every format stores smaller values for closer pixels, and the depth tests pass when a pixel is
+ * strictly closer. The kernels compute depth = depth_far - 1/w as a float: with depth_far = 1 that
+ * is the usual 1 - 1/w, which the integer formats scale to their range. Reversed-Z sets depth_far
+ * to 0 for the float format, so it stores -1/w: 1/w is never subtracted from 1, and distant pixels
+ * keep the fine float steps close to 0 instead of the coarse ones close to 1. The integer formats
+ * are evenly spaced, both mappings quantize to the same values, so they always use 1 - 1/w.
+ * The buffer itself is render_target.depth_buffer.
+ */
+extern enum depth_format depth_format;
+extern bool depth_reversed;
+extern float depth_far;
+
+/* Force inlined into kernels that take the depth format as a constant, so the format checks fold away */
+#if defined(_MSC_VER)
+#define DEPTH_INLINE static __forceinline
+#else
+#define DEPTH_INLINE static inline __attribute__((always_inline))
+#endif
+
+/* Function to allocate the depth buffer in a format, reversed stores -1/w instead of 1 - 1/w in the float format */
+bool depth_init(enum depth_format format, bool reversed);
+
+/* Function to get the stored depth of a pixel at a given 1/w as a float, for the depth hierarchy */
+float depth_key(float reciprocal_w);
+
+/* Function to reset a rectangle of the depth buffer to the far plane */
+void depth_clear_rect(rect_t rect);
+
+/* Function to find the farthest stored depth inside a rectangle of the depth buffer, as a float */
+float depth_max_rect(rect_t rect);
+
+/* Function to free the depth buffer */
+void depth_destroy(void);
+
+/* First pixel of a row of the depth buffer */
+DEPTH_INLINE void* depth_row(int y, enum depth_format format)
+{
+	size_t pixel_size = (format == DEPTH_UNORM16) ? sizeof(uint16_t) : sizeof(uint32_t);
+	return (uint8_t*)render_target.depth_buffer + (size_t)render_target.width * y * pixel_size;
+}
+
+/* Scales a float depth to an integer format, clamped to its range, NaN ends up on the far plane */
+DEPTH_INLINE uint32_t depth_quantize(float depth, enum depth_format format)
+{
+	float max = (format == DEPTH_UNORM16) ? (float)DEPTH_UNORM16_MAX : (float)DEPTH_UNORM24_MAX;
+	float scaled = depth * max;
+	scaled = (scaled < max) ? scaled : max;
+	scaled = (scaled > 0.0f) ? scaled : 0.0f;
+	return (uint32_t)scaled;
+}
+
+/* Depth tests a pixel and stores its depth if it is closer, returns whether it passed */
+DEPTH_INLINE bool depth_test_pixel(void* row, int x, float depth, enum depth_format format)
+{
+	if (format == DEPTH_FLOAT32)
+	{
+		float* pixel = (float*)row + x;
+		if (depth < *pixel)
+		{
+			*pixel = depth;
+			return true;
+		}
+		return false;
+	}
+
+	uint32_t quantized = depth_quantize(depth, format);
+	if (format == DEPTH_UNORM24)
+	{
+		uint32_t* pixel = (uint32_t*)row + x;
+		if (quantized < *pixel)
+		{
+			*pixel = quantized;
+			return true;
+		}
+		return false;
+	}
+
+	uint16_t* pixel = (uint16_t*)row + x;
+	if (quantized < *pixel)
+	{
+		*pixel = (uint16_t)quantized;
+		return true;
+	}
+	return false;
+}
+
+#endif // !DEPTH_H
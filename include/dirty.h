@@ -0,0 +1,35 @@
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "display.h"
+
+/* Function to allocate the dirty flags and depth epochs of the screen tiles, everything starts out dirty */
+bool dirty_init(void);
+
+/* Function to mark the tiles overlapping a screen rectangle as drawn into this frame */
+void dirty_mark_rect(rect_t rect);
+
+/* Function to check whether the last color clear wiped a tile, so its background has to be drawn again */
+bool dirty_tile_wiped(int tile_x, int tile_y);
+
+/* Function to clear the color of the tiles drawn into since the last clear */
+void dirty_clear_color(uint32_t color);
+
+/* Function to start a new depth epoch, the depth of a tile is only cleared the first time it is drawn into afterwards */
+void dirty_clear_depth(void);
+
+/* Function to make the depth of the tiles overlapping a screen rectangle valid for the current epoch */
+void dirty_acquire_depth(rect_t rect);
+
+/* Called with a rectangle of the screen that changed since the last frame was presented */
+typedef void (*dirty_run_t)(rect_t run);
+
+/* Function to call a callback with every run of changed tiles in a tile row, or once with the whole screen when every tile changed */
+void dirty_for_each_run(dirty_run_t callback);
+
+/* Function to free the dirty flags */
+void dirty_destroy(void);
+
+#endif // !DIRTY_H
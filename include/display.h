@@ -4,18 +4,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <SDL.h>
 #include "texture.h"
-
-/* Constants for frame rate */
-#define FPS 60 
-#define FRAME_TARGET_TIME (1000 / FPS)
+#include "render_target.h"
 
 enum culling_mode
 {
 	CULLING_BACKFACE,
 	CULLING_NONE
-} culling_mode;
+};
 
 enum render_mode
 {
@@ -24,28 +20,39 @@ enum render_mode
 	RENDER_FILL,
 	RENDER_FILL_WIRE,
 	RENDER_TEXTURED,
-	RENDER_TEXTURED_WIRE
-} render_mode;
+	RENDER_TEXTURED_WIRE,
+	RENDER_VISIBILITY,
+	RENDER_MODE_COUNT
+};
+
+/* Screen rectangle with inclusive bounds, used to restrict rasterization to a tile */
+typedef struct
+{
+	int min_x, min_y;
+	int max_x, max_y;
+} rect_t;
+
+/* Pixels the kernels depth tested and the ones that passed and were written, summed up for the frame stats */
+typedef struct
+{
+	uint64_t tested;
+	uint64_t written;
+} pixel_counts_t;
 
 /* External declarations for global variables */
-extern SDL_Window* window;
-extern SDL_Renderer* renderer;
-extern uint32_t* color_buffer;
-extern float* depth_buffer;
-extern SDL_Texture* color_buffer_texture;
-extern int window_width;
-extern int window_height;
-
-/* Function to initialize the window */
-bool initialize_window(void);
-
-/* Function to draw a grid */
+extern enum culling_mode culling_mode;
+extern enum render_mode render_mode;
+
+/* Names of the render modes used by the command line tools, in enum render_mode order */
+extern const char* const render_mode_names[RENDER_MODE_COUNT];
+
+/* Function to draw a grid, only into the tiles the last color clear wiped since the others still have it */
 void draw_grid(void);
 
 /* Function to draw a single pixel */
 void draw_pixel(int x, int y, uint32_t color);
 
-/* Function to draw a line */
+/* Function to draw a line, clipped to the screen */
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 
 /* Function to draw a triangle */
@@ -53,31 +60,39 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
 
 /* Function to draw a filled triangle */
 void draw_filled_triangle(
-	int x0, int y0, float z0, float w0, 
-	int x1, int y1, float z1, float w1, 
-	int x2, int y2, float z2, float w2, 
+	float x0, float y0, float z0, float w0, 
+	float x1, float y1, float z1, float w1, 
+	float x2, float y2, float z2, float w2, 
 	uint32_t color);
 
+/* Function to draw a filled triangle, only touching the pixels inside the clip rectangle, adding the pixels it tested and wrote to counts */
+void draw_filled_triangle_clipped(
+	float x0, float y0, float z0, float w0,
+	float x1, float y1, float z1, float w1,
+	float x2, float y2, float z2, float w2,
+	uint32_t color, rect_t clip, pixel_counts_t* counts);
+
 /* Function to draw a textured triangle */
 void draw_textured_triangle(
-	int x0, int y0, float z0, float w0, float u0, float v0, 
-	int x1, int y1, float z1, float w1, float u1, float v1, 
-	int x2, int y2, float z2, float w2, float u2, float v2, 
-	uint32_t* texture);
+	float x0, float y0, float z0, float w0, float u0, float v0, 
+	float x1, float y1, float z1, float w1, float u1, float v1, 
+	float x2, float y2, float z2, float w2, float u2, float v2, 
+	const texture_level_t* texture);
+
+/* Function to draw a textured triangle, only touching the pixels inside the clip rectangle, adding the pixels it tested and wrote to counts */
+void draw_textured_triangle_clipped(
+	float x0, float y0, float z0, float w0, float u0, float v0,
+	float x1, float y1, float z1, float w1, float u1, float v1,
+	float x2, float y2, float z2, float w2, float u2, float v2,
+	const texture_level_t* texture, rect_t clip, pixel_counts_t* counts);
 
 /* Function to draw a rectangle */
 void draw_rect(int x, int y, int width, int height, uint32_t color);
 
-/* Function to render the color buffer */
-void render_color_buffer(void);
-
-/* Function to clear the color buffer */
+/* Function to clear the color buffer, only the tiles drawn into since the last clear are touched */
 void clear_color_buffer(uint32_t color);
 
-/* Function to clear the depth buffer */
+/* Function to clear the depth buffer, in O(1): every tile is cleared lazily by the first triangle drawn into it */
 void clear_depth_buffer(void);
 
-/* Function to destroy the window */
-void destroy_window(void);
-
 #endif /* DISPLAY_H */
\ No newline at end of file
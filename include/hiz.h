@@ -0,0 +1,44 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <stdbool.h>
+#include "display.h"
+#include "rasterizer.h"
+
+/* Fine level: farthest depth of every 8x8 block of pixels */
+#define HIZ_BLOCK_SIZE 8
+
+/* Coarse level: farthest depth of every 64x64 block, the same as a screen tile so each thread owns its entries */
+#define HIZ_COARSE_BLOCK_SIZE 64
+
+/* Triangles with a bounding box smaller than this many pixels skip the block tests */
+#define HIZ_MIN_TEST_AREA (HIZ_BLOCK_SIZE * HIZ_BLOCK_SIZE)
+
+/* Walks the rows of 8x8 blocks of a triangle, yielding runs of blocks that may still be visible */
+typedef struct
+{
+	rect_t bounds;          /* bounding box of the triangle */
+	float nearest_depth;    /* smallest stored depth of the triangle, see depth_key */
+	int block_x, block_y;   /* next block to test */
+	int min_block_x;
+	int max_block_x, max_block_y;
+	bool test_blocks;       /* false for small triangles, they are yielded in one run */
+	bool done;
+} hiz_iterator_t;
+
+/* Function to allocate the depth hierarchy for the current window size */
+bool hiz_init(void);
+
+/* Function to reset every level to the far plane, together with the depth buffer */
+void hiz_clear(void);
+
+/* Function to start walking the bounding box of a set up triangle, rejecting it whole if it is hidden */
+void hiz_begin(hiz_iterator_t* iterator, const triangle_edges_t* edges, float nearest_depth);
+
+/* Function to get the next run of blocks the triangle may be visible in, returns false when done */
+bool hiz_next_run(hiz_iterator_t* iterator, rect_t* run);
+
+/* Function to free the depth hierarchy */
+void hiz_destroy(void);
+
+#endif // !HIZ_H
@@ -3,6 +3,8 @@
 
 #include "vector.h"
 #include "triangle.h"
+#include "vertex.h"
+#include "clipping.h"
 
 /* Constants for cube mesh */
 #define N_CUBE_VERTICES 8
@@ -12,23 +14,21 @@
 extern vec3_t cube_vertices[N_CUBE_VERTICES];
 extern face_t cube_faces[N_CUBE_FACES];
 
-/* Structure for dynamic size meshes, with array of vertices and faces */
+/* Structure for dynamic size meshes, with array of vertices and faces, placed in the world by the instances drawing it */
 typedef struct
 {
-    vec3_t* vertices; /* dynamic array of vertices */
+    vertex_buffer_t vertices; /* positions of the vertices, one array per coordinate */
     face_t* faces;    /* dynamic array of faces */
-    vec3_t rotation;  /* rotation with x, y, and z values */
-	vec3_t scale;     /* scale with x, y, and z values */
-	vec3_t translation; /* translation with x, y, and z values */
+	bounds_t bounds;  /* box and sphere around the vertices, in model space */
 } mesh_t;
 
-/* External declaration for global mesh */
-extern mesh_t mesh;
-
 /* Function to load cube mesh data */
-void load_cube_mesh_data(void);
+bool load_cube_mesh_data(mesh_t* mesh);
+
+/* Function to load mesh data from an OBJ file, returns false if the file cannot be opened */
+bool load_obj_file_data(mesh_t* mesh, const char* filename);
 
-/* Function to load mesh data from an OBJ file */
-void load_obj_file_data(char* filename);
+/* Function to free the vertices and faces of a mesh */
+void free_mesh(mesh_t* mesh);
 
 #endif /* MESH_H */
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include "depth.h"
+
+/*
+ * The renderer core: transforms the instances of the global scene seen from the global camera into
+ * triangles and draws them into the render target, in the current render_mode. It never touches a
+ * window, so it runs the same with or without a display.
+ */
+
+/* Number of triangles the last pipeline_update produced for the rasterizer */
+extern int num_triangles_to_render;
+
+/* Function to create the render target and everything the pipeline needs to draw into it, with depth stored in a format,
+   reversed_depth stores -1/w instead of 1 - 1/w in the float format */
+bool pipeline_init(int width, int height, enum depth_format format, bool reversed_depth);
+
+/* Function to transform, light and project every instance of the scene into the triangles of the next frame */
+void pipeline_update(void);
+
+/* Function to draw the triangles of the frame into the render target */
+void pipeline_render(void);
+
+/* Function to stop the rasterizer threads and free the render target */
+void pipeline_destroy(void);
+
+#endif // !PIPELINE_H
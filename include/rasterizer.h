@@ -0,0 +1,151 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "display.h"
+#include "depth.h"
+
+/* SIMD kernels are only built for x86 and x64 targets, everything else uses the scalar kernels */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RASTERIZER_X86 1
+#endif
+
+/* Instruction sets the pixel kernels can be built for */
+enum raster_isa
+{
+	RASTER_ISA_SCALAR,
+	RASTER_ISA_SSE2,
+	RASTER_ISA_AVX2,
+	RASTER_ISA_COUNT
+};
+
+/* Names of the instruction sets used by the command line tools, in enum raster_isa order */
+extern const char* const raster_isa_names[RASTER_ISA_COUNT];
+
+/* Vertex positions are snapped to 28.4 fixed point, 16 sub-pixel steps per pixel */
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+/* Triangles narrower than this many pixels are covered with per-pixel edge tests by the flat colored kernels,
+   wider ones are solved row by row for their covered span */
+#define SPAN_MIN_WIDTH 32
+
+/* Vertices farther than this many pixels from the origin would overflow the fixed point edge functions */
+#define MAX_RASTER_COORDINATE (1 << 25)
+
+/*
+ * Edge functions of a screen-space triangle, set up once and stepped per pixel.
+ * They are exact 64-bit integers computed from the 28.4 vertices, sampled at pixel
+ * centers, and pixels exactly on an edge are only covered by the triangle the edge
+ * is a top or left edge of.
+ */
+typedef struct
+{
+	int min_x, min_y;          /* bounding box of the covered pixels, clipped to the clip rectangle */
+	int max_x, max_y;
+	int clip_max_x;            /* right end of the clip rectangle, pixels up to it belong to the thread drawing the triangle */
+	int64_t edge_origin[3];    /* edge functions at the center of pixel (min_x, min_y), fill rule bias included */
+	int64_t edge_dx[3];        /* increment of each edge function per pixel */
+	int64_t edge_dy[3];        /* increment of each edge function per row */
+	bool fits_32bit;           /* the edge functions stay inside 32 bits over the bounding box (SIMD kernels) */
+	double edge_dx_reciprocal[3]; /* 1 / edge_dx, 0 for horizontal steps, to solve rows for their span without dividing */
+	float weight_origin[3];    /* barycentric weights at the center of pixel (min_x, min_y) */
+	float weight_dx[3];        /* increment of each barycentric weight per pixel */
+	float weight_dy[3];        /* increment of each barycentric weight per row */
+} triangle_edges_t;
+
+/* Linear attribute plane in screen space: value = origin + dx * (x - min_x) + dy * (y - min_y) */
+typedef struct
+{
+	float origin;
+	float dx;
+	float dy;
+} attribute_plane_t;
+
+/* Pixel kernels that walk the bounding box of a set up triangle and depth test every covered pixel.
+   The flat colored ones solve the edge functions for the covered span of each row instead of testing every pixel. */
+typedef void (*fill_kernel_t)(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color, pixel_counts_t* counts);
+typedef void (*texture_kernel_t)(
+	const triangle_edges_t* edges,
+	const attribute_plane_t* reciprocal_w,
+	const attribute_plane_t* u_over_w,
+	const attribute_plane_t* v_over_w,
+	const texture_level_t* texture,
+	pixel_counts_t* counts);
+
+/* Kernels used by the triangle draw functions, set by rasterizer_select_isa, the textured ones are indexed by the wrap of the texture level.
+   The SIMD kernels step the edge functions in 32 bits, triangles without fits_32bit use scalar or span code. */
+extern fill_kernel_t fill_triangle_kernel;
+extern const texture_kernel_t* texture_triangle_kernels;
+
+/*
+ * Every kernel is written once as a body taking the depth format, and the texture wrap of the textured
+ * ones, as constant arguments. These define one function per combination around it and a table of them
+ * indexed by the format and the wrap, so the hot loops test neither.
+ */
+#define DEFINE_FILL_KERNELS(name, body) \
+	static void name##_float32(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color, pixel_counts_t* counts) \
+	{ body(edges, reciprocal_w, color, counts, DEPTH_FLOAT32); } \
+	static void name##_unorm24(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color, pixel_counts_t* counts) \
+	{ body(edges, reciprocal_w, color, counts, DEPTH_UNORM24); } \
+	static void name##_unorm16(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color, pixel_counts_t* counts) \
+	{ body(edges, reciprocal_w, color, counts, DEPTH_UNORM16); } \
+	const fill_kernel_t name[DEPTH_FORMAT_COUNT] = { name##_float32, name##_unorm24, name##_unorm16 }
+
+#define DEFINE_TEXTURE_KERNEL(name, body, format, wrap) \
+	static void name(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, \
+		const attribute_plane_t* u_over_w, const attribute_plane_t* v_over_w, const texture_level_t* texture, pixel_counts_t* counts) \
+	{ body(edges, reciprocal_w, u_over_w, v_over_w, texture, counts, format, wrap); }
+
+#define DEFINE_TEXTURE_KERNELS(name, body) \
+	DEFINE_TEXTURE_KERNEL(name##_float32_npot, body, DEPTH_FLOAT32, TEXTURE_WRAP_NPOT) \
+	DEFINE_TEXTURE_KERNEL(name##_float32_pow2, body, DEPTH_FLOAT32, TEXTURE_WRAP_POW2) \
+	DEFINE_TEXTURE_KERNEL(name##_unorm24_npot, body, DEPTH_UNORM24, TEXTURE_WRAP_NPOT) \
+	DEFINE_TEXTURE_KERNEL(name##_unorm24_pow2, body, DEPTH_UNORM24, TEXTURE_WRAP_POW2) \
+	DEFINE_TEXTURE_KERNEL(name##_unorm16_npot, body, DEPTH_UNORM16, TEXTURE_WRAP_NPOT) \
+	DEFINE_TEXTURE_KERNEL(name##_unorm16_pow2, body, DEPTH_UNORM16, TEXTURE_WRAP_POW2) \
+	const texture_kernel_t name[DEPTH_FORMAT_COUNT][TEXTURE_WRAP_COUNT] = { \
+		{ name##_float32_npot, name##_float32_pow2 }, \
+		{ name##_unorm24_npot, name##_unorm24_pow2 }, \
+		{ name##_unorm16_npot, name##_unorm16_pow2 } \
+	}
+
+/* Function to snap triangle ABC to the sub-pixel grid and set up its edge equations, returns false if no pixel is covered */
+bool setup_triangle_edges(triangle_edges_t* edges, vec4_t a, vec4_t b, vec4_t c, rect_t clip);
+
+/* Function to compute the screen-space gradients of an attribute with values f0, f1 and f2 at the vertices */
+attribute_plane_t setup_attribute_plane(const triangle_edges_t* edges, float f0, float f1, float f2);
+
+/* Function to narrow set up edges to the part of their bounding box inside rect, returns false if nothing is left */
+bool narrow_triangle_edges(const triangle_edges_t* edges, rect_t rect, triangle_edges_t* narrowed);
+
+/* Function to move the origin of an attribute plane along with edges narrowed by narrow_triangle_edges */
+attribute_plane_t narrow_attribute_plane(const triangle_edges_t* edges, const triangle_edges_t* narrowed, const attribute_plane_t* plane);
+
+/* Function to find the covered pixels [*start, *end] of a row from its edge function values at min_x, returns false if there are none */
+bool triangle_row_span(const triangle_edges_t* edges, const int64_t edge_row[3], int* start, int* end);
+
+/* Function to find the widest instruction set supported by both the build and the CPU */
+enum raster_isa rasterizer_detect_isa(void);
+
+/* Function to switch the pixel kernels to the ones for the depth format, falls back to narrower ones the CPU cannot run.
+   Call it again after depth_init changes the format. */
+enum raster_isa rasterizer_select_isa(enum raster_isa isa);
+
+/* Scalar kernels, always available */
+extern const fill_kernel_t fill_triangle_scalar[DEPTH_FORMAT_COUNT];
+extern const texture_kernel_t texture_triangle_scalar[DEPTH_FORMAT_COUNT][TEXTURE_WRAP_COUNT];
+
+#ifdef RASTERIZER_X86
+/* 4 pixels wide kernels (rasterizer_sse2.c) */
+extern const fill_kernel_t fill_triangle_sse2[DEPTH_FORMAT_COUNT];
+extern const texture_kernel_t texture_triangle_sse2[DEPTH_FORMAT_COUNT][TEXTURE_WRAP_COUNT];
+
+/* 8 pixels wide kernels (rasterizer_avx2.c) */
+extern const fill_kernel_t fill_triangle_avx2[DEPTH_FORMAT_COUNT];
+extern const texture_kernel_t texture_triangle_avx2[DEPTH_FORMAT_COUNT][TEXTURE_WRAP_COUNT];
+#endif
+
+#endif // !RASTERIZER_H
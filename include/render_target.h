@@ -0,0 +1,25 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Buffers the renderer draws into, a window presents the color buffer while headless renders read it back from memory */
+typedef struct
+{
+	int width;
+	int height;
+	uint32_t* color_buffer;     /* RGBA32 pixels, row by row */
+	void* depth_buffer;         /* pixels in depth_format, row by row, allocated by depth_init */
+} render_target_t;
+
+/* External declaration for the render target every draw function writes to */
+extern render_target_t render_target;
+
+/* Function to size the render target and allocate its color buffer */
+bool render_target_init(int width, int height);
+
+/* Function to free the color buffer of the render target */
+void render_target_destroy(void);
+
+#endif // !RENDER_TARGET_H
@@ -0,0 +1,95 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "texture.h"
+#include "wireframe.h"
+
+/* Most levels of detail of an asset, the loaded mesh and the coarser ones simplified from it */
+#define SCENE_MAX_LODS 4
+
+/* Every level has about this fraction of the faces of the one before it, the screen area it is drawn at shrinks by as much */
+#define SCENE_LOD_FACE_RATIO 4
+
+/* Meshes are not simplified below this many faces */
+#define SCENE_LOD_MIN_FACES 64
+
+/* The simplification stops at the first collapse moving the surface by more than this fraction of the bounding sphere radius, on average over the faces it replaces */
+#define SCENE_LOD_MAX_ERROR 0.05f
+
+/* A level is drawn while its surface is at most this many pixels away from the one of the loaded mesh */
+#define SCENE_LOD_ERROR_PIXELS 0.75f
+
+/* An instance only moves to a coarser level once it is this much smaller than where the level starts, so it does not flicker at the boundary */
+#define SCENE_LOD_HYSTERESIS 0.15f
+
+/* One level of detail of an asset, with the largest projected bounding sphere radius it is drawn at */
+typedef struct
+{
+	mesh_t mesh;
+	wireframe_t wireframe;
+	float max_radius;   /* in pixels, unbounded for the loaded mesh */
+} scene_lod_t;
+
+/* A model loaded once, its levels of detail, texture and wireframe edges are shared by every instance drawing it */
+typedef struct
+{
+	scene_lod_t lods[SCENE_MAX_LODS];   /* lods[0] is the mesh as loaded, its bounds hold for every level */
+	int num_lods;
+	texture_t texture;
+} scene_asset_t;
+
+/* One placement of an asset in the world, all it costs per frame is its matrix and its culling */
+typedef struct
+{
+	int asset;          /* index into scene.assets */
+	vec3_t rotation;    /* rotation with x, y, and z values */
+	vec3_t scale;       /* scale with x, y, and z values */
+	vec3_t translation; /* translation with x, y, and z values */
+	bool moved;         /* set by scene_instance_moved, cleared once the spatial index has refit its bounds */
+	int lod;            /* level of detail drawn last frame */
+} scene_instance_t;
+
+/* Everything the pipeline draws: the assets, and the instances placing them in the world */
+typedef struct
+{
+	scene_asset_t* assets;
+	int num_assets;
+	int assets_capacity;
+	scene_instance_t* instances;
+	int num_instances;
+	int instances_capacity;
+	int* moved_instances;       /* instances flagged as moved since the spatial index last caught up */
+	int num_moved_instances;
+	int moved_instances_capacity;
+	unsigned int layout_version;    /* bumped whenever instances are added or removed */
+} scene_t;
+
+/* External declaration for the global scene */
+extern scene_t scene;
+
+/* Function to load a model and its texture as a new asset, returns its index or -1 if either cannot be loaded */
+int scene_load_asset(const char* obj_filename, const char* png_filename);
+
+/* Function to place a new instance of an asset at the origin, unrotated and unscaled, returns its index or -1 */
+int scene_add_instance(int asset);
+
+/* Function to tell the scene an instance was moved, rotated or scaled, its bounds are refit before the next frame */
+void scene_instance_moved(int instance);
+
+/* Function to pick the level of detail of an instance from the radius of its bounding sphere on screen, in pixels, returns it */
+int scene_select_lod(scene_instance_t* instance, float projected_radius);
+
+/* Function to build the world matrix of an instance: scale, then rotation, then translation */
+mat4_t scene_instance_world_matrix(const scene_instance_t* instance);
+
+/* Function to remove every instance, keeping the assets loaded */
+void scene_clear_instances(void);
+
+/* Function to free every asset and instance of the scene */
+void scene_destroy(void);
+
+#endif // !SCENE_H
@@ -0,0 +1,20 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "mesh.h"
+
+/*
+ * Mesh simplification by quadric edge collapse: the edge whose removal moves the surface the least is
+ * collapsed first, by moving one of its vertices onto the other, so every level keeps a subset of the
+ * original positions. Vertices on a UV seam or an open border only slide along it, and the texture
+ * coordinates of every corner are carried over from the side of the seam the corner is on, so no
+ * texture is torn apart and no hole opens up.
+ */
+
+/* Function to simplify a mesh into coarser levels in one pass, levels[i] gets at most target_faces[i] faces where the collapses allow it,
+   and errors[i] the largest distance of an original vertex to its surface, in model units. No collapse moves the surface by more than
+   max_error, as the root mean square distance to the planes of the faces it replaces.
+   Returns the number of levels made, the chain stops at the first level that cannot be made noticeably coarser than the one before */
+int mesh_simplify(const mesh_t* mesh, const int* target_faces, int num_targets, float max_error, mesh_t* levels, float* errors);
+
+#endif // !SIMPLIFY_H
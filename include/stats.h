@@ -0,0 +1,73 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of past frames kept in the ring buffer */
+#define STATS_HISTORY 256
+
+/* Stages of a frame that are timed, in the order they run */
+enum stats_stage
+{
+	STAGE_TRANSFORM,    /* instance hierarchy and culling, and world, view and projection transform of the mesh vertices */
+	STAGE_CULL,         /* dropping faces outside the frustum, face normals and backface culling */
+	STAGE_CLIP,         /* clipping in homogeneous space against the near, far and guard band planes */
+	STAGE_PROJECT,      /* perspective divide, lighting and mip selection into the triangles to render */
+	STAGE_CLEAR,        /* color and depth clears */
+	STAGE_RASTER,       /* grid, triangles and wireframe */
+	STAGE_PRESENT,      /* upload and present in the window */
+	STAGE_COUNT
+};
+
+/* Work counted every frame */
+enum stats_counter
+{
+	COUNTER_BVH_NODES_VISITED,      /* nodes of the instance hierarchy tested against the frustum */
+	COUNTER_INSTANCES_CULLED,       /* instances whose bounds are outside the frustum, none of their faces are processed */
+	COUNTER_TRIANGLES_IN,           /* faces of the level of detail drawn of every instance in the frustum */
+	COUNTER_TRIANGLES_CULLED,       /* faces facing away from the camera */
+	COUNTER_TRIANGLES_CLIPPED,      /* faces crossing or outside a frustum plane */
+	COUNTER_TRIANGLES_RASTERIZED,   /* triangles handed to the tile rasterizer */
+	COUNTER_PIXELS_TESTED,          /* covered pixels that were depth tested */
+	COUNTER_PIXELS_WRITTEN,         /* pixels that passed the depth test and were written */
+	COUNTER_COUNT
+};
+
+/* Timings and counters of one frame */
+typedef struct
+{
+	uint64_t frame;                     /* frame number, counting from 0 */
+	double stage_ms[STAGE_COUNT];
+	uint64_t counters[COUNTER_COUNT];
+} frame_stats_t;
+
+/* Names of the stages and counters, as printed by stats_dump */
+extern const char* const stats_stage_names[STAGE_COUNT];
+extern const char* const stats_counter_names[COUNTER_COUNT];
+
+/* Function to start recording a new frame, overwriting the oldest one once the ring buffer is full */
+void stats_begin_frame(void);
+
+/* Function to read the timer the stages are measured with */
+uint64_t stats_now(void);
+
+/* Function to add the time since start to a stage of the current frame, returns the current time to start the next stage with */
+uint64_t stats_end_stage(enum stats_stage stage, uint64_t start);
+
+/* Function to add to a counter of the current frame */
+void stats_add_count(enum stats_counter counter, uint64_t count);
+
+/* Function to get the number of frames in the ring buffer */
+int stats_frame_count(void);
+
+/* Function to get a recorded frame, 0 is the current one, returns NULL for frames that are no longer kept */
+const frame_stats_t* stats_frame(int frames_ago);
+
+/* Function to average the last frames in the ring buffer, returns how many were averaged */
+int stats_average(int frames, frame_stats_t* average);
+
+/* Function to print every frame in the ring buffer and their average */
+void stats_dump(FILE* file);
+
+#endif // !STATS_H
@@ -0,0 +1,29 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Writes the frames of the render target one after another to a file or to stdout, so they can be piped
+ * straight into a video encoder. Every frame is written out as soon as it is rendered, only one frame is
+ * held in memory for the color conversion.
+ */
+
+/* Formats of a frame stream */
+enum stream_format
+{
+	STREAM_Y4M,     /* YUV4MPEG2 with 4:2:0 chroma, what video encoders read from a pipe */
+	STREAM_PPM      /* binary PPM images back to back */
+};
+
+/* Function to start a stream of frames of the size of the render target, a path of "-" writes to stdout */
+bool stream_open(const char* path, enum stream_format format, int frames_per_second);
+
+/* Function to write the color buffer of the render target as the next frame of the stream */
+bool stream_write_frame(void);
+
+/* Function to flush and close the stream */
+bool stream_close(void);
+
+#endif // !STREAM_H
@@ -2,6 +2,8 @@
 #define TEXTURE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include "upng.h"
 
 /* Structure for 2D texture coordinates */
@@ -11,13 +13,65 @@ typedef struct
 	float v;
 } tex2_t;
 
-/* External declarations for texture data */
-extern int tex_width;
-extern int tex_height;
+/*
+ * Textures are swizzled into tiles of 32x32 texels, 4 KB each, stored tile row by tile row.
+ * The texels inside a tile are in Morton (Z) order, so texels that are close in any direction
+ * are close in memory: a 4x4 block fills one cache line and a tile one page. Textures whose
+ * size is not a multiple of the tile size are padded.
+ */
+#define TEXTURE_TILE_BITS 5
+#define TEXTURE_TILE_SIZE (1 << TEXTURE_TILE_BITS)
 
-extern upng_t* png_texture;
-extern uint32_t* mesh_texture;
+/* Most levels of a mipmap chain, enough for textures of up to 32768 texels on a side */
+#define TEXTURE_MAX_LEVELS 16
 
-void load_png_texture_data(const char* filename);
+/* How texel coordinates wrap around a level, the kernels are specialized for each one */
+enum texture_wrap
+{
+	TEXTURE_WRAP_NPOT,      /* any size, wrapped with a modulo */
+	TEXTURE_WRAP_POW2,      /* power of two width and height, wrapped with a mask */
+	TEXTURE_WRAP_COUNT
+};
+
+/* One level of a mipmap chain, swizzled into the tiled layout */
+typedef struct
+{
+	uint32_t* texels;
+	int width;
+	int height;
+	enum texture_wrap wrap;
+	/* Offsets of the columns and rows in the tiled layout, a texel is at the sum of the two.
+	   Morton indices are separable like this, the bits of x and y never overlap. */
+	int* column_offsets;
+	int* row_offsets;
+} texture_level_t;
+
+/* Mipmap chain of a texture, level 0 is the full resolution texture and every level halves the previous one */
+typedef struct
+{
+	texture_level_t levels[TEXTURE_MAX_LEVELS];
+	int level_count;
+} texture_t;
+
+/* Function to decode a PNG file into the levels of a mipmap chain, swizzled into the tiled layout, returns false if it cannot be loaded */
+bool load_png_texture_data(texture_t* texture, const char* filename);
+
+/* Function to pick the mipmap level of a triangle from twice its area in texture coordinates and on the screen */
+int texture_select_level(const texture_t* texture, float uv_area, float screen_area);
+
+/* Function to free the mipmap chain */
+void free_texture(texture_t* texture);
+
+/* Wraps a texel coordinate inside a level of the given size, kernels pass the wrap mode as a constant */
+static inline int texture_wrap_coordinate(int coordinate, int size, enum texture_wrap wrap)
+{
+	return (wrap == TEXTURE_WRAP_POW2) ? (abs(coordinate) & (size - 1)) : (abs(coordinate) % size);
+}
+
+/* Index of texel (x, y) of a level in the tiled layout, both coordinates already wrapped inside the level */
+static inline int texel_index(const texture_level_t* level, int x, int y)
+{
+	return level->column_offsets[x] + level->row_offsets[y];
+}
 
 #endif // TEXTURE_H
\ No newline at end of file
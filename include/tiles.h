@@ -0,0 +1,35 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "triangle.h"
+#include "display.h"
+
+/* Width and height in pixels of the screen tiles that triangles are binned into */
+#define TILE_SIZE 64
+
+/* What the tile rasterizer writes into the color buffer */
+enum tile_shading
+{
+	TILE_SHADE_FLAT,        /* the color of the triangle */
+	TILE_SHADE_TEXTURED,    /* perspective correct texels */
+	TILE_SHADE_TRIANGLE_ID  /* the index of the triangle plus one */
+};
+
+/* Work run on the pixels of one tile, every tile is handed to exactly one thread */
+typedef void (*tile_job_t)(rect_t tile);
+
+/* Function to create the tile grid and the rasterizer worker threads (0 picks one per CPU core) */
+bool tiles_init(int num_threads);
+
+/* Function to bin the triangles into screen tiles and rasterize the tiles in parallel */
+void tiles_render_triangles(const triangle_t* triangles, int num_triangles, enum tile_shading shading);
+
+/* Function to run a job on the pixels of every tile in parallel */
+void tiles_for_each(tile_job_t job);
+
+/* Function to stop the worker threads and free the tile bins */
+void tiles_destroy(void);
+
+#endif // !TILES_H
@@ -23,6 +23,8 @@ typedef struct
     vec4_t points[3];
 	tex2_t texcoords[3];
 	uint32_t color;
+	float light_intensity;
+	const texture_level_t* texture;     /* mipmap level of the texture of its mesh the triangle is textured from */
 } triangle_t;
 
 #endif /* TRIANGLE_H */
\ No newline at end of file
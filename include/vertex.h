@@ -0,0 +1,89 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "rasterizer.h"
+
+/* Vertices are transformed in batches of up to this many, every array is padded to a whole number of batches */
+#define VERTEX_BATCH 8
+
+/* Every array starts on this many bytes, so a batch is one aligned AVX2 load or store */
+#define VERTEX_ALIGNMENT 32
+
+/* Clip-space planes a vertex lies outside of, a face outside the same plane with all three vertices is invisible.
+   The clipper uses the same bits for the planes it clips against, with the sides moved out to CLIP_GUARD_BAND * w. */
+enum vertex_outcode
+{
+	OUTCODE_LEFT = 1 << 0,      /* x < -w */
+	OUTCODE_RIGHT = 1 << 1,     /* x > w */
+	OUTCODE_BOTTOM = 1 << 2,    /* y < -w */
+	OUTCODE_TOP = 1 << 3,       /* y > w */
+	OUTCODE_NEAR = 1 << 4,      /* z < 0 */
+	OUTCODE_FAR = 1 << 5,       /* z > w */
+	OUTCODE_PLANES = 6          /* number of planes, the bit of plane i is 1 << i */
+};
+
+/* Positions of a mesh as a structure of arrays, padded with zeros up to a whole batch */
+typedef struct
+{
+	float* x;
+	float* y;
+	float* z;
+	int count;
+	void* memory;   /* one allocation holding the arrays */
+} vertex_buffer_t;
+
+/* Vertices after the transform: camera space for normals and lighting, clip space for projection, and their outcodes */
+typedef struct
+{
+	float* view_x;
+	float* view_y;
+	float* view_z;
+	float* clip_x;
+	float* clip_y;
+	float* clip_z;
+	float* clip_w;
+	uint8_t* outcodes;
+	int capacity;
+	void* memory;
+} transformed_vertices_t;
+
+/* Kernel transforming every vertex of a buffer with the affine world-view matrix into camera space, and on with the projection into clip space */
+typedef void (*vertex_kernel_t)(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed);
+
+/* Kernel used by vertex_transform, set by vertex_select_isa */
+extern vertex_kernel_t vertex_transform_kernel;
+
+/* Function to copy positions into a vertex buffer, replacing what it held */
+bool vertex_buffer_init(vertex_buffer_t* buffer, const vec3_t* positions, int count);
+
+/* Function to free the arrays of a vertex buffer */
+void vertex_buffer_destroy(vertex_buffer_t* buffer);
+
+/* Function to make room for transforming count vertices, keeps the arrays when they are large enough */
+bool transformed_vertices_reserve(transformed_vertices_t* transformed, int count);
+
+/* Function to free the arrays of transformed vertices */
+void transformed_vertices_destroy(transformed_vertices_t* transformed);
+
+/* Function to transform every vertex of a buffer, transformed has to have room for them */
+void vertex_transform(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed);
+
+/* Function to switch the vertex kernel, falls back to narrower ones the CPU cannot run */
+enum raster_isa vertex_select_isa(enum raster_isa isa);
+
+/* Scalar kernel, always available */
+void vertex_transform_scalar(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed);
+
+#ifdef RASTERIZER_X86
+/* 4 vertices wide kernel (vertex_sse2.c) */
+void vertex_transform_sse2(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed);
+
+/* 8 vertices wide kernel (vertex_avx2.c) */
+void vertex_transform_avx2(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed);
+#endif
+
+#endif // !VERTEX_H
@@ -0,0 +1,17 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "triangle.h"
+
+/* Function to allocate the triangle id buffer for the current window size */
+bool visibility_init(void);
+
+/* Function to rasterize triangle ids and depth, then texture and light every visible pixel exactly once */
+void visibility_render(const triangle_t* triangles, int num_triangles);
+
+/* Function to free the triangle id buffer */
+void visibility_destroy(void);
+
+#endif // !VISIBILITY_H
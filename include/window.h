@@ -0,0 +1,26 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+
+/* Constants for frame rate */
+#define FPS 60 
+#define FRAME_TARGET_TIME (1000 / FPS)
+
+/* External declarations for the window the render target is presented in */
+extern SDL_Window* window;
+extern SDL_Renderer* renderer;
+extern SDL_Texture* color_buffer_texture;
+
+/* Function to initialize a borderless window covering the display, returns its size */
+bool initialize_window(int* width, int* height);
+
+/* Function to render the color buffer of the render target */
+void render_color_buffer(void);
+
+/* Function to destroy the window */
+void destroy_window(void);
+
+#endif /* WINDOW_H */
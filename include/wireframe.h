@@ -0,0 +1,52 @@
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "triangle.h"
+
+/* Size in pixels of the square drawn on every vertex */
+#define WIREFRAME_VERTEX_SIZE 6
+
+/* Edge between two mesh vertices, shared by every face that uses it */
+typedef struct
+{
+	int a, b;
+} wire_edge_t;
+
+/* Unique edges of a mesh, and the index of each of the three edges of every face, shared by every instance of the mesh */
+typedef struct
+{
+	wire_edge_t* edges;
+	int num_edges;
+	int* face_edges;
+	int* face_vertices;
+	int num_vertices;
+} wireframe_t;
+
+/* Function to build the unique edges of a mesh, call it again whenever the mesh is reloaded */
+bool wireframe_init(wireframe_t* wireframe, const face_t* faces, int num_faces, int num_vertices);
+
+/* Function to free the edge lists of a mesh */
+void wireframe_free(wireframe_t* wireframe);
+
+/* Function to start a new frame, forgetting the lines of the previous one */
+void wireframe_begin_frame(void);
+
+/* Function to start collecting the visible faces of one instance of a mesh */
+bool wireframe_begin_instance(const wireframe_t* wireframe);
+
+/* Function to mark a face of the current instance as visible this frame, with its three projected screen points */
+void wireframe_add_face(int face_index, const vec4_t projected_points[3]);
+
+/* Function to add every edge and vertex of the visible faces of the current instance to the frame, once each */
+void wireframe_end_instance(void);
+
+/* Function to draw the edges of the frame, and optionally its vertices */
+void wireframe_render(uint32_t edge_color, bool draw_vertices, uint32_t vertex_color);
+
+/* Function to free the lines of the frame and the marks of the instances */
+void wireframe_destroy(void);
+
+#endif // !WIREFRAME_H
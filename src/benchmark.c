@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+#include "array.h"
+#include "camera.h"
+#include "display.h"
+#include "scene.h"
+#include "rasterizer.h"
+#include "depth.h"
+#include "stats.h"
+#include "pipeline.h"
+
+/*
+ * Renders every bundled model in every render mode and depth format along the same scripted camera path,
+ * without a window and without waiting for a frame rate, and prints the results as JSON:
+ *   3D-Renderer-benchmark [assets_directory width height frames depth]
+ * The path only depends on the frame number, so two runs render exactly the same frames. Giving one of
+ * the depth names below only measures that depth format.
+ */
+
+/* Bundled models with the texture they are drawn with, the sphere has no texture of its own */
+static const char* const benchmark_models[][2] = {
+	{ "cube", "cube" },
+	{ "crab", "crab" },
+	{ "drone", "drone" },
+	{ "efa", "efa" },
+	{ "f117", "f117" },
+	{ "f22", "f22" },
+	{ "sphere", "pikuma" }
+};
+#define NUM_BENCHMARK_MODELS ((int)(sizeof(benchmark_models) / sizeof(benchmark_models[0])))
+
+/* Depth formats the models are rendered with, each one measured on its own */
+static const struct
+{
+	const char* name;
+	enum depth_format format;
+	bool reversed;
+} benchmark_depths[] = {
+	{ "float32", DEPTH_FLOAT32, false },
+	{ "float32_reversed", DEPTH_FLOAT32, true },
+	{ "unorm24", DEPTH_UNORM24, false },
+	{ "unorm16", DEPTH_UNORM16, false }
+};
+#define NUM_BENCHMARK_DEPTHS ((int)(sizeof(benchmark_depths) / sizeof(benchmark_depths[0])))
+
+/* Frames rendered before measuring, so the caches, tiles and threads are warmed up */
+#define WARMUP_FRAMES 5
+
+/* Where the models are placed, the camera circles around it */
+#define MODEL_DISTANCE 5.0f
+
+/* Timings of one model in one render mode and depth format */
+typedef struct
+{
+	double* frame_ms;        /* time of every measured frame */
+	frame_stats_t totals;    /* stage times and counters summed over the measured frames */
+} benchmark_run_t;
+
+/* Milliseconds between two performance counter values */
+static double elapsed_ms(uint64_t start, uint64_t end)
+{
+	return (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+/* Sorts frame times in ascending order */
+static int compare_ms(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted frame times */
+static double percentile(const double* sorted, int count, double p)
+{
+	int rank = (int)ceil(p / 100.0 * count);
+	rank = (rank > 1) ? rank : 1;
+	return sorted[rank - 1];
+}
+
+/* Adds the stage times and counters of a frame to totals */
+static void add_frame_stats(frame_stats_t* totals, const frame_stats_t* frame)
+{
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		totals->stage_ms[stage] += frame->stage_ms[stage];
+	}
+	for (int counter = 0; counter < COUNTER_COUNT; counter++)
+	{
+		totals->counters[counter] += frame->counters[counter];
+	}
+}
+
+/* Places the camera at a frame of the path: one orbit around the model, moving in and out twice and bobbing up and down */
+static void place_camera(int frame, int frames)
+{
+	float t = (float)frame / (float)frames;
+	float angle = 2.0f * (float)M_PI * t;
+	float radius = 4.75f - 1.25f * cosf(2.0f * angle);
+
+	camera.position.x = radius * sinf(angle);
+	camera.position.y = 0.5f * sinf(3.0f * angle);
+	camera.position.z = MODEL_DISTANCE - radius * cosf(angle);
+
+	// Look at the model, the view direction is the z-axis rotated by the yaw
+	camera.yaw = atan2f(-camera.position.x, MODEL_DISTANCE - camera.position.z);
+}
+
+/* Renders the frames of the path in the current render mode and times them */
+static void run_path(benchmark_run_t* run, int frames)
+{
+	for (int frame = 0; frame < WARMUP_FRAMES; frame++)
+	{
+		place_camera(0, frames);
+		pipeline_update();
+		pipeline_render();
+	}
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		place_camera(frame, frames);
+
+		uint64_t start = SDL_GetPerformanceCounter();
+		pipeline_update();
+		pipeline_render();
+		run->frame_ms[frame] = elapsed_ms(start, SDL_GetPerformanceCounter());
+
+		add_frame_stats(&run->totals, stats_frame(0));
+	}
+}
+
+/* Prints the statistics of a set of frames as the members of a JSON object */
+static void print_stats(const double* frame_ms, int count, const frame_stats_t* totals)
+{
+	double* sorted = (double*)malloc(sizeof(double) * count);
+	double total_ms = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		sorted[i] = frame_ms[i];
+		total_ms += frame_ms[i];
+	}
+	qsort(sorted, count, sizeof(double), compare_ms);
+
+	double seconds = total_ms / 1000.0;
+	printf("\"frames\": %d, ", count);
+	printf("\"frame_ms\": { \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }, ",
+		sorted[0], percentile(sorted, count, 50.0), percentile(sorted, count, 90.0), percentile(sorted, count, 99.0),
+		sorted[count - 1], total_ms / count);
+	printf("\"triangles_per_second\": %.0f, ", totals->counters[COUNTER_TRIANGLES_RASTERIZED] / seconds);
+	printf("\"pixels_per_second\": %.0f, ", totals->counters[COUNTER_PIXELS_WRITTEN] / seconds);
+
+	// Nothing is presented without a window, so the present stage is left out
+	printf("\"stage_ms\": { ");
+	for (int stage = 0; stage < STAGE_PRESENT; stage++)
+	{
+		printf("\"%s\": %.4f%s", stats_stage_names[stage], totals->stage_ms[stage] / count, (stage < STAGE_PRESENT - 1) ? ", " : " }, ");
+	}
+	printf("\"per_frame\": { ");
+	for (int counter = 0; counter < COUNTER_COUNT; counter++)
+	{
+		printf("\"%s\": %.1f%s", stats_counter_names[counter], (double)totals->counters[counter] / count, (counter < COUNTER_COUNT - 1) ? ", " : " }");
+	}
+
+	free(sorted);
+}
+
+/* Renders every model in every render mode with one depth format, returns false if a model cannot be loaded */
+static bool run_depth(int depth, benchmark_run_t runs[][NUM_BENCHMARK_MODELS], int* model_faces, const char* assets, int width, int height, int frames)
+{
+	if (!pipeline_init(width, height, benchmark_depths[depth].format, benchmark_depths[depth].reversed))
+	{
+		pipeline_destroy();
+		return false;
+	}
+	culling_mode = CULLING_BACKFACE;
+
+	for (int model = 0; model < NUM_BENCHMARK_MODELS; model++)
+	{
+		char obj_path[1024];
+		char png_path[1024];
+		snprintf(obj_path, sizeof(obj_path), "%s/obj/%s.obj", assets, benchmark_models[model][0]);
+		snprintf(png_path, sizeof(png_path), "%s/textures/%s.png", assets, benchmark_models[model][1]);
+
+		int asset = scene_load_asset(obj_path, png_path);
+		int instance = scene_add_instance(asset);
+		if (instance < 0)
+		{
+			pipeline_destroy();
+			scene_destroy();
+			return false;
+		}
+		model_faces[model] = array_length(scene.assets[asset].lods[0].mesh.faces);
+
+		scene.instances[instance].translation.z = MODEL_DISTANCE;
+		for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+		{
+			fprintf(stderr, "%s: %s: %s\n", benchmark_depths[depth].name, benchmark_models[model][0], render_mode_names[mode]);
+			render_mode = (enum render_mode)mode;
+			run_path(&runs[mode][model], frames);
+		}
+
+		scene_destroy();
+	}
+
+	pipeline_destroy();
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* assets = (argc > 1) ? argv[1] : "../assets";
+	int width = (argc > 2) ? atoi(argv[2]) : 800;
+	int height = (argc > 3) ? atoi(argv[3]) : 600;
+	int frames = (argc > 4) ? atoi(argv[4]) : 120;
+	int first_depth = 0;
+	int last_depth = NUM_BENCHMARK_DEPTHS - 1;
+	if (argc > 5)
+	{
+		for (first_depth = 0; first_depth < NUM_BENCHMARK_DEPTHS && strcmp(argv[5], benchmark_depths[first_depth].name) != 0; first_depth++)
+		{
+		}
+		last_depth = first_depth;
+	}
+	if (width <= 0 || height <= 0 || frames <= 0 || first_depth >= NUM_BENCHMARK_DEPTHS)
+	{
+		fprintf(stderr, "Usage: %s [assets_directory width height frames float32|float32_reversed|unorm24|unorm16]\n", argv[0]);
+		return 1;
+	}
+
+	benchmark_run_t runs[NUM_BENCHMARK_DEPTHS][RENDER_MODE_COUNT][NUM_BENCHMARK_MODELS] = { 0 };
+	int model_faces[NUM_BENCHMARK_MODELS] = { 0 };
+	for (int depth = first_depth; depth <= last_depth; depth++)
+	{
+		for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+		{
+			for (int model = 0; model < NUM_BENCHMARK_MODELS; model++)
+			{
+				runs[depth][mode][model].frame_ms = (double*)malloc(sizeof(double) * frames);
+				if (!runs[depth][mode][model].frame_ms)
+				{
+					fprintf(stderr, "Error allocating the frame times.\n");
+					return 1;
+				}
+			}
+		}
+	}
+
+	for (int depth = first_depth; depth <= last_depth; depth++)
+	{
+		if (!run_depth(depth, runs[depth], model_faces, assets, width, height, frames))
+		{
+			return 1;
+		}
+	}
+
+	/* Every model on its own, and all of them together per render mode and depth format */
+	double* mode_frame_ms = (double*)malloc(sizeof(double) * frames * NUM_BENCHMARK_MODELS);
+	if (!mode_frame_ms)
+	{
+		fprintf(stderr, "Error allocating the frame times.\n");
+		return 1;
+	}
+	printf("{\n");
+	printf("  \"width\": %d, \"height\": %d, \"frames_per_path\": %d, \"isa\": \"%s\",\n", width, height, frames, raster_isa_names[rasterizer_detect_isa()]);
+	printf("  \"depths\": [\n");
+	for (int depth = first_depth; depth <= last_depth; depth++)
+	{
+		printf("  { \"depth\": \"%s\", \"modes\": [\n", benchmark_depths[depth].name);
+		for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+		{
+			frame_stats_t totals = { 0 };
+
+			printf("    { \"mode\": \"%s\", \"models\": [\n", render_mode_names[mode]);
+			for (int model = 0; model < NUM_BENCHMARK_MODELS; model++)
+			{
+				const benchmark_run_t* run = &runs[depth][mode][model];
+				printf("      { \"model\": \"%s\", \"faces\": %d, ", benchmark_models[model][0], model_faces[model]);
+				print_stats(run->frame_ms, frames, &run->totals);
+				printf(" }%s\n", (model < NUM_BENCHMARK_MODELS - 1) ? "," : "");
+
+				for (int frame = 0; frame < frames; frame++)
+				{
+					mode_frame_ms[model * frames + frame] = run->frame_ms[frame];
+				}
+				add_frame_stats(&totals, &run->totals);
+			}
+			printf("      ],\n      \"all_models\": { ");
+			print_stats(mode_frame_ms, frames * NUM_BENCHMARK_MODELS, &totals);
+			printf(" } }%s\n", (mode < RENDER_MODE_COUNT - 1) ? "," : "");
+		}
+		printf("  ] }%s\n", (depth < last_depth) ? "," : "");
+	}
+	printf("  ]\n}\n");
+
+	free(mode_frame_ms);
+	for (int depth = first_depth; depth <= last_depth; depth++)
+	{
+		for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+		{
+			for (int model = 0; model < NUM_BENCHMARK_MODELS; model++)
+			{
+				free(runs[depth][mode][model].frame_ms);
+			}
+		}
+	}
+	return 0;
+}
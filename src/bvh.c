@@ -0,0 +1,600 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <SDL.h>
+#include "scene.h"
+#include "stats.h"
+#include "bvh.h"
+
+/* World-space box of an instance */
+typedef struct
+{
+	vec3_t min;
+	vec3_t max;
+} box_t;
+
+/* A tree: its nodes, the order of the instances its ranges index into, and the leaf holding every instance */
+typedef struct
+{
+	bvh_node_t* nodes;
+	int num_nodes;
+	int* order;
+	int* leaf_of;
+	int num_instances;
+	float area_sum;     /* area of every inner node plus area times instances of every leaf */
+	float built_cost;   /* area_sum relative to the area of the root, right after the build */
+} bvh_tree_t;
+
+/* The tree the queries run on, and the scene layout it was built for */
+static bvh_tree_t tree = { 0 };
+static bool tree_built = false;
+static unsigned int tree_layout_version = 0;
+
+/* Current box of every instance */
+static box_t* instance_boxes = NULL;
+static int instance_boxes_capacity = 0;
+
+/* Rebuild running on a background thread from a snapshot of the boxes, and the instances moved since the snapshot */
+static SDL_Thread* rebuild_thread = NULL;
+static SDL_atomic_t rebuild_done;
+static bvh_tree_t rebuild_tree = { 0 };
+static box_t* rebuild_boxes = NULL;
+static int* moved_during_rebuild = NULL;
+static int num_moved_during_rebuild = 0;
+static int moved_during_rebuild_capacity = 0;
+static bool rebuild_stale = false;
+static int rebuild_count = 0;
+
+/* Results of the last query, and the stack it walks the tree with */
+static bvh_hit_t* hits = NULL;
+static int hits_capacity = 0;
+static int* query_stack = NULL;
+static int query_stack_capacity = 0;
+
+/* Half the surface area of a box, the chance a random ray or plane hits it is proportional to it */
+static float box_area(vec3_t min, vec3_t max)
+{
+	float dx = max.x - min.x;
+	float dy = max.y - min.y;
+	float dz = max.z - min.z;
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void box_grow(box_t* box, const box_t* other)
+{
+	box->min.x = fminf(box->min.x, other->min.x);
+	box->min.y = fminf(box->min.y, other->min.y);
+	box->min.z = fminf(box->min.z, other->min.z);
+	box->max.x = fmaxf(box->max.x, other->max.x);
+	box->max.y = fmaxf(box->max.y, other->max.y);
+	box->max.z = fmaxf(box->max.z, other->max.z);
+}
+
+static box_t empty_box(void)
+{
+	box_t box = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	return box;
+}
+
+static float box_center(const box_t* box, int axis)
+{
+	const float* min = &box->min.x;
+	const float* max = &box->max.x;
+	return 0.5f * (min[axis] + max[axis]);
+}
+
+/* Box of the model bounds of an instance in world space, the center is transformed and the extents grow by the absolute matrix */
+static box_t instance_world_box(const scene_instance_t* instance)
+{
+	const bounds_t* bounds = &scene.assets[instance->asset].lods[0].mesh.bounds;
+	mat4_t world_matrix = scene_instance_world_matrix(instance);
+	float center[3] = { 0.5f * (bounds->min.x + bounds->max.x), 0.5f * (bounds->min.y + bounds->max.y), 0.5f * (bounds->min.z + bounds->max.z) };
+	float extent[3] = { 0.5f * (bounds->max.x - bounds->min.x), 0.5f * (bounds->max.y - bounds->min.y), 0.5f * (bounds->max.z - bounds->min.z) };
+
+	float world_center[3];
+	float world_extent[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const float* row = world_matrix.m[i];
+		world_center[i] = row[0] * center[0] + row[1] * center[1] + row[2] * center[2] + row[3];
+		world_extent[i] = fabsf(row[0]) * extent[0] + fabsf(row[1]) * extent[1] + fabsf(row[2]) * extent[2];
+	}
+
+	box_t box = {
+		{ world_center[0] - world_extent[0], world_center[1] - world_extent[1], world_center[2] - world_extent[2] },
+		{ world_center[0] + world_extent[0], world_center[1] + world_extent[1], world_center[2] + world_extent[2] }
+	};
+	return box;
+}
+
+static void free_tree(bvh_tree_t* t)
+{
+	free(t->nodes);
+	free(t->order);
+	free(t->leaf_of);
+	memset(t, 0, sizeof(bvh_tree_t));
+}
+
+/* Weight of a node in the surface area cost: visiting an inner node costs one test, a leaf one per instance */
+static float node_cost(const bvh_node_t* node)
+{
+	return box_area(node->min, node->max) * (float)((node->left < 0) ? node->count : 1);
+}
+
+/* Splits the range of a node at the bucket boundary with the lowest surface area cost, returns the size of the left part or 0 if none is cheaper */
+static int split_node(const bvh_tree_t* t, const bvh_node_t* node, const box_t* boxes)
+{
+	// Bucket the instances by their centers along the longest axis of the centers
+	box_t centers = empty_box();
+	for (int i = node->first; i < node->first + node->count; i++)
+	{
+		const box_t* box = &boxes[t->order[i]];
+		box_t center = { { box_center(box, 0), box_center(box, 1), box_center(box, 2) }, { box_center(box, 0), box_center(box, 1), box_center(box, 2) } };
+		box_grow(&centers, &center);
+	}
+	float extent[3] = { centers.max.x - centers.min.x, centers.max.y - centers.min.y, centers.max.z - centers.min.z };
+	int axis = (extent[0] >= extent[1] && extent[0] >= extent[2]) ? 0 : (extent[1] >= extent[2]) ? 1 : 2;
+	if (!(extent[axis] > 0.0f))
+	{
+		return 0;
+	}
+	float axis_min = (&centers.min.x)[axis];
+	float scale = (float)BVH_SPLIT_BUCKETS / extent[axis];
+
+	int bucket_counts[BVH_SPLIT_BUCKETS] = { 0 };
+	box_t bucket_boxes[BVH_SPLIT_BUCKETS];
+	for (int b = 0; b < BVH_SPLIT_BUCKETS; b++)
+	{
+		bucket_boxes[b] = empty_box();
+	}
+	for (int i = node->first; i < node->first + node->count; i++)
+	{
+		const box_t* box = &boxes[t->order[i]];
+		int bucket = (int)((box_center(box, axis) - axis_min) * scale);
+		bucket = (bucket < BVH_SPLIT_BUCKETS) ? bucket : BVH_SPLIT_BUCKETS - 1;
+		bucket_counts[bucket]++;
+		box_grow(&bucket_boxes[bucket], box);
+	}
+
+	// Sweep from the right to get the cost of every right part, then from the left to find the cheapest boundary
+	float right_costs[BVH_SPLIT_BUCKETS];
+	box_t right = empty_box();
+	int right_count = 0;
+	for (int b = BVH_SPLIT_BUCKETS - 1; b > 0; b--)
+	{
+		box_grow(&right, &bucket_boxes[b]);
+		right_count += bucket_counts[b];
+		right_costs[b] = (right_count > 0) ? box_area(right.min, right.max) * (float)right_count : 0.0f;
+	}
+
+	float best_cost = box_area(node->min, node->max) * (float)node->count;
+	int best_boundary = 0;
+	box_t left = empty_box();
+	int left_count = 0;
+	for (int b = 0; b < BVH_SPLIT_BUCKETS - 1; b++)
+	{
+		box_grow(&left, &bucket_boxes[b]);
+		left_count += bucket_counts[b];
+		if (left_count == 0 || left_count == node->count)
+		{
+			continue;
+		}
+		float cost = box_area(left.min, left.max) * (float)left_count + right_costs[b + 1];
+		if (cost < best_cost)
+		{
+			best_cost = cost;
+			best_boundary = b + 1;
+		}
+	}
+	if (best_boundary == 0)
+	{
+		return 0;
+	}
+
+	// Partition the range in place, the instances of the buckets left of the boundary first
+	int* order = t->order;
+	int i = node->first;
+	int j = node->first + node->count - 1;
+	while (i <= j)
+	{
+		int bucket = (int)((box_center(&boxes[order[i]], axis) - axis_min) * scale);
+		if (bucket < best_boundary)
+		{
+			i++;
+		}
+		else
+		{
+			int swap = order[i];
+			order[i] = order[j];
+			order[j] = swap;
+			j--;
+		}
+	}
+	return i - node->first;
+}
+
+/* Builds a tree over count boxes top down, returns false if it cannot be allocated */
+static bool build_tree(bvh_tree_t* t, const box_t* boxes, int count)
+{
+	memset(t, 0, sizeof(bvh_tree_t));
+	t->nodes = (bvh_node_t*)malloc(sizeof(bvh_node_t) * (2 * count + 1));
+	t->order = (int*)malloc(sizeof(int) * (count + 1));
+	t->leaf_of = (int*)malloc(sizeof(int) * (count + 1));
+	if (!t->nodes || !t->order || !t->leaf_of)
+	{
+		free_tree(t);
+		return false;
+	}
+	t->num_instances = count;
+	for (int i = 0; i < count; i++)
+	{
+		t->order[i] = i;
+	}
+	if (count == 0)
+	{
+		return true;
+	}
+
+	t->nodes[0].first = 0;
+	t->nodes[0].count = count;
+	t->nodes[0].parent = -1;
+	t->num_nodes = 1;
+
+	// Nodes are split in the order they were created, so every node is handled after its parent gave it its range
+	for (int n = 0; n < t->num_nodes; n++)
+	{
+		bvh_node_t* node = &t->nodes[n];
+		box_t bounds = empty_box();
+		for (int i = node->first; i < node->first + node->count; i++)
+		{
+			box_grow(&bounds, &boxes[t->order[i]]);
+		}
+		node->min = bounds.min;
+		node->max = bounds.max;
+		node->left = -1;
+
+		int left_count = (node->count > BVH_LEAF_SIZE) ? split_node(t, node, boxes) : 0;
+		if (left_count == 0 && node->count > BVH_LEAF_SIZE)
+		{
+			// No split is cheaper, or every center is the same, halving keeps the leaves small anyway
+			left_count = node->count / 2;
+		}
+		if (left_count == 0)
+		{
+			for (int i = node->first; i < node->first + node->count; i++)
+			{
+				t->leaf_of[t->order[i]] = n;
+			}
+			t->area_sum += node_cost(node);
+			continue;
+		}
+
+		node->left = t->num_nodes;
+		bvh_node_t* children = &t->nodes[t->num_nodes];
+		children[0].first = node->first;
+		children[0].count = left_count;
+		children[0].parent = n;
+		children[1].first = node->first + left_count;
+		children[1].count = node->count - left_count;
+		children[1].parent = n;
+		t->num_nodes += 2;
+		t->area_sum += node_cost(node);
+	}
+
+	float root_area = box_area(t->nodes[0].min, t->nodes[0].max);
+	t->built_cost = (root_area > 0.0f) ? t->area_sum / root_area : 0.0f;
+	return true;
+}
+
+/* Surface area cost of a tree relative to the area of its root */
+static float tree_cost(const bvh_tree_t* t)
+{
+	if (t->num_nodes == 0)
+	{
+		return 0.0f;
+	}
+	float root_area = box_area(t->nodes[0].min, t->nodes[0].max);
+	return (root_area > 0.0f) ? t->area_sum / root_area : 0.0f;
+}
+
+/* Refits the leaf of a moved instance and its ancestors to the current boxes, stopping at the first node that did not change */
+static void refit_instance(bvh_tree_t* t, const box_t* boxes, int instance)
+{
+	if (instance >= t->num_instances)
+	{
+		return;
+	}
+
+	int n = t->leaf_of[instance];
+	while (n >= 0)
+	{
+		bvh_node_t* node = &t->nodes[n];
+		box_t bounds = empty_box();
+		if (node->left < 0)
+		{
+			for (int i = node->first; i < node->first + node->count; i++)
+			{
+				box_grow(&bounds, &boxes[t->order[i]]);
+			}
+		}
+		else
+		{
+			box_t left = { t->nodes[node->left].min, t->nodes[node->left].max };
+			box_t right = { t->nodes[node->left + 1].min, t->nodes[node->left + 1].max };
+			box_grow(&bounds, &left);
+			box_grow(&bounds, &right);
+		}
+
+		if (memcmp(&bounds.min, &node->min, sizeof(vec3_t)) == 0 && memcmp(&bounds.max, &node->max, sizeof(vec3_t)) == 0)
+		{
+			return;
+		}
+		t->area_sum -= node_cost(node);
+		node->min = bounds.min;
+		node->max = bounds.max;
+		t->area_sum += node_cost(node);
+		n = node->parent;
+	}
+}
+
+/* Builds the background tree from the snapshot of the boxes */
+static int rebuild_worker(void* data)
+{
+	int count = *(const int*)data;
+	if (!build_tree(&rebuild_tree, rebuild_boxes, count))
+	{
+		memset(&rebuild_tree, 0, sizeof(bvh_tree_t));
+	}
+	SDL_AtomicSet(&rebuild_done, 1);
+	return 0;
+}
+
+/* Waits for a running background rebuild and drops its tree */
+static void cancel_rebuild(void)
+{
+	if (rebuild_thread)
+	{
+		SDL_WaitThread(rebuild_thread, NULL);
+		rebuild_thread = NULL;
+	}
+	free_tree(&rebuild_tree);
+	num_moved_during_rebuild = 0;
+	rebuild_stale = false;
+}
+
+/* Remembers an instance moved while the background tree is built, it is refit into that tree once it is done */
+static void remember_moved_during_rebuild(int instance)
+{
+	if (num_moved_during_rebuild == moved_during_rebuild_capacity)
+	{
+		int capacity = (moved_during_rebuild_capacity > 0) ? moved_during_rebuild_capacity * 2 : 64;
+		int* grown = (int*)realloc(moved_during_rebuild, sizeof(int) * capacity);
+		if (!grown)
+		{
+			// The rebuilt tree cannot be caught up, so it is thrown away when it finishes
+			fprintf(stderr, "Error allocating the moved instances.\n");
+			rebuild_stale = true;
+			return;
+		}
+		moved_during_rebuild = grown;
+		moved_during_rebuild_capacity = capacity;
+	}
+	moved_during_rebuild[num_moved_during_rebuild++] = instance;
+}
+
+/* Makes the query stack deep enough for any walk of the current tree */
+static bool reserve_query_stack(void)
+{
+	if (tree.num_nodes <= query_stack_capacity)
+	{
+		return true;
+	}
+	int* grown = (int*)realloc(query_stack, sizeof(int) * tree.num_nodes);
+	if (!grown)
+	{
+		fprintf(stderr, "Error allocating the BVH query stack.\n");
+		return false;
+	}
+	query_stack = grown;
+	query_stack_capacity = tree.num_nodes;
+	return true;
+}
+
+/* Rebuilds the tree at once from every instance, for a new scene layout */
+static bool rebuild_now(void)
+{
+	cancel_rebuild();
+	free_tree(&tree);
+	tree_built = false;
+
+	if (scene.num_instances > instance_boxes_capacity)
+	{
+		box_t* grown = (box_t*)realloc(instance_boxes, sizeof(box_t) * scene.num_instances);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the instance boxes.\n");
+			return false;
+		}
+		instance_boxes = grown;
+		instance_boxes_capacity = scene.num_instances;
+	}
+	for (int i = 0; i < scene.num_instances; i++)
+	{
+		instance_boxes[i] = instance_world_box(&scene.instances[i]);
+		scene.instances[i].moved = false;
+	}
+	scene.num_moved_instances = 0;
+
+	if (!build_tree(&tree, instance_boxes, scene.num_instances) || !reserve_query_stack())
+	{
+		fprintf(stderr, "Error allocating the BVH.\n");
+		free_tree(&tree);
+		return false;
+	}
+	tree_built = true;
+	tree_layout_version = scene.layout_version;
+	return true;
+}
+
+/* Function to bring the tree up to date with the scene: rebuild it if instances were added or removed,
+   refit the moved ones, and start or pick up a background rebuild */
+bool bvh_update(void)
+{
+	if (!tree_built || tree_layout_version != scene.layout_version)
+	{
+		return rebuild_now();
+	}
+
+	// Swap in a finished background tree, and catch it up with the instances moved while it was built
+	if (rebuild_thread && SDL_AtomicGet(&rebuild_done))
+	{
+		SDL_WaitThread(rebuild_thread, NULL);
+		rebuild_thread = NULL;
+		if (rebuild_tree.nodes && !rebuild_stale && rebuild_tree.num_instances == scene.num_instances)
+		{
+			bvh_tree_t swap = tree;
+			tree = rebuild_tree;
+			rebuild_tree = swap;
+			for (int i = 0; i < num_moved_during_rebuild; i++)
+			{
+				refit_instance(&tree, instance_boxes, moved_during_rebuild[i]);
+			}
+			if (!reserve_query_stack())
+			{
+				return rebuild_now();
+			}
+		}
+		free_tree(&rebuild_tree);
+		num_moved_during_rebuild = 0;
+		rebuild_stale = false;
+	}
+
+	// Refit the moved instances, this only touches their leaves and the nodes above them
+	for (int i = 0; i < scene.num_moved_instances; i++)
+	{
+		int instance = scene.moved_instances[i];
+		scene.instances[instance].moved = false;
+		instance_boxes[instance] = instance_world_box(&scene.instances[instance]);
+		refit_instance(&tree, instance_boxes, instance);
+		if (rebuild_thread)
+		{
+			remember_moved_during_rebuild(instance);
+		}
+	}
+	scene.num_moved_instances = 0;
+
+	// Once the refits have loosened the tree too much, build a new one from the current boxes without stalling the frames
+	if (!rebuild_thread && tree_cost(&tree) > BVH_REBUILD_RATIO * tree.built_cost)
+	{
+		box_t* snapshot = (box_t*)realloc(rebuild_boxes, sizeof(box_t) * (scene.num_instances + 1));
+		if (!snapshot)
+		{
+			return rebuild_now();
+		}
+		rebuild_boxes = snapshot;
+		memcpy(rebuild_boxes, instance_boxes, sizeof(box_t) * scene.num_instances);
+		rebuild_count = scene.num_instances;
+		SDL_AtomicSet(&rebuild_done, 0);
+		rebuild_thread = SDL_CreateThread(rebuild_worker, "bvh", &rebuild_count);
+		if (!rebuild_thread)
+		{
+			return rebuild_now();
+		}
+	}
+	return true;
+}
+
+/* Adds the instances of a range of the order to the hits, returns false if they do not fit */
+static bool add_hits(int first, int count, int* num_hits, enum frustum_visibility visibility)
+{
+	if (*num_hits + count > hits_capacity)
+	{
+		int capacity = (hits_capacity > 0) ? hits_capacity * 2 : 256;
+		while (capacity < *num_hits + count)
+		{
+			capacity *= 2;
+		}
+		bvh_hit_t* grown = (bvh_hit_t*)realloc(hits, sizeof(bvh_hit_t) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the BVH hits.\n");
+			return false;
+		}
+		hits = grown;
+		hits_capacity = capacity;
+	}
+	for (int i = first; i < first + count; i++)
+	{
+		hits[*num_hits].instance = tree.order[i];
+		hits[*num_hits].visibility = visibility;
+		(*num_hits)++;
+	}
+	return true;
+}
+
+/* Function to find the instances whose boxes are not outside the frustum, returns their number */
+int bvh_query_frustum(const frustum_t* frustum, const bvh_hit_t** found)
+{
+	*found = hits;
+	if (!tree_built || tree.num_nodes == 0)
+	{
+		return 0;
+	}
+
+	int num_hits = 0;
+	int num_visited = 0;
+	int stack_size = 0;
+	query_stack[stack_size++] = 0;
+	while (stack_size > 0)
+	{
+		const bvh_node_t* node = &tree.nodes[query_stack[--stack_size]];
+		num_visited++;
+
+		enum frustum_visibility visibility = frustum_test_box(frustum, node->min, node->max);
+		if (visibility == FRUSTUM_OUTSIDE)
+		{
+			continue;
+		}
+
+		// Everything below a node inside the frustum is inside it too, and below a leaf there is nothing left to test
+		if (visibility == FRUSTUM_INSIDE || node->left < 0)
+		{
+			if (!add_hits(node->first, node->count, &num_hits, visibility))
+			{
+				break;
+			}
+			continue;
+		}
+
+		query_stack[stack_size++] = node->left + 1;
+		query_stack[stack_size++] = node->left;
+	}
+	stats_add_count(COUNTER_BVH_NODES_VISITED, num_visited);
+
+	*found = hits;
+	return num_hits;
+}
+
+/* Function to wait for a background rebuild and free the tree */
+void bvh_destroy(void)
+{
+	cancel_rebuild();
+	free_tree(&tree);
+	tree_built = false;
+	free(instance_boxes);
+	free(rebuild_boxes);
+	free(moved_during_rebuild);
+	free(hits);
+	free(query_stack);
+	instance_boxes = NULL;
+	rebuild_boxes = NULL;
+	moved_during_rebuild = NULL;
+	hits = NULL;
+	query_stack = NULL;
+	instance_boxes_capacity = 0;
+	moved_during_rebuild_capacity = 0;
+	hits_capacity = 0;
+	query_stack_capacity = 0;
+}
@@ -1,50 +1,53 @@
 #include "clipping.h"
 #include <math.h>
+#include <float.h>
 #include <string.h>
 
 #define NUM_FRUSTUM_PLANES 6
-plane_t frustum_planes[NUM_FRUSTUM_PLANES];
-
-// Frustum planes are defined by a point and a normal vector
-// Near plane		:		Point = (0, 0, z_near), Normal = (0, 0, 1)
-// Far plane		:		Point = (0, 0, z_far),	Normal = (0, 0, -1)
-// Left plane		:		Point = (0, 0, 0),		Normal = (cos(fov/2), 0, sin(fov/2))
-// Right plane		:		Point = (0, 0, 0),		Normal = (-cos(fov/2), 0, sin(fov/2))
-// Bottom plane		:		Point = (0, 0, 0),		Normal = (0, cos(fov/2), sin(fov/2))
-// Top plane		:		Point = (0, 0, 0),		Normal = (0, -cos(fov/2), sin(fov/2))
-void init_frustum_planes(float fov, float z_near, float z_far)
-{
-	float cos_half_fov = cosf(fov / 2.0f);
-	float sin_half_fov = sinf(fov / 2.0f);
-
-	vec3_t origin = { 0.0f, 0.0f, 0.0f };
-
-	// Near plane
-	frustum_planes[NEAR_FRUSTUM_PLANE].point = (vec3_t) { 0.f, 0.f, z_near };
-	frustum_planes[NEAR_FRUSTUM_PLANE].normal = (vec3_t){ 0.0f, 0.0f, 1.0f };
-
-	// Far plane
-	frustum_planes[FAR_FRUSTUM_PLANE].point = (vec3_t){ 0.f, 0.f, z_far };
-	frustum_planes[FAR_FRUSTUM_PLANE].normal = (vec3_t){ 0.0f, 0.0f, -1.0f };
-
-	// Left plane
-	frustum_planes[LEFT_FRUSTUM_PLANE].point = origin;
-	frustum_planes[LEFT_FRUSTUM_PLANE].normal = (vec3_t){ cos_half_fov, 0.0f, sin_half_fov };
 
-	// Right plane
-	frustum_planes[RIGHT_FRUSTUM_PLANE].point = origin;
-	frustum_planes[RIGHT_FRUSTUM_PLANE].normal = (vec3_t){ -cos_half_fov, 0.0f, sin_half_fov };
-
-	// Bottom plane
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].point = origin;
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal = (vec3_t){ 0.0f, cos_half_fov, sin_half_fov };
+// Clipping happens in homogeneous clip space, before the perspective divide, so every plane is a linear
+// function of (x, y, z, w) and points behind the camera never get divided by a negative w.
+// The planes are numbered by the bit of their outcode, and a point is inside a plane while its distance is positive:
+// Left plane		:		x + CLIP_GUARD_BAND * w
+// Right plane		:		CLIP_GUARD_BAND * w - x
+// Bottom plane		:		y + CLIP_GUARD_BAND * w
+// Top plane		:		CLIP_GUARD_BAND * w - y
+// Near plane		:		z
+// Far plane		:		w - z
+static float plane_distance(vec4_t position, int plane_index)
+{
+	switch (1 << plane_index)
+	{
+	case OUTCODE_LEFT:
+		return position.x + CLIP_GUARD_BAND * position.w;
+	case OUTCODE_RIGHT:
+		return CLIP_GUARD_BAND * position.w - position.x;
+	case OUTCODE_BOTTOM:
+		return position.y + CLIP_GUARD_BAND * position.w;
+	case OUTCODE_TOP:
+		return CLIP_GUARD_BAND * position.w - position.y;
+	case OUTCODE_NEAR:
+		return position.z;
+	default:
+		return position.w - position.z;
+	}
+}
 
-	// Top plane
-	frustum_planes[TOP_FRUSTUM_PLANE].point = origin;
-	frustum_planes[TOP_FRUSTUM_PLANE].normal = (vec3_t){ 0.0f, -cos_half_fov, sin_half_fov };
+/* Function to find the planes a clip-space position lies outside of, as outcode bits with the sides moved out to the guard band */
+uint8_t clip_planes_outside(vec4_t position)
+{
+	uint8_t planes = 0;
+	for (int i = 0; i < OUTCODE_PLANES; i++)
+	{
+		if (plane_distance(position, i) < 0.0f)
+		{
+			planes |= (uint8_t)(1 << i);
+		}
+	}
+	return planes;
 }
 
-polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2)
+polygon_t create_polygon_from_triangle(clip_vertex_t v0, clip_vertex_t v1, clip_vertex_t v2)
 {
 	polygon_t polygon;
 
@@ -57,45 +60,48 @@ polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2)
 	return polygon;
 }
 
-void clip_polygon_against_plane(polygon_t* polygon, int plane_index)
+static void clip_polygon_against_plane(polygon_t* polygon, int plane_index)
 {
-	vec3_t plane_point = frustum_planes[plane_index].point;
-	vec3_t plane_normal = frustum_planes[plane_index].normal;
-
 	// The array of inside vertices will be used to store the vertices that are inside the plane
-	vec3_t inside_vertices[MAX_NUM_POLY_VERTICES];
+	clip_vertex_t inside_vertices[MAX_NUM_POLY_VERTICES];
 	int num_inside_vertices = 0;
 
 	// Start current and previous vertex witht the first and last polygon vertices
-	vec3_t* current_vertex = &polygon->vertices[0];
-	vec3_t* previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
+	clip_vertex_t* current_vertex = &polygon->vertices[0];
+	clip_vertex_t* previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
 
-	// Start the current and previous distance with the dot product of the first and last vertices with the plane normal
+	// Start the current and previous distance with the distance of the last vertex to the plane
 	float current_dot = 0.0f;
-	float previous_dot = vec3_dot(vec3_sub(*previous_vertex, plane_point), plane_normal);
+	float previous_dot = plane_distance(previous_vertex->position, plane_index);
 
 	// Loop through all the polygon vertices
-	while (current_vertex != &polygon->vertices[polygon->num_vertices]) 
+	while (current_vertex != &polygon->vertices[polygon->num_vertices])
 	{
-		current_dot = vec3_dot(vec3_sub(*current_vertex, plane_point), plane_normal);
+		current_dot = plane_distance(current_vertex->position, plane_index);
 
-		// If we change from outside to inside or inside to outside
-		if (current_dot * previous_dot < 0.0f)
+		// If we change from outside to inside or inside to outside, a vertex right on the plane needs no intersection
+		if ((current_dot < 0.0f && previous_dot > 0.0f) || (current_dot > 0.0f && previous_dot < 0.0f))
 		{
-			// Calculate the intersection point
+			// Calculate the intersection point, the position and the texture coordinates move along together
 			float t = previous_dot / (previous_dot - current_dot); // Linear interpolation factor
-			vec3_t intersection_point = vec3_add(*previous_vertex, vec3_mul(vec3_sub(*current_vertex, *previous_vertex), t)); // I = Q1 + t(Q2 - Q1)
+			clip_vertex_t intersection_point;
+			intersection_point.position.x = previous_vertex->position.x + t * (current_vertex->position.x - previous_vertex->position.x);  // I = Q1 + t(Q2 - Q1)
+			intersection_point.position.y = previous_vertex->position.y + t * (current_vertex->position.y - previous_vertex->position.y);
+			intersection_point.position.z = previous_vertex->position.z + t * (current_vertex->position.z - previous_vertex->position.z);
+			intersection_point.position.w = previous_vertex->position.w + t * (current_vertex->position.w - previous_vertex->position.w);
+			intersection_point.uv.u = previous_vertex->uv.u + t * (current_vertex->uv.u - previous_vertex->uv.u);
+			intersection_point.uv.v = previous_vertex->uv.v + t * (current_vertex->uv.v - previous_vertex->uv.v);
 
 			// Insert the intersection point into the inside vertices array
 			inside_vertices[num_inside_vertices] = intersection_point;
 			num_inside_vertices++;
 		}
-		
+
 		// If the current vertex is inside the plane
-		if (current_dot > 0.0f) 
+		if (current_dot >= 0.0f)
 		{
 			// Insert the current vertex into the inside vertices array
-			inside_vertices[num_inside_vertices] = vec3_clone(current_vertex);
+			inside_vertices[num_inside_vertices] = *current_vertex;
 			num_inside_vertices++;
 		}
 
@@ -106,16 +112,162 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane_index)
 	}
 
 	// Copy the inside vertices into the polygon vertices array
-	memcpy(polygon->vertices, inside_vertices, num_inside_vertices * sizeof(vec3_t));
+	memcpy(polygon->vertices, inside_vertices, num_inside_vertices * sizeof(clip_vertex_t));
 	polygon->num_vertices = num_inside_vertices;
 }
 
-void clip_polygon(polygon_t* polygon)
+/* Function to clip a polygon against the planes in a mask of outcode bits, it becomes a convex fan around its first vertex, or empty */
+void clip_polygon(polygon_t* polygon, uint8_t planes)
 {
-	clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+	for (int i = 0; i < OUTCODE_PLANES && polygon->num_vertices > 0; i++)
+	{
+		if (planes & (1 << i))
+		{
+			clip_polygon_against_plane(polygon, i);
+		}
+	}
+}
+
+/* Function to compute the box and sphere around count points */
+bounds_t bounds_from_points(const float* x, const float* y, const float* z, int count)
+{
+	bounds_t bounds = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, 0.0f };
+	if (count <= 0)
+	{
+		return bounds;
+	}
+
+	bounds.min = (vec3_t){ FLT_MAX, FLT_MAX, FLT_MAX };
+	bounds.max = (vec3_t){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int i = 0; i < count; i++)
+	{
+		bounds.min.x = fminf(bounds.min.x, x[i]);
+		bounds.min.y = fminf(bounds.min.y, y[i]);
+		bounds.min.z = fminf(bounds.min.z, z[i]);
+		bounds.max.x = fmaxf(bounds.max.x, x[i]);
+		bounds.max.y = fmaxf(bounds.max.y, y[i]);
+		bounds.max.z = fmaxf(bounds.max.z, z[i]);
+	}
+
+	// Center the sphere on the box and grow it to the farthest point, tighter than the half diagonal of the box
+	bounds.center = (vec3_t){ 0.5f * (bounds.min.x + bounds.max.x), 0.5f * (bounds.min.y + bounds.max.y), 0.5f * (bounds.min.z + bounds.max.z) };
+	float radius_squared = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		float dx = x[i] - bounds.center.x;
+		float dy = y[i] - bounds.center.y;
+		float dz = z[i] - bounds.center.z;
+		radius_squared = fmaxf(radius_squared, dx * dx + dy * dy + dz * dz);
+	}
+	bounds.radius = sqrtf(radius_squared);
+	return bounds;
+}
+
+/* Row a plus sign times row b of a matrix, as a plane */
+static vec4_t combine_rows(const float a[4], float sign, const float b[4])
+{
+	return (vec4_t){ a[0] + sign * b[0], a[1] + sign * b[1], a[2] + sign * b[2], a[3] + sign * b[3] };
+}
+
+/* Function to extract the frustum planes from a model-view-projection matrix, they come out in model space */
+frustum_t frustum_from_matrix(const mat4_t* model_view_projection)
+{
+	// Every clip-space plane is a sum of rows of the matrix, z >= 0 is row 2 alone and x >= -w is row 3 plus row 0
+	const float (*m)[4] = model_view_projection->m;
+	frustum_t frustum;
+	frustum.planes[0] = combine_rows(m[2], 0.0f, m[3]);
+	frustum.planes[1] = combine_rows(m[3], -1.0f, m[2]);
+	frustum.planes[2] = combine_rows(m[3], 1.0f, m[0]);
+	frustum.planes[3] = combine_rows(m[3], -1.0f, m[0]);
+	frustum.planes[4] = combine_rows(m[3], 1.0f, m[1]);
+	frustum.planes[5] = combine_rows(m[3], -1.0f, m[1]);
+
+	// Normalize the planes so the distance to them is in the units of the model
+	for (int i = 0; i < NUM_FRUSTUM_PLANES; i++)
+	{
+		vec4_t* plane = &frustum.planes[i];
+		float length = sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+		if (length > 0.0f)
+		{
+			plane->x /= length;
+			plane->y /= length;
+			plane->z /= length;
+			plane->w /= length;
+		}
+	}
+	return frustum;
+}
+
+/* Where a box lies relative to one plane, from its corners farthest along and against the normal */
+static enum frustum_visibility box_plane_visibility(const vec4_t* plane, vec3_t min, vec3_t max)
+{
+	vec3_t farthest = {
+		(plane->x >= 0.0f) ? max.x : min.x,
+		(plane->y >= 0.0f) ? max.y : min.y,
+		(plane->z >= 0.0f) ? max.z : min.z
+	};
+	if (plane->x * farthest.x + plane->y * farthest.y + plane->z * farthest.z + plane->w < 0.0f)
+	{
+		return FRUSTUM_OUTSIDE;
+	}
+	vec3_t nearest = {
+		(plane->x >= 0.0f) ? min.x : max.x,
+		(plane->y >= 0.0f) ? min.y : max.y,
+		(plane->z >= 0.0f) ? min.z : max.z
+	};
+	if (plane->x * nearest.x + plane->y * nearest.y + plane->z * nearest.z + plane->w < 0.0f)
+	{
+		return FRUSTUM_INTERSECTING;
+	}
+	return FRUSTUM_INSIDE;
+}
+
+/* Function to test bounds against the frustum, the sphere first and the box only when the sphere crosses a plane */
+enum frustum_visibility frustum_test_bounds(const frustum_t* frustum, const bounds_t* bounds)
+{
+	enum frustum_visibility visibility = FRUSTUM_INSIDE;
+	for (int i = 0; i < NUM_FRUSTUM_PLANES; i++)
+	{
+		const vec4_t* plane = &frustum->planes[i];
+		float distance = plane->x * bounds->center.x + plane->y * bounds->center.y + plane->z * bounds->center.z + plane->w;
+		if (distance >= bounds->radius)
+		{
+			continue;
+		}
+		if (distance < -bounds->radius)
+		{
+			return FRUSTUM_OUTSIDE;
+		}
+
+		// The sphere crosses the plane, the box tells whether the mesh does
+		enum frustum_visibility plane_visibility = box_plane_visibility(plane, bounds->min, bounds->max);
+		if (plane_visibility == FRUSTUM_OUTSIDE)
+		{
+			return FRUSTUM_OUTSIDE;
+		}
+		if (plane_visibility == FRUSTUM_INTERSECTING)
+		{
+			visibility = FRUSTUM_INTERSECTING;
+		}
+	}
+	return visibility;
+}
+
+/* Function to test an axis aligned box against the frustum */
+enum frustum_visibility frustum_test_box(const frustum_t* frustum, vec3_t min, vec3_t max)
+{
+	enum frustum_visibility visibility = FRUSTUM_INSIDE;
+	for (int i = 0; i < NUM_FRUSTUM_PLANES; i++)
+	{
+		enum frustum_visibility plane_visibility = box_plane_visibility(&frustum->planes[i], min, max);
+		if (plane_visibility == FRUSTUM_OUTSIDE)
+		{
+			return FRUSTUM_OUTSIDE;
+		}
+		if (plane_visibility == FRUSTUM_INTERSECTING)
+		{
+			visibility = FRUSTUM_INTERSECTING;
+		}
+	}
+	return visibility;
 }
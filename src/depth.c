@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include "depth.h"
+
+/* The way depth is stored in the depth buffer of the render target */
+enum depth_format depth_format = DEPTH_FLOAT32;
+bool depth_reversed = false;
+float depth_far = 1.0f;
+
+/* Function to allocate the depth buffer in a format, reversed stores -1/w instead of 1 - 1/w in the float format */
+bool depth_init(enum depth_format format, bool reversed)
+{
+	depth_destroy();
+
+	size_t pixel_size = (format == DEPTH_UNORM16) ? sizeof(uint16_t) : sizeof(uint32_t);
+	render_target.depth_buffer = malloc(pixel_size * render_target.width * render_target.height);
+	if (!render_target.depth_buffer)
+	{
+		fprintf(stderr, "Error allocating the depth buffer.\n");
+		return false;
+	}
+
+	depth_format = format;
+	depth_reversed = reversed;
+	depth_far = (reversed && format == DEPTH_FLOAT32) ? 0.0f : 1.0f;
+	return true;
+}
+
+/* Function to get the stored depth of a pixel at a given 1/w as a float, for the depth hierarchy */
+float depth_key(float reciprocal_w)
+{
+	float depth = depth_far - reciprocal_w;
+	if (depth_format == DEPTH_FLOAT32)
+	{
+		return depth;
+	}
+
+	// Integers up to 24 bits are exact in a float
+	return (float)depth_quantize(depth, depth_format);
+}
+
+/* Function to reset a rectangle of the depth buffer to the far plane */
+void depth_clear_rect(rect_t rect)
+{
+	// A local copy, the global could alias the rows and would be reloaded for every pixel
+	float far = depth_far;
+	for (int y = rect.min_y; y <= rect.max_y; y++)
+	{
+		void* row = depth_row(y, depth_format);
+		switch (depth_format)
+		{
+		case DEPTH_FLOAT32:
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				((float*)row)[x] = far;
+			}
+			break;
+		case DEPTH_UNORM24:
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				((uint32_t*)row)[x] = DEPTH_UNORM24_MAX;
+			}
+			break;
+		default:
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				((uint16_t*)row)[x] = DEPTH_UNORM16_MAX;
+			}
+			break;
+		}
+	}
+}
+
+/* Function to find the farthest stored depth inside a rectangle of the depth buffer, as a float */
+float depth_max_rect(rect_t rect)
+{
+	if (depth_format == DEPTH_FLOAT32)
+	{
+		float max_depth = -FLT_MAX;
+		for (int y = rect.min_y; y <= rect.max_y; y++)
+		{
+			const float* row = (const float*)depth_row(y, depth_format);
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				max_depth = (row[x] > max_depth) ? row[x] : max_depth;
+			}
+		}
+		return max_depth;
+	}
+
+	uint32_t max_depth = 0;
+	for (int y = rect.min_y; y <= rect.max_y; y++)
+	{
+		if (depth_format == DEPTH_UNORM24)
+		{
+			const uint32_t* row = (const uint32_t*)depth_row(y, depth_format);
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				max_depth = (row[x] > max_depth) ? row[x] : max_depth;
+			}
+		}
+		else
+		{
+			const uint16_t* row = (const uint16_t*)depth_row(y, depth_format);
+			for (int x = rect.min_x; x <= rect.max_x; x++)
+			{
+				max_depth = (row[x] > max_depth) ? row[x] : max_depth;
+			}
+		}
+	}
+	return (float)max_depth;
+}
+
+/* Function to free the depth buffer */
+void depth_destroy(void)
+{
+	free(render_target.depth_buffer);
+	render_target.depth_buffer = NULL;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "depth.h"
+#include "tiles.h"
+#include "dirty.h"
+
+/* Tile grid covering the color and depth buffers, the same one the triangles are binned into */
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+static int num_tiles = 0;
+
+/* Tiles drawn into since the last color clear, and tiles the last color clear wiped */
+static uint8_t* tile_drawn = NULL;
+static uint8_t* tile_wiped = NULL;
+
+/* Depth epoch every tile was last cleared in, the depth of tiles from older epochs is stale */
+static uint32_t* tile_depth_epoch = NULL;
+static uint32_t depth_epoch = 1;
+
+/* Pixels of a tile, clipped to the screen */
+static rect_t tile_pixels(int tile_x, int tile_y)
+{
+	rect_t rect = {
+		tile_x * TILE_SIZE,
+		tile_y * TILE_SIZE,
+		(tile_x + 1) * TILE_SIZE - 1,
+		(tile_y + 1) * TILE_SIZE - 1
+	};
+	rect.max_x = (rect.max_x < render_target.width - 1) ? rect.max_x : render_target.width - 1;
+	rect.max_y = (rect.max_y < render_target.height - 1) ? rect.max_y : render_target.height - 1;
+	return rect;
+}
+
+/* Finds the range of tiles overlapped by a screen rectangle, returns false if it is off-screen or empty */
+static bool rect_tile_bounds(rect_t rect, int* min_tx, int* min_ty, int* max_tx, int* max_ty)
+{
+	rect.min_x = (rect.min_x > 0) ? rect.min_x : 0;
+	rect.min_y = (rect.min_y > 0) ? rect.min_y : 0;
+	rect.max_x = (rect.max_x < render_target.width - 1) ? rect.max_x : render_target.width - 1;
+	rect.max_y = (rect.max_y < render_target.height - 1) ? rect.max_y : render_target.height - 1;
+	if (rect.min_x > rect.max_x || rect.min_y > rect.max_y)
+	{
+		return false;
+	}
+
+	*min_tx = rect.min_x / TILE_SIZE;
+	*min_ty = rect.min_y / TILE_SIZE;
+	*max_tx = rect.max_x / TILE_SIZE;
+	*max_ty = rect.max_y / TILE_SIZE;
+	return true;
+}
+
+/* Function to allocate the dirty flags and depth epochs of the screen tiles, everything starts out dirty */
+bool dirty_init(void)
+{
+	num_tiles_x = (render_target.width + TILE_SIZE - 1) / TILE_SIZE;
+	num_tiles_y = (render_target.height + TILE_SIZE - 1) / TILE_SIZE;
+	num_tiles = num_tiles_x * num_tiles_y;
+
+	tile_drawn = (uint8_t*)malloc(num_tiles);
+	tile_wiped = (uint8_t*)malloc(num_tiles);
+	tile_depth_epoch = (uint32_t*)calloc(num_tiles, sizeof(uint32_t));
+	if (!tile_drawn || !tile_wiped || !tile_depth_epoch)
+	{
+		fprintf(stderr, "Error allocating the dirty tiles.\n");
+		dirty_destroy();
+		return false;
+	}
+
+	// Nothing is known about the buffers yet, so the first clear and upload cover the whole screen
+	memset(tile_drawn, 1, num_tiles);
+	memset(tile_wiped, 1, num_tiles);
+	depth_epoch = 1;
+	return true;
+}
+
+/* Function to mark the tiles overlapping a screen rectangle as drawn into this frame */
+void dirty_mark_rect(rect_t rect)
+{
+	int min_tx, min_ty, max_tx, max_ty;
+	if (!rect_tile_bounds(rect, &min_tx, &min_ty, &max_tx, &max_ty))
+	{
+		return;
+	}
+
+	for (int ty = min_ty; ty <= max_ty; ty++)
+	{
+		for (int tx = min_tx; tx <= max_tx; tx++)
+		{
+			tile_drawn[ty * num_tiles_x + tx] = 1;
+		}
+	}
+}
+
+/* Function to check whether the last color clear wiped a tile, so its background has to be drawn again */
+bool dirty_tile_wiped(int tile_x, int tile_y)
+{
+	return tile_wiped[tile_y * num_tiles_x + tile_x] != 0;
+}
+
+/* Function to clear the color of the tiles drawn into since the last clear */
+void dirty_clear_color(uint32_t color)
+{
+	for (int ty = 0; ty < num_tiles_y; ty++)
+	{
+		for (int tx = 0; tx < num_tiles_x; tx++)
+		{
+			int tile = ty * num_tiles_x + tx;
+			tile_wiped[tile] = tile_drawn[tile];
+			tile_drawn[tile] = 0;
+			if (!tile_wiped[tile])
+			{
+				continue;
+			}
+
+			rect_t rect = tile_pixels(tx, ty);
+			for (int y = rect.min_y; y <= rect.max_y; y++)
+			{
+				uint32_t* row = &render_target.color_buffer[render_target.width * y];
+				for (int x = rect.min_x; x <= rect.max_x; x++)
+				{
+					row[x] = color;
+				}
+			}
+		}
+	}
+}
+
+/* Function to start a new depth epoch, the depth of a tile is only cleared the first time it is drawn into afterwards */
+void dirty_clear_depth(void)
+{
+	depth_epoch++;
+
+	// Once the counter wraps around, stale epochs could look current again
+	if (depth_epoch == 0)
+	{
+		memset(tile_depth_epoch, 0, sizeof(uint32_t) * num_tiles);
+		depth_epoch = 1;
+	}
+}
+
+/* Function to make the depth of the tiles overlapping a screen rectangle valid for the current epoch */
+void dirty_acquire_depth(rect_t rect)
+{
+	int min_tx, min_ty, max_tx, max_ty;
+	if (!rect_tile_bounds(rect, &min_tx, &min_ty, &max_tx, &max_ty))
+	{
+		return;
+	}
+
+	for (int ty = min_ty; ty <= max_ty; ty++)
+	{
+		for (int tx = min_tx; tx <= max_tx; tx++)
+		{
+			int tile = ty * num_tiles_x + tx;
+			if (tile_depth_epoch[tile] == depth_epoch)
+			{
+				continue;
+			}
+
+			depth_clear_rect(tile_pixels(tx, ty));
+			tile_depth_epoch[tile] = depth_epoch;
+		}
+	}
+}
+
+/* Function to call a callback with every run of changed tiles in a tile row, or once with the whole screen when every tile changed */
+void dirty_for_each_run(dirty_run_t callback)
+{
+	// Tiles drawn into this frame changed, and so did the ones the last clear wiped back to the background
+	int num_changed = 0;
+	for (int tile = 0; tile < num_tiles; tile++)
+	{
+		num_changed += (tile_drawn[tile] | tile_wiped[tile]);
+	}
+
+	if (num_changed == num_tiles)
+	{
+		rect_t screen = { 0, 0, render_target.width - 1, render_target.height - 1 };
+		callback(screen);
+		return;
+	}
+
+	// Join the changed tiles of a tile row into runs, so each run is handled at once
+	for (int ty = 0; ty < num_tiles_y; ty++)
+	{
+		int tx = 0;
+		while (tx < num_tiles_x)
+		{
+			int tile = ty * num_tiles_x + tx;
+			if (!(tile_drawn[tile] | tile_wiped[tile]))
+			{
+				tx++;
+				continue;
+			}
+
+			int run_start = tx;
+			while (tx < num_tiles_x && (tile_drawn[ty * num_tiles_x + tx] | tile_wiped[ty * num_tiles_x + tx]))
+			{
+				tx++;
+			}
+
+			rect_t first = tile_pixels(run_start, ty);
+			rect_t last = tile_pixels(tx - 1, ty);
+			rect_t run = { first.min_x, first.min_y, last.max_x, last.max_y };
+			callback(run);
+		}
+	}
+}
+
+/* Function to free the dirty flags */
+void dirty_destroy(void)
+{
+	free(tile_drawn);
+	free(tile_wiped);
+	free(tile_depth_epoch);
+	tile_drawn = NULL;
+	tile_wiped = NULL;
+	tile_depth_epoch = NULL;
+	num_tiles = 0;
+}
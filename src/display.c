@@ -1,97 +1,142 @@
-﻿#include "display.h"
-#include "swap.h"
+﻿#include <math.h>
+#include <float.h>
+#include "display.h"
 #include "vector.h"
+#include "rasterizer.h"
+#include "depth.h"
+#include "hiz.h"
+#include "tiles.h"
+#include "dirty.h"
 
 /* Global variables */
-SDL_Window* window = NULL;
-SDL_Renderer* renderer = NULL;
-uint32_t* color_buffer = NULL;
-float* depth_buffer = NULL;
-SDL_Texture* color_buffer_texture = NULL;
-int window_width = 800;
-int window_height = 600;
-
-/* Function to initialize the window */
-bool initialize_window(void)
-{
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
-    {
-        fprintf(stderr, "Error initializing SDL.\n");
-        return false;
-    }
-
-    /* Set width and height of the SDL window with the max screen resolution */
-    SDL_DisplayMode display_mode;
-    SDL_GetCurrentDisplayMode(0, &display_mode);
-    window_width = display_mode.w;
-    window_height = display_mode.h;
-
-    /* Create a SDL Window */
-    window = SDL_CreateWindow(
-        NULL,
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        window_width,
-        window_height,
-        SDL_WINDOW_BORDERLESS
-    );
-    if (!window)
-    {
-        fprintf(stderr, "Error creating SDL window.\n");
-        return false;
-    }
+enum culling_mode culling_mode = CULLING_BACKFACE;
+enum render_mode render_mode = RENDER_WIRE;
+const char* const render_mode_names[RENDER_MODE_COUNT] = {
+	"wire", "wire_vertex", "fill", "fill_wire", "textured", "textured_wire", "visibility"
+};
 
-    /* Create a SDL renderer */
-    renderer = SDL_CreateRenderer(window, -1, 0);
-    if (!renderer)
-    {
-        fprintf(stderr, "Error creating SDL renderer.\n");
-        return false;
-    }
-
-    return true;
-}
-
-/* Function to draw a grid */
+/* Function to draw a grid, only into the tiles the last color clear wiped since the others still have it */
 void draw_grid(void)
 {
-    for (int y = 0; y < window_height; y += 10)
-    {
-        for (int x = 0; x < window_width; x += 10)
-        {
-            color_buffer[(window_width * y) + x] = 0xFF444444;
-        }
-    }
+	for (int tile_y = 0; tile_y * TILE_SIZE < render_target.height; tile_y++)
+	{
+		for (int tile_x = 0; tile_x * TILE_SIZE < render_target.width; tile_x++)
+		{
+			if (!dirty_tile_wiped(tile_x, tile_y))
+			{
+				continue;
+			}
+
+			int max_x = ((tile_x + 1) * TILE_SIZE < render_target.width) ? (tile_x + 1) * TILE_SIZE : render_target.width;
+			int max_y = ((tile_y + 1) * TILE_SIZE < render_target.height) ? (tile_y + 1) * TILE_SIZE : render_target.height;
+
+			// First multiple of 10 inside the tile
+			for (int y = (tile_y * TILE_SIZE + 9) / 10 * 10; y < max_y; y += 10)
+			{
+				for (int x = (tile_x * TILE_SIZE + 9) / 10 * 10; x < max_x; x += 10)
+				{
+					render_target.color_buffer[(render_target.width * y) + x] = 0xFF444444;
+				}
+			}
+		}
+	}
 }
 
 /* Function to draw a single pixel */
 void draw_pixel(int x, int y, uint32_t color)
 {
-    if (x >= 0 && x < window_width && y >= 0 && y < window_height)
+    if (x >= 0 && x < render_target.width && y >= 0 && y < render_target.height)
     {
-        color_buffer[(window_width * y) + x] = color;
+        render_target.color_buffer[(render_target.width * y) + x] = color;
+		dirty_mark_rect((rect_t){ x, y, x, y });
     }
 }
 
-/* Function to draw a line */
-void draw_line(int x0, int y0, int x1, int y1, uint32_t color)
+/* Clips a line to the inclusive clip rectangle (Liang-Barsky), returns false if no part of it is inside */
+static bool clip_line(int* x0, int* y0, int* x1, int* y1, rect_t clip)
 {
-    int delta_x = (x1 - x0);
-    int delta_y = (y1 - y0);
+	double delta_x = (double)*x1 - *x0;
+	double delta_y = (double)*y1 - *y0;
+	double p[4] = { -delta_x, delta_x, -delta_y, delta_y };
+	double q[4] = { (double)*x0 - clip.min_x, (double)clip.max_x - *x0, (double)*y0 - clip.min_y, (double)clip.max_y - *y0 };
+	double t_enter = 0.0;
+	double t_leave = 1.0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (p[i] == 0.0)
+		{
+			// Parallel to this side, either completely outside or not limited by it
+			if (q[i] < 0.0)
+			{
+				return false;
+			}
+			continue;
+		}
 
-    int longest_side_length = (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
+		double t = q[i] / p[i];
+		if (p[i] < 0.0)
+		{
+			if (t > t_leave) return false;
+			if (t > t_enter) t_enter = t;
+		}
+		else
+		{
+			if (t < t_enter) return false;
+			if (t < t_leave) t_leave = t;
+		}
+	}
 
-    float x_inc = delta_x / (float)longest_side_length;
-    float y_inc = delta_y / (float)longest_side_length;
+	double start_x = *x0;
+	double start_y = *y0;
+	*x0 = (int)floor(start_x + t_enter * delta_x + 0.5);
+	*y0 = (int)floor(start_y + t_enter * delta_y + 0.5);
+	*x1 = (int)floor(start_x + t_leave * delta_x + 0.5);
+	*y1 = (int)floor(start_y + t_leave * delta_y + 0.5);
+
+	// Rounding can put an end point half a pixel outside
+	*x0 = (*x0 < clip.min_x) ? clip.min_x : (*x0 > clip.max_x) ? clip.max_x : *x0;
+	*y0 = (*y0 < clip.min_y) ? clip.min_y : (*y0 > clip.max_y) ? clip.max_y : *y0;
+	*x1 = (*x1 < clip.min_x) ? clip.min_x : (*x1 > clip.max_x) ? clip.max_x : *x1;
+	*y1 = (*y1 < clip.min_y) ? clip.min_y : (*y1 > clip.max_y) ? clip.max_y : *y1;
+	return true;
+}
 
-    float current_x = x0;
-    float current_y = y0;
-    for (int i = 0; i <= longest_side_length; i++)
-    {
-        draw_pixel(round(current_x), round(current_y), color);
-        current_x += x_inc;
-        current_y += y_inc;
-    }
+/* Function to draw a line, clipped to the screen first so every pixel can be written without bounds checks */
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color)
+{
+	rect_t screen = { 0, 0, render_target.width - 1, render_target.height - 1 };
+	if (!clip_line(&x0, &y0, &x1, &y1, screen))
+	{
+		return;
+	}
+	dirty_mark_rect((rect_t){ (x0 < x1) ? x0 : x1, (y0 < y1) ? y0 : y1, (x0 > x1) ? x0 : x1, (y0 > y1) ? y0 : y1 });
+
+	// Integer Bresenham: always step along the major axis, and along the minor one whenever the error crosses over
+	int delta_x = abs(x1 - x0);
+	int delta_y = abs(y1 - y0);
+	int step_x = (x0 < x1) ? 1 : -1;
+	int step_y = (y0 < y1) ? render_target.width : -render_target.width;
+
+	int major_length = (delta_x >= delta_y) ? delta_x : delta_y;
+	int minor_length = (delta_x >= delta_y) ? delta_y : delta_x;
+	int major_step = (delta_x >= delta_y) ? step_x : step_y;
+	int minor_step = (delta_x >= delta_y) ? step_y : step_x;
+
+	uint32_t* pixel = &render_target.color_buffer[(render_target.width * y0) + x0];
+	int error = 2 * minor_length - major_length;
+	*pixel = color;
+	for (int i = 0; i < major_length; i++)
+	{
+		if (error > 0)
+		{
+			pixel += minor_step;
+			error -= 2 * major_length;
+		}
+		pixel += major_step;
+		error += 2 * minor_length;
+		*pixel = color;
+	}
 }
 
 /* Function to draw a triangle */
@@ -140,353 +185,168 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
 //	}
 //}
 
-vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p)
+/* Returns the smallest stored depth of a triangle, depth is linear in screen space so it is found at a vertex */
+static float nearest_triangle_depth(float w0, float w1, float w2)
 {
-	// Find the vectors between the vertices ABC and point P
-	vec2_t ac = vec2_sub(c, a);
-	vec2_t ab = vec2_sub(b, a);
-	vec2_t ap = vec2_sub(p, a);
-	vec2_t pc = vec2_sub(c, p);
-	vec2_t pb = vec2_sub(b, p);
-
-	// Compute the area of the parallelogram ABC using 2D cross product
-	float area_parallelogram_abc = (ac.x * ab.y - ac.y * ab.x); // |ac x ab|
-
-	// Alpha is teh area of the small parallelogram PBC divided by the area of the ABC parallelogram
-	float alpha = (pc.x * pb.y - pc.y * pb.x) / area_parallelogram_abc;
-
-	// Beta is the area of the small parallelogram APC divided by the area of the ABC parallelogram
-	float beta = (ac.x * ap.y - ac.y * ap.x) / area_parallelogram_abc;
-
-	// Gamma is the remaining area
-	float gamma = 1.0f - alpha - beta;
-
-	return (vec3_t) { alpha, beta, gamma };
+	// Vertices behind the camera have no meaningful depth, never reject their triangles
+	if (w0 <= 0.0f || w1 <= 0.0f || w2 <= 0.0f)
+	{
+		return -FLT_MAX;
+	}
+	return depth_key(fmaxf(fmaxf(1.0f / w0, 1.0f / w1), 1.0f / w2));
 }
 
-void draw_triangle_pixel(int x, int y, uint32_t color, vec4_t point_a, vec4_t point_b, vec4_t point_c)
+/* Returns the rectangle covering the whole color buffer */
+static rect_t screen_rect(void)
 {
-	vec2_t p = { x, y };
-	vec2_t a = vec2_from_vec4(point_a);
-	vec2_t b = vec2_from_vec4(point_b);
-	vec2_t c = vec2_from_vec4(point_c);
-
-	vec3_t weights = barycentric_weights(a, b, c, p);
-
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
-
-	float interpolated_reciprocal_w = (1.0f / point_a.w) * alpha + (1.0f / point_b.w) * beta + (1.0f / point_c.w) * gamma;
-
-	interpolated_reciprocal_w = 1.0f - interpolated_reciprocal_w;
-
-	if (interpolated_reciprocal_w < depth_buffer[(window_width * y) + x])
-	{
-		draw_pixel(x, y, color);
-		depth_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
-	}
+	rect_t rect = { 0, 0, render_target.width - 1, render_target.height - 1 };
+	return rect;
 }
 
 void draw_filled_triangle(
-	int x0, int y0, float z0, float w0,
-	int x1, int y1, float z1, float w1,
-	int x2, int y2, float z2, float w2,
+	float x0, float y0, float z0, float w0,
+	float x1, float y1, float z1, float w1,
+	float x2, float y2, float z2, float w2,
 	uint32_t color)
 {
-    // We need to sort the vertices by y-coordinate ascending (y0 < y1 < y2)
-	/* Sort the vertices, t0, t1, t2 lower−to−upper (bubblesort yay!) */
-	if (y0 > y1)
-	{
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-		float_swap(&z0, &z1);
-		float_swap(&w0, &w1);
-	}
-
-	if (y1 > y2)
-	{
-        int_swap(&y2, &y1);
-        int_swap(&x2, &x1);
-		float_swap(&z2, &z1);
-		float_swap(&w2, &w1);
-	}
-
-	if (y0 > y1)
-	{
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-		float_swap(&z0, &z1);
-		float_swap(&w0, &w1);
-	}
+	pixel_counts_t counts = { 0, 0 };
+	draw_filled_triangle_clipped(x0, y0, z0, w0, x1, y1, z1, w1, x2, y2, z2, w2, color, screen_rect(), &counts);
+}
 
-	/* Create vector points after we sort the vertices */
+/* Function to draw a filled triangle, only touching the pixels inside the clip rectangle, adding the pixels it tested and wrote to counts */
+void draw_filled_triangle_clipped(
+	float x0, float y0, float z0, float w0,
+	float x1, float y1, float z1, float w1,
+	float x2, float y2, float z2, float w2,
+	uint32_t color, rect_t clip, pixel_counts_t* counts)
+{
 	vec4_t point_a = { x0, y0, z0, w0 };
 	vec4_t point_b = { x1, y1, z1, w1 };
 	vec4_t point_c = { x2, y2, z2, w2 };
 
-	/* Render de upper part of the triangle (Flat-Bottom) */
-	float inv_slope_1 = 0.f;
-	float inv_slope_2 = 0.f;
-
-	if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / fabs(y1 - y0);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / fabs(y2 - y0);
-
-	if (y1 - y0 != 0)
+	triangle_edges_t edges;
+	if (!setup_triangle_edges(&edges, point_a, point_b, point_c, clip))
 	{
-		for (int y = y0; y <= y1; y++)
-		{
-			int start_x = x1 + (y - y1) * inv_slope_1;
-			int end_x = x0 + (y - y0) * inv_slope_2;
-
-			if (start_x > end_x)
-			{
-				int_swap(&start_x, &end_x);     // swap if start_x is to the right of end_x
-			}
-
-			for (int x = start_x; x < end_x; x++)
-			{
-				draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
-			}
-
-		}
+		return;
 	}
 
-	/* Render de bottom part of the triangle (Flat-Top) */
-	inv_slope_1 = 0.f;
-	inv_slope_2 = 0.f;
+	// Claim the tiles under the triangle, clearing their depth if this is the first draw since the last clear
+	rect_t bounds = { edges.min_x, edges.min_y, edges.max_x, edges.max_y };
+	dirty_mark_rect(bounds);
+	dirty_acquire_depth(bounds);
 
-	if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / fabs(y2 - y1);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / fabs(y2 - y0);
+	// Only 1/w is needed to depth test a flat colored triangle
+	attribute_plane_t reciprocal_w = setup_attribute_plane(&edges, 1.0f / w0, 1.0f / w1, 1.0f / w2);
 
-	if (y2 - y1 != 0)
+	// Only rasterize the runs of 8x8 blocks that are not already covered by closer pixels
+	hiz_iterator_t blocks;
+	rect_t run;
+	hiz_begin(&blocks, &edges, nearest_triangle_depth(w0, w1, w2));
+	while (hiz_next_run(&blocks, &run))
 	{
-		for (int y = y1; y <= y2; y++)
+		triangle_edges_t run_edges;
+		if (narrow_triangle_edges(&edges, run, &run_edges))
 		{
-			int start_x = x1 + (y - y1) * inv_slope_1;
-			int end_x = x0 + (y - y0) * inv_slope_2;
-
-			if (start_x > end_x)
-			{
-				int_swap(&start_x, &end_x);     // swap if start_x is to the right of end_x
-			}
-
-			for (int x = start_x; x < end_x; x++)
-			{
-				draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
-			}
+			attribute_plane_t run_reciprocal_w = narrow_attribute_plane(&edges, &run_edges, &reciprocal_w);
+			fill_triangle_kernel(&run_edges, &run_reciprocal_w, color, counts);
 		}
 	}
 }
 
-/* Function to draw the textured pixel at position x and y using interpolation */
-void draw_texel(
-    int x, int y, uint32_t* texture, 
-    vec4_t point_a, vec4_t point_b, vec4_t point_c, 
-    tex2_t a_uv, tex2_t b_uv, tex2_t c_uv)
+/* Function to draw a textured triangle */
+void draw_textured_triangle(
+    float x0, float y0, float z0, float w0, float u0, float v0,
+    float x1, float y1, float z1, float w1, float u1, float v1,
+    float x2, float y2, float z2, float w2, float u2, float v2,
+    const texture_level_t* texture)
 {
-    vec3_t weights = barycentric_weights(vec2_from_vec4(point_a), vec2_from_vec4(point_b), vec2_from_vec4(point_c), (vec2_t) { x, y });
-
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
-
-	// Variables to store the interpolated values of u, v and w for the current pixel
-    float interpolated_u;
-	float interpolated_v;
-	float interpolated_reciprocal_w;
-
-	// Perform the interpolation of all U/w and V/w values using barycentric weights and a factor of 1/w
-	interpolated_u = ((a_uv.u / point_a.w) * alpha) + ((b_uv.u / point_b.w) * beta) + ((c_uv.u / point_c.w) * gamma);
-	interpolated_v = ((a_uv.v / point_a.w) * alpha) + ((b_uv.v / point_b.w) * beta) + ((c_uv.v / point_c.w) * gamma);
-
-	// Also interpolate the reciprocal of w (1/w) for perspective correct texture mapping
-	interpolated_reciprocal_w = (1.0f / point_a.w) * alpha + (1.0f / point_b.w) * beta + (1.0f / point_c.w) * gamma;
-
-	// Divide the interpolated u and v by the interpolated reciprocal w
-	interpolated_u /= interpolated_reciprocal_w;
-	interpolated_v /= interpolated_reciprocal_w;
-
-	// Maps the u and v coordinates to the texture space (width and height)
-	int tex_x = abs((int)(interpolated_u * tex_width)) % tex_width;
-	int tex_y = abs((int)(interpolated_v * tex_height)) % tex_height;
-
-	// Clamp the texture coordinates to the texture width and height
-	// if (tex_x >= tex_width) tex_x = tex_width - 1;
-	// if (tex_y >= tex_height) tex_y = tex_height - 1;
-
-    // Get the color from the texture
-	uint32_t texel_color = texture[(tex_width * tex_y) + tex_x];
-
-	// Adjust the 1/w so the pixels that are closer to the camera have a smaller value
-	interpolated_reciprocal_w = 1.0f - interpolated_reciprocal_w;
-
-	// Check if the current pixel is closer to the camera than the previous one
-	if (interpolated_reciprocal_w < depth_buffer[(window_width * y) + x])
-	{
-		// Draw the pixel at position x and y with the texel color
-		draw_pixel(x, y, texel_color);
-
-		// Update the depth buffer with the interpolated reciprocal w
-		depth_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
-	}
+	pixel_counts_t counts = { 0, 0 };
+	draw_textured_triangle_clipped(
+		x0, y0, z0, w0, u0, v0,
+		x1, y1, z1, w1, u1, v1,
+		x2, y2, z2, w2, u2, v2,
+		texture, screen_rect(), &counts);
 }
 
-/* Function to draw a textured triangle */
-void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    uint32_t* texture)
+/* Function to draw a textured triangle, only touching the pixels inside the clip rectangle, adding the pixels it tested and wrote to counts */
+void draw_textured_triangle_clipped(
+	float x0, float y0, float z0, float w0, float u0, float v0,
+	float x1, float y1, float z1, float w1, float u1, float v1,
+	float x2, float y2, float z2, float w2, float u2, float v2,
+	const texture_level_t* texture, rect_t clip, pixel_counts_t* counts)
 {
-	// We need to sort the vertices by y-coordinate ascending (y0 < y1 < y2)
-	/* Sort the vertices, t0, t1, t2 lower−to−upper (bubblesort yay!) */
-	if (y0 > y1)
-	{
-		int_swap(&y0, &y1);
-		int_swap(&x0, &x1);
-		float_swap(&z0, &z1);
-		float_swap(&w0, &w1);
-		float_swap(&u0, &u1);
-		float_swap(&v0, &v1);
-	}
+	vec4_t point_a = { x0, y0, z0, w0 };
+	vec4_t point_b = { x1, y1, z1, w1 };
+	vec4_t point_c = { x2, y2, z2, w2 };
 
-	if (y1 > y2)
+	triangle_edges_t edges;
+	if (!setup_triangle_edges(&edges, point_a, point_b, point_c, clip))
 	{
-		int_swap(&y2, &y1);
-		int_swap(&x2, &x1);
-		float_swap(&z2, &z1);
-		float_swap(&w2, &w1);
-		float_swap(&u2, &u1);
-		float_swap(&v2, &v1);
+		return;
 	}
 
-	if (y0 > y1)
-	{
-		int_swap(&y0, &y1);
-		int_swap(&x0, &x1);
-		float_swap(&z0, &z1);
-		float_swap(&w0, &w1);
-		float_swap(&u0, &u1);
-		float_swap(&v0, &v1);
-	}
+	// Claim the tiles under the triangle, clearing their depth if this is the first draw since the last clear
+	rect_t bounds = { edges.min_x, edges.min_y, edges.max_x, edges.max_y };
+	dirty_mark_rect(bounds);
+	dirty_acquire_depth(bounds);
 
 	/* Flip the V component to account for inverted UV-Coordinates (V grows downwards) */
 	v0 = 1.0f - v0;
 	v1 = 1.0f - v1;
-	v2 = 1.0f - v2; 
-
-    /* Create vector points after we sort the vertices */
-	vec4_t point_a = { x0, y0, z0, w0 };
-	vec4_t point_b = { x1, y1, z1, w1 };
-	vec4_t point_c = { x2, y2, z2, w2 };
-
-	/* Render de upper part of the triangle (Flat-Bottom) */
-	float inv_slope_1 = 0.f;
-	float inv_slope_2 = 0.f;
-
-    if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / fabs(y1 - y0);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / fabs(y2 - y0);
-
-    if (y1 - y0 != 0) 
-    {
-        for (int y = y0; y <= y1; y++) 
-        {
-			int start_x = x1 + (y - y1) * inv_slope_1;
-			int end_x = x0 + (y - y0) * inv_slope_2;
-
-			if (start_x > end_x)
-			{
-				int_swap(&start_x, &end_x);     // swap if start_x is to the right of end_x
-			}
-
-			for (int x = start_x; x < end_x; x++)
-			{
-				draw_texel(x, y, texture, point_a, point_b, point_c, (tex2_t) { u0, v0 }, (tex2_t) { u1, v1 }, (tex2_t) { u2, v2 });
-			}
-
-        }
-    }
-
-    /* Render de bottom part of the triangle (Flat-Top) */
-    inv_slope_1 = 0.f;
-    inv_slope_2 = 0.f;
-
-	if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / fabs(y2 - y1);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / fabs(y2 - y0);
-
-	if (y2 - y1 != 0)
+	v2 = 1.0f - v2;
+
+	// U/w, V/w and 1/w are linear in screen space, so they can be stepped for perspective correct mapping
+	attribute_plane_t reciprocal_w = setup_attribute_plane(&edges, 1.0f / w0, 1.0f / w1, 1.0f / w2);
+	attribute_plane_t u_over_w = setup_attribute_plane(&edges, u0 / w0, u1 / w1, u2 / w2);
+	attribute_plane_t v_over_w = setup_attribute_plane(&edges, v0 / w0, v1 / w1, v2 / w2);
+
+	// Only rasterize the runs of 8x8 blocks that are not already covered by closer pixels
+	hiz_iterator_t blocks;
+	rect_t run;
+	hiz_begin(&blocks, &edges, nearest_triangle_depth(w0, w1, w2));
+	while (hiz_next_run(&blocks, &run))
 	{
-		for (int y = y1; y <= y2; y++)
+		triangle_edges_t run_edges;
+		if (narrow_triangle_edges(&edges, run, &run_edges))
 		{
-			int start_x = x1 + (y - y1) * inv_slope_1;
-			int end_x = x0 + (y - y0) * inv_slope_2;
-
-			if (start_x > end_x)
-			{
-				int_swap(&start_x, &end_x);     // swap if start_x is to the right of end_x
-			}
-
-			for (int x = start_x; x < end_x; x++)
-			{
-				draw_texel(x, y, texture, point_a, point_b, point_c, (tex2_t) { u0, v0 }, (tex2_t) { u1, v1 }, (tex2_t) { u2, v2 });
-			}
-
+			attribute_plane_t run_reciprocal_w = narrow_attribute_plane(&edges, &run_edges, &reciprocal_w);
+			attribute_plane_t run_u_over_w = narrow_attribute_plane(&edges, &run_edges, &u_over_w);
+			attribute_plane_t run_v_over_w = narrow_attribute_plane(&edges, &run_edges, &v_over_w);
+			// Edge functions too large for 32 bit lanes fall back to the 64 bit scalar kernel
+			texture_kernel_t kernel = run_edges.fits_32bit ? texture_triangle_kernels[texture->wrap] : texture_triangle_scalar[depth_format][texture->wrap];
+			kernel(&run_edges, &run_reciprocal_w, &run_u_over_w, &run_v_over_w, texture, counts);
 		}
 	}
 }
 
-/* Function to draw a rectangle */
+/* Function to draw a rectangle, clipped to the screen */
 void draw_rect(int x, int y, int width, int height, uint32_t color)
 {
-    for (int i = 0; i < width; i++)
-    {
-        for (int j = 0; j < height; j++)
-        {
-            int current_x = x + i;
-            int current_y = y + j;
-            draw_pixel(current_x, current_y, color);
-        }
-    }
-}
+	int min_x = (x > 0) ? x : 0;
+	int min_y = (y > 0) ? y : 0;
+	int max_x = (x + width < render_target.width) ? x + width : render_target.width;
+	int max_y = (y + height < render_target.height) ? y + height : render_target.height;
+	dirty_mark_rect((rect_t){ min_x, min_y, max_x - 1, max_y - 1 });
 
-/* Function to render the color buffer */
-void render_color_buffer(void)
-{
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int)(window_width * sizeof(uint32_t))
-    );
-    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+	for (int row = min_y; row < max_y; row++)
+	{
+		uint32_t* pixel = &render_target.color_buffer[render_target.width * row];
+		for (int column = min_x; column < max_x; column++)
+		{
+			pixel[column] = color;
+		}
+	}
 }
 
-/* Function to clear the color buffer */
+/* Function to clear the color buffer, only the tiles drawn into since the last clear are touched */
 void clear_color_buffer(uint32_t color)
 {
-    for (int y = 0; y < window_height; y++)
-    {
-        for (int x = 0; x < window_width; x++)
-        {
-            color_buffer[(window_width * y) + x] = color;
-        }
-    }
+	dirty_clear_color(color);
 }
 
-/* Function to clear the depth buffer */
+/* Function to clear the depth buffer, in O(1): every tile is cleared lazily by the first triangle drawn into it */
 void clear_depth_buffer(void)
 {
-	for (int i = 0; i < window_width * window_height; i++)
-	{
-		depth_buffer[i] = 1.0f;
-	}
+	dirty_clear_depth();
+	hiz_clear();
 }
-
-/* Function to destroy the window */
-void destroy_window(void)
-{
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-}
\ No newline at end of file
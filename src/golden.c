@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+#include "camera.h"
+#include "display.h"
+#include "scene.h"
+#include "tiles.h"
+#include "rasterizer.h"
+#include "depth.h"
+#include "dirty.h"
+#include "vertex.h"
+#include "pipeline.h"
+
+/*
+ * Golden image test of the raster paths: renders fixed camera poses of every bundled model in every
+ * render mode with the scalar kernels on one thread, and checks that the SIMD kernels and the tile
+ * threads draw the same color and depth, in every depth format and with reversed-Z:
+ *   3D-Renderer-golden assets_directory [--write dir | --compare dir] [--out dir] [--tolerance n] [--max-mismatches n] [--textured-simd-mismatches n]
+ * --write stores the scalar float depth renders as references, --compare checks them against references
+ * written earlier, so a change can be checked against the output from before it. --out writes every
+ * rendered image, and a diff image of every mismatch. Exits with 1 when any image does not match.
+ * Only the textured renders of the SIMD kernels may differ from the reference in a few pixels by default.
+ */
+
+#define GOLDEN_WIDTH 320
+#define GOLDEN_HEIGHT 240
+
+/* Bundled models with the texture they are drawn with, the sphere has no texture of its own */
+static const char* const golden_models[][2] = {
+	{ "cube", "cube" },
+	{ "crab", "crab" },
+	{ "drone", "drone" },
+	{ "efa", "efa" },
+	{ "f117", "f117" },
+	{ "f22", "f22" },
+	{ "sphere", "pikuma" }
+};
+#define NUM_GOLDEN_MODELS ((int)(sizeof(golden_models) / sizeof(golden_models[0])))
+
+/* Depth formats every render is checked in, the first one is the format of the stored references */
+static const struct
+{
+	const char* name;
+	enum depth_format format;
+	bool reversed;
+} golden_depths[] = {
+	{ "float32", DEPTH_FLOAT32, false },
+	{ "float32_reversed", DEPTH_FLOAT32, true },
+	{ "unorm24", DEPTH_UNORM24, false },
+	{ "unorm16", DEPTH_UNORM16, false }
+};
+#define NUM_GOLDEN_DEPTHS ((int)(sizeof(golden_depths) / sizeof(golden_depths[0])))
+
+/* Where the models are placed */
+#define MODEL_DISTANCE 5.0f
+
+/* Camera poses around the model: angle around it, distance from it and height */
+static const float golden_poses[][3] = {
+	{ 0.0f, 3.5f, 0.0f },
+	{ 0.9f, 3.0f, 0.4f },
+	{ -2.4f, 4.5f, -0.3f }
+};
+#define NUM_GOLDEN_POSES ((int)(sizeof(golden_poses) / sizeof(golden_poses[0])))
+
+/* Color and depth of one render, depth is normalized to a float whatever the format */
+typedef struct
+{
+	uint32_t* color;
+	float* depth;
+} golden_image_t;
+
+/* Limits of how far a render may be from its reference */
+static int color_tolerance = 0;         /* largest difference of a color channel that still matches */
+static float depth_tolerance = 1e-5f;   /* largest difference of a normalized depth that still matches, at least one step of a quantized format */
+static int max_mismatches = 0;          /* pixels of a render allowed to exceed the tolerances */
+static int textured_simd_mismatches = 4;    /* the same for textured renders of the SIMD kernels, stepping u/w and v/w along a row
+                                               instead of evaluating them per pixel can round a texel coordinate over to its neighbor */
+
+static const char* output_directory = NULL;
+
+/* Points the camera at the model from a pose */
+static void place_camera(int pose)
+{
+	float angle = golden_poses[pose][0];
+	float distance = golden_poses[pose][1];
+
+	camera.position.x = distance * sinf(angle);
+	camera.position.y = golden_poses[pose][2];
+	camera.position.z = MODEL_DISTANCE - distance * cosf(angle);
+	camera.yaw = atan2f(-camera.position.x, MODEL_DISTANCE - camera.position.z);
+}
+
+/* Renders a frame and copies its color and depth out of the render target */
+static void render_image(golden_image_t* image)
+{
+	pipeline_update();
+	pipeline_render();
+
+	// Tiles no triangle was drawn into still hold the depth of older frames, until they are cleared
+	rect_t screen = { 0, 0, render_target.width - 1, render_target.height - 1 };
+	dirty_acquire_depth(screen);
+
+	int num_pixels = render_target.width * render_target.height;
+	memcpy(image->color, render_target.color_buffer, sizeof(uint32_t) * num_pixels);
+	for (int y = 0; y < render_target.height; y++)
+	{
+		const void* row = depth_row(y, depth_format);
+		float* depth = &image->depth[render_target.width * y];
+		for (int x = 0; x < render_target.width; x++)
+		{
+			switch (depth_format)
+			{
+			case DEPTH_FLOAT32:
+				depth[x] = ((const float*)row)[x];
+				break;
+			case DEPTH_UNORM24:
+				depth[x] = (float)((const uint32_t*)row)[x] / (float)DEPTH_UNORM24_MAX;
+				break;
+			default:
+				depth[x] = (float)((const uint16_t*)row)[x] / (float)DEPTH_UNORM16_MAX;
+				break;
+			}
+		}
+	}
+}
+
+/* Writes the color of an image as a binary PPM, the pixels are RGBA32 so red is the lowest byte */
+static bool write_ppm(const char* path, const uint32_t* color, int width, int height)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Error writing %s.\n", path);
+		return false;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int i = 0; i < width * height; i++)
+	{
+		uint8_t rgb[3] = { (uint8_t)color[i], (uint8_t)(color[i] >> 8), (uint8_t)(color[i] >> 16) };
+		fwrite(rgb, 1, 3, file);
+	}
+	fclose(file);
+	return true;
+}
+
+/* Writes the depth of an image as a little endian PFM, rows from the bottom up like the format wants */
+static bool write_pfm(const char* path, const float* depth, int width, int height)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Error writing %s.\n", path);
+		return false;
+	}
+
+	fprintf(file, "Pf\n%d %d\n-1.0\n", width, height);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		fwrite(&depth[width * y], sizeof(float), width, file);
+	}
+	fclose(file);
+	return true;
+}
+
+/* Reads an image written by write_ppm and write_pfm, returns false if it is missing or has another size */
+static bool read_reference(const char* color_path, const char* depth_path, golden_image_t* image, int width, int height)
+{
+	int file_width = 0;
+	int file_height = 0;
+	bool read = false;
+
+	FILE* file = fopen(color_path, "rb");
+	if (file && fscanf(file, "P6 %d %d 255", &file_width, &file_height) == 2 && fgetc(file) != EOF &&
+		file_width == width && file_height == height)
+	{
+		read = true;
+		for (int i = 0; i < width * height && read; i++)
+		{
+			uint8_t rgb[3];
+			read = (fread(rgb, 1, 3, file) == 3);
+			image->color[i] = 0xFF000000 | ((uint32_t)rgb[2] << 16) | ((uint32_t)rgb[1] << 8) | rgb[0];
+		}
+	}
+	if (file)
+	{
+		fclose(file);
+	}
+	if (!read)
+	{
+		fprintf(stderr, "Error reading %s.\n", color_path);
+		return false;
+	}
+
+	read = false;
+	file = fopen(depth_path, "rb");
+	if (file && fscanf(file, "Pf %d %d -1.0", &file_width, &file_height) == 2 && fgetc(file) != EOF &&
+		file_width == width && file_height == height)
+	{
+		read = true;
+		for (int y = height - 1; y >= 0 && read; y--)
+		{
+			read = (fread(&image->depth[width * y], sizeof(float), width, file) == (size_t)width);
+		}
+	}
+	if (file)
+	{
+		fclose(file);
+	}
+	if (!read)
+	{
+		fprintf(stderr, "Error reading %s.\n", depth_path);
+	}
+	return read;
+}
+
+/* Compares an image against its reference, prints and writes the mismatches, returns whether at most allowed_mismatches pixels differ */
+static bool compare_images(const golden_image_t* image, const golden_image_t* reference, const char* name, int allowed_mismatches)
+{
+	int num_pixels = render_target.width * render_target.height;
+	int color_mismatches = 0;
+	int depth_mismatches = 0;
+	int largest_channel = 0;
+	float largest_depth = 0.0f;
+	uint32_t* diff = output_directory ? (uint32_t*)calloc(num_pixels, sizeof(uint32_t)) : NULL;
+
+	// The SIMD kernels step 1/w by adding instead of evaluating it per pixel, which can round a quantized depth one step apart
+	float depth_step = 0.0f;
+	if (depth_format == DEPTH_UNORM24)
+	{
+		depth_step = 1.0f / (float)DEPTH_UNORM24_MAX;
+	}
+	else if (depth_format == DEPTH_UNORM16)
+	{
+		depth_step = 1.0f / (float)DEPTH_UNORM16_MAX;
+	}
+	float allowed_depth = (depth_tolerance > depth_step * 1.5f) ? depth_tolerance : depth_step * 1.5f;
+
+	for (int i = 0; i < num_pixels; i++)
+	{
+		int channel = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			int difference = abs((int)((image->color[i] >> shift) & 0xFF) - (int)((reference->color[i] >> shift) & 0xFF));
+			channel = (difference > channel) ? difference : channel;
+		}
+		float depth = fabsf(image->depth[i] - reference->depth[i]);
+
+		// Red where the color differs, green where the depth does
+		bool color_differs = (channel > color_tolerance);
+		bool depth_differs = !(depth <= allowed_depth);
+		color_mismatches += color_differs;
+		depth_mismatches += depth_differs;
+		largest_channel = (channel > largest_channel) ? channel : largest_channel;
+		largest_depth = (depth > largest_depth) ? depth : largest_depth;
+		if (diff)
+		{
+			diff[i] = 0xFF000000 | (color_differs ? 0x000000FF : 0) | (depth_differs ? 0x0000FF00 : 0);
+		}
+	}
+
+	// Differences within the budget are printed too, so they cannot grow unnoticed
+	bool matched = (color_mismatches <= allowed_mismatches && depth_mismatches <= allowed_mismatches);
+	if (color_mismatches > 0 || depth_mismatches > 0)
+	{
+		printf("%s %s: %d color pixels (largest channel difference %d), %d depth pixels (largest difference %g), %d allowed\n",
+			matched ? "WITHIN BUDGET" : "MISMATCH", name, color_mismatches, largest_channel, depth_mismatches, largest_depth, allowed_mismatches);
+	}
+	if (!matched)
+	{
+		if (diff)
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), "%s/%s_diff.ppm", output_directory, name);
+			write_ppm(path, diff, render_target.width, render_target.height);
+		}
+	}
+	free(diff);
+	return matched;
+}
+
+/* Switches to one of the golden depth formats, instruction set of the vertex and pixel kernels and number of rasterizer threads, returns false if the CPU lacks the instruction set */
+static bool select_raster_path(int depth, enum raster_isa isa, int num_threads)
+{
+	tiles_destroy();
+	if (!tiles_init(num_threads) || !depth_init(golden_depths[depth].format, golden_depths[depth].reversed))
+	{
+		return false;
+	}
+	clear_depth_buffer();
+	enum raster_isa vertex_isa = vertex_select_isa(isa);
+	return rasterizer_select_isa(isa) == isa && vertex_isa == isa;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* assets = NULL;
+	const char* write_directory = NULL;
+	const char* compare_directory = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = (i + 1 < argc);
+		if (strcmp(argv[i], "--write") == 0 && has_value)
+		{
+			write_directory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--compare") == 0 && has_value)
+		{
+			compare_directory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--out") == 0 && has_value)
+		{
+			output_directory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && has_value)
+		{
+			color_tolerance = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max-mismatches") == 0 && has_value)
+		{
+			max_mismatches = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--textured-simd-mismatches") == 0 && has_value)
+		{
+			textured_simd_mismatches = atoi(argv[++i]);
+		}
+		else if (!assets && argv[i][0] != '-')
+		{
+			assets = argv[i];
+		}
+		else
+		{
+			assets = NULL;
+			break;
+		}
+	}
+	if (!assets)
+	{
+		fprintf(stderr, "Usage: %s assets_directory [--write dir | --compare dir] [--out dir] [--tolerance n] [--max-mismatches n] [--textured-simd-mismatches n]\n", argv[0]);
+		return 1;
+	}
+
+	if (!pipeline_init(GOLDEN_WIDTH, GOLDEN_HEIGHT, DEPTH_FLOAT32, false))
+	{
+		pipeline_destroy();
+		return 1;
+	}
+	culling_mode = CULLING_BACKFACE;
+
+	// More threads than cores still splits the tiles between threads, which is what is tested
+	int num_threads = SDL_GetCPUCount();
+	num_threads = (num_threads > 4) ? num_threads : 4;
+
+	int num_pixels = GOLDEN_WIDTH * GOLDEN_HEIGHT;
+	golden_image_t reference = { (uint32_t*)malloc(sizeof(uint32_t) * num_pixels), (float*)malloc(sizeof(float) * num_pixels) };
+	golden_image_t image = { (uint32_t*)malloc(sizeof(uint32_t) * num_pixels), (float*)malloc(sizeof(float) * num_pixels) };
+	golden_image_t stored = { (uint32_t*)malloc(sizeof(uint32_t) * num_pixels), (float*)malloc(sizeof(float) * num_pixels) };
+	if (!reference.color || !reference.depth || !image.color || !image.depth || !stored.color || !stored.depth)
+	{
+		fprintf(stderr, "Error allocating the golden images.\n");
+		return 1;
+	}
+
+	int num_checked = 0;
+	int num_failed = 0;
+	for (int model = 0; model < NUM_GOLDEN_MODELS; model++)
+	{
+		char path[1024];
+		char depth_path[1024];
+		snprintf(path, sizeof(path), "%s/obj/%s.obj", assets, golden_models[model][0]);
+		char texture_path[1024];
+		snprintf(texture_path, sizeof(texture_path), "%s/textures/%s.png", assets, golden_models[model][1]);
+		int instance = scene_add_instance(scene_load_asset(path, texture_path));
+		if (instance < 0)
+		{
+			return 1;
+		}
+		scene.instances[instance].translation.z = MODEL_DISTANCE;
+
+		for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+		{
+			render_mode = (enum render_mode)mode;
+			for (int pose = 0; pose < NUM_GOLDEN_POSES; pose++)
+			{
+				place_camera(pose);
+				for (int depth = 0; depth < NUM_GOLDEN_DEPTHS; depth++)
+				{
+					char name[256];
+					snprintf(name, sizeof(name), "%s_%s_%d_%s", golden_models[model][0], render_mode_names[mode], pose, golden_depths[depth].name);
+
+					// The scalar kernels on one thread are the reference every other path has to match
+					select_raster_path(depth, RASTER_ISA_SCALAR, 1);
+					render_image(&reference);
+
+					if (output_directory)
+					{
+						snprintf(path, sizeof(path), "%s/%s_reference.ppm", output_directory, name);
+						write_ppm(path, reference.color, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+					}
+
+					// Only the default format is stored, the others are checked against it through the scalar path
+					if (depth == 0 && (write_directory || compare_directory))
+					{
+						const char* directory = write_directory ? write_directory : compare_directory;
+						snprintf(path, sizeof(path), "%s/%s.ppm", directory, name);
+						snprintf(depth_path, sizeof(depth_path), "%s/%s.pfm", directory, name);
+						if (write_directory)
+						{
+							if (!write_ppm(path, reference.color, GOLDEN_WIDTH, GOLDEN_HEIGHT) || !write_pfm(depth_path, reference.depth, GOLDEN_WIDTH, GOLDEN_HEIGHT))
+							{
+								return 1;
+							}
+						}
+						else
+						{
+							num_checked++;
+							if (!read_reference(path, depth_path, &stored, GOLDEN_WIDTH, GOLDEN_HEIGHT) || !compare_images(&reference, &stored, name, max_mismatches))
+							{
+								num_failed++;
+							}
+						}
+					}
+
+					for (int isa = RASTER_ISA_SCALAR; isa < RASTER_ISA_COUNT; isa++)
+					{
+						for (int threads = 1; threads <= num_threads; threads += num_threads - 1)
+						{
+							if ((isa == RASTER_ISA_SCALAR && threads == 1) || !select_raster_path(depth, (enum raster_isa)isa, threads))
+							{
+								continue;
+							}
+
+							char variant[300];
+							snprintf(variant, sizeof(variant), "%s_%s_%dthreads", name, raster_isa_names[isa], threads);
+							render_image(&image);
+							if (output_directory)
+							{
+								snprintf(path, sizeof(path), "%s/%s.ppm", output_directory, variant);
+								write_ppm(path, image.color, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+							}
+
+							bool textured = (render_mode == RENDER_TEXTURED || render_mode == RENDER_TEXTURED_WIRE);
+							int allowed_mismatches = (textured && isa != RASTER_ISA_SCALAR) ? textured_simd_mismatches : max_mismatches;
+							num_checked++;
+							num_failed += !compare_images(&image, &reference, variant, allowed_mismatches);
+						}
+					}
+				}
+			}
+		}
+
+		scene_destroy();
+	}
+
+	if (write_directory)
+	{
+		printf("Wrote the reference images to %s.\n", write_directory);
+	}
+	printf("%d of %d images matched.\n", num_checked - num_failed, num_checked);
+
+	free(reference.color);
+	free(reference.depth);
+	free(image.color);
+	free(image.depth);
+	free(stored.color);
+	free(stored.depth);
+	pipeline_destroy();
+	return (num_failed == 0) ? 0 : 1;
+}
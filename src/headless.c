@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include <SDL.h>
+#include "display.h"
+#include "scene.h"
+#include "pipeline.h"
+
+/*
+ * Renders a model into memory without opening a window, for machines without a display:
+ *   3D-Renderer-headless model.obj texture.png [width height render_mode frames instances depth_format reversed_depth]
+ * The frames are rendered back to back and the average frame time is printed. More than one instance
+ * lays copies of the model out on a square grid going away from the camera, sharing one loaded mesh.
+ * The depth format is a number in enum depth_format order, and a reversed_depth of 1 stores reversed-Z.
+ */
+
+/* Where the first row of the grid is placed, the same as the windowed renderer */
+#define MODEL_DISTANCE 5.0f
+
+/* Function to place count instances of an asset on a square grid in front of the camera, a little more than one model apart */
+static bool place_instances(int asset, int count)
+{
+	int side = (int)ceilf(sqrtf((float)count));
+	float spacing = 2.5f * scene.assets[asset].lods[0].mesh.bounds.radius;
+	for (int i = 0; i < count; i++)
+	{
+		int instance = scene_add_instance(asset);
+		if (instance < 0)
+		{
+			return false;
+		}
+		scene.instances[instance].translation.x = ((float)(i % side) - 0.5f * (float)(side - 1)) * spacing;
+		scene.instances[instance].translation.z = MODEL_DISTANCE + (float)(i / side) * spacing;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s model.obj texture.png [width height render_mode frames instances depth_format reversed_depth]\n", argv[0]);
+		return 1;
+	}
+
+	int width = (argc > 3) ? atoi(argv[3]) : 800;
+	int height = (argc > 4) ? atoi(argv[4]) : 600;
+	int mode = (argc > 5) ? atoi(argv[5]) : RENDER_TEXTURED;
+	int frames = (argc > 6) ? atoi(argv[6]) : 100;
+	int instances = (argc > 7) ? atoi(argv[7]) : 1;
+	int format = (argc > 8) ? atoi(argv[8]) : DEPTH_FLOAT32;
+	bool reversed_depth = (argc > 9) ? atoi(argv[9]) != 0 : false;
+	if (width <= 0 || height <= 0 || mode < 0 || mode >= RENDER_MODE_COUNT || frames <= 0 || instances <= 0 || format < 0 || format >= DEPTH_FORMAT_COUNT)
+	{
+		fprintf(stderr, "Invalid size, render mode, frame count, instance count or depth format.\n");
+		return 1;
+	}
+
+	int asset = -1;
+	if (!pipeline_init(width, height, (enum depth_format)format, reversed_depth) || (asset = scene_load_asset(argv[1], argv[2])) < 0 || !place_instances(asset, instances))
+	{
+		pipeline_destroy();
+		scene_destroy();
+		return 1;
+	}
+
+	render_mode = (enum render_mode)mode;
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		pipeline_update();
+		pipeline_render();
+	}
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+	printf("%d frames of %d instances at %dx%d in render mode %d with depth format %d%s: %.3f ms per frame\n",
+		frames, instances, width, height, mode, format, reversed_depth ? " reversed" : "", seconds * 1000.0 / frames);
+
+	pipeline_destroy();
+	scene_destroy();
+	return 0;
+}
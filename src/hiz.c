@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "depth.h"
+#include "hiz.h"
+
+/* Blocks per row and column of each level */
+static int fine_width = 0;
+static int fine_height = 0;
+static int coarse_width = 0;
+static int coarse_height = 0;
+
+/*
+ * Farthest depth of each block. A depth test only ever lowers the values in the depth buffer,
+ * so an old maximum is still an upper bound after new pixels are written. The dirty flags only
+ * mark blocks whose maximum may have become tighter, it is recomputed when a test needs it.
+ */
+static float* fine_max_depth = NULL;
+static float* coarse_max_depth = NULL;
+static bool* fine_dirty = NULL;
+static bool* coarse_dirty = NULL;
+
+#define BLOCKS_PER_COARSE_BLOCK (HIZ_COARSE_BLOCK_SIZE / HIZ_BLOCK_SIZE)
+
+/* Function to allocate the depth hierarchy for the current window size */
+bool hiz_init(void)
+{
+	fine_width = (render_target.width + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+	fine_height = (render_target.height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+	coarse_width = (render_target.width + HIZ_COARSE_BLOCK_SIZE - 1) / HIZ_COARSE_BLOCK_SIZE;
+	coarse_height = (render_target.height + HIZ_COARSE_BLOCK_SIZE - 1) / HIZ_COARSE_BLOCK_SIZE;
+
+	fine_max_depth = (float*)malloc(sizeof(float) * fine_width * fine_height);
+	coarse_max_depth = (float*)malloc(sizeof(float) * coarse_width * coarse_height);
+	fine_dirty = (bool*)malloc(sizeof(bool) * fine_width * fine_height);
+	coarse_dirty = (bool*)malloc(sizeof(bool) * coarse_width * coarse_height);
+
+	if (!fine_max_depth || !coarse_max_depth || !fine_dirty || !coarse_dirty)
+	{
+		fprintf(stderr, "Error allocating the depth hierarchy.\n");
+		return false;
+	}
+
+	hiz_clear();
+	return true;
+}
+
+/* Function to reset every level to the far plane, together with the depth buffer */
+void hiz_clear(void)
+{
+	float far_depth = depth_key(0.0f);
+	for (int i = 0; i < fine_width * fine_height; i++)
+	{
+		fine_max_depth[i] = far_depth;
+	}
+	for (int i = 0; i < coarse_width * coarse_height; i++)
+	{
+		coarse_max_depth[i] = far_depth;
+	}
+	memset(fine_dirty, 0, sizeof(bool) * fine_width * fine_height);
+	memset(coarse_dirty, 0, sizeof(bool) * coarse_width * coarse_height);
+}
+
+/* Recomputes the farthest depth of an 8x8 block from the depth buffer */
+static void tighten_fine_block(int block_x, int block_y)
+{
+	int min_x = block_x * HIZ_BLOCK_SIZE;
+	int min_y = block_y * HIZ_BLOCK_SIZE;
+	int max_x = (min_x + HIZ_BLOCK_SIZE < render_target.width) ? min_x + HIZ_BLOCK_SIZE : render_target.width;
+	int max_y = (min_y + HIZ_BLOCK_SIZE < render_target.height) ? min_y + HIZ_BLOCK_SIZE : render_target.height;
+
+	rect_t block = { min_x, min_y, max_x - 1, max_y - 1 };
+	fine_max_depth[(fine_width * block_y) + block_x] = depth_max_rect(block);
+	fine_dirty[(fine_width * block_y) + block_x] = false;
+	coarse_dirty[(coarse_width * (block_y / BLOCKS_PER_COARSE_BLOCK)) + (block_x / BLOCKS_PER_COARSE_BLOCK)] = true;
+}
+
+/* Recomputes the farthest depth of a 64x64 block from the 8x8 blocks inside it */
+static void tighten_coarse_block(int coarse_x, int coarse_y)
+{
+	int min_block_x = coarse_x * BLOCKS_PER_COARSE_BLOCK;
+	int min_block_y = coarse_y * BLOCKS_PER_COARSE_BLOCK;
+	int max_block_x = (min_block_x + BLOCKS_PER_COARSE_BLOCK < fine_width) ? min_block_x + BLOCKS_PER_COARSE_BLOCK : fine_width;
+	int max_block_y = (min_block_y + BLOCKS_PER_COARSE_BLOCK < fine_height) ? min_block_y + BLOCKS_PER_COARSE_BLOCK : fine_height;
+
+	float max_depth = -FLT_MAX;
+	for (int block_y = min_block_y; block_y < max_block_y; block_y++)
+	{
+		for (int block_x = min_block_x; block_x < max_block_x; block_x++)
+		{
+			float block_depth = fine_max_depth[(fine_width * block_y) + block_x];
+			max_depth = (block_depth > max_depth) ? block_depth : max_depth;
+		}
+	}
+
+	coarse_max_depth[(coarse_width * coarse_y) + coarse_x] = max_depth;
+	coarse_dirty[(coarse_width * coarse_y) + coarse_x] = false;
+}
+
+/* Checks if anything at nearest_depth can pass the depth test inside a 64x64 block */
+static bool coarse_block_visible(int coarse_x, int coarse_y, float nearest_depth)
+{
+	int index = (coarse_width * coarse_y) + coarse_x;
+	if (nearest_depth < coarse_max_depth[index])
+	{
+		if (!coarse_dirty[index])
+		{
+			return true;
+		}
+		tighten_coarse_block(coarse_x, coarse_y);
+	}
+	return nearest_depth < coarse_max_depth[index];
+}
+
+/* Checks if anything at nearest_depth can pass the depth test inside an 8x8 block */
+static bool fine_block_visible(int block_x, int block_y, float nearest_depth)
+{
+	int index = (fine_width * block_y) + block_x;
+	if (nearest_depth < fine_max_depth[index])
+	{
+		if (!fine_dirty[index])
+		{
+			return true;
+		}
+		tighten_fine_block(block_x, block_y);
+	}
+	return nearest_depth < fine_max_depth[index];
+}
+
+/* Flags the blocks under a rasterized run, their farthest depth may have come closer */
+static void mark_dirty(rect_t run)
+{
+	for (int block_y = run.min_y / HIZ_BLOCK_SIZE; block_y <= run.max_y / HIZ_BLOCK_SIZE; block_y++)
+	{
+		for (int block_x = run.min_x / HIZ_BLOCK_SIZE; block_x <= run.max_x / HIZ_BLOCK_SIZE; block_x++)
+		{
+			fine_dirty[(fine_width * block_y) + block_x] = true;
+		}
+	}
+	for (int coarse_y = run.min_y / HIZ_COARSE_BLOCK_SIZE; coarse_y <= run.max_y / HIZ_COARSE_BLOCK_SIZE; coarse_y++)
+	{
+		for (int coarse_x = run.min_x / HIZ_COARSE_BLOCK_SIZE; coarse_x <= run.max_x / HIZ_COARSE_BLOCK_SIZE; coarse_x++)
+		{
+			coarse_dirty[(coarse_width * coarse_y) + coarse_x] = true;
+		}
+	}
+}
+
+/* Function to start walking the bounding box of a set up triangle, rejecting it whole if it is hidden */
+void hiz_begin(hiz_iterator_t* iterator, const triangle_edges_t* edges, float nearest_depth)
+{
+	iterator->bounds = (rect_t){ edges->min_x, edges->min_y, edges->max_x, edges->max_y };
+	iterator->nearest_depth = nearest_depth;
+	iterator->min_block_x = edges->min_x / HIZ_BLOCK_SIZE;
+	iterator->max_block_x = edges->max_x / HIZ_BLOCK_SIZE;
+	iterator->max_block_y = edges->max_y / HIZ_BLOCK_SIZE;
+	iterator->block_x = iterator->min_block_x;
+	iterator->block_y = edges->min_y / HIZ_BLOCK_SIZE;
+	iterator->done = false;
+
+	// Testing blocks costs more than it saves for triangles smaller than a block
+	int area = (edges->max_x - edges->min_x + 1) * (edges->max_y - edges->min_y + 1);
+	iterator->test_blocks = (area >= HIZ_MIN_TEST_AREA);
+	if (!iterator->test_blocks)
+	{
+		return;
+	}
+
+	// Reject the whole triangle if it is behind every 64x64 block it touches
+	for (int coarse_y = edges->min_y / HIZ_COARSE_BLOCK_SIZE; coarse_y <= edges->max_y / HIZ_COARSE_BLOCK_SIZE; coarse_y++)
+	{
+		for (int coarse_x = edges->min_x / HIZ_COARSE_BLOCK_SIZE; coarse_x <= edges->max_x / HIZ_COARSE_BLOCK_SIZE; coarse_x++)
+		{
+			if (coarse_block_visible(coarse_x, coarse_y, nearest_depth))
+			{
+				return;
+			}
+		}
+	}
+	iterator->done = true;
+}
+
+/* Function to get the next run of blocks the triangle may be visible in, returns false when done */
+bool hiz_next_run(hiz_iterator_t* iterator, rect_t* run)
+{
+	if (iterator->done)
+	{
+		return false;
+	}
+
+	if (!iterator->test_blocks)
+	{
+		*run = iterator->bounds;
+		mark_dirty(*run);
+		iterator->done = true;
+		return true;
+	}
+
+	while (iterator->block_y <= iterator->max_block_y)
+	{
+		// Skip the hidden blocks, then extend the run over the visible ones that follow
+		while (iterator->block_x <= iterator->max_block_x &&
+			!fine_block_visible(iterator->block_x, iterator->block_y, iterator->nearest_depth))
+		{
+			iterator->block_x++;
+		}
+
+		int run_start = iterator->block_x;
+		while (iterator->block_x <= iterator->max_block_x &&
+			fine_block_visible(iterator->block_x, iterator->block_y, iterator->nearest_depth))
+		{
+			iterator->block_x++;
+		}
+		int run_end = iterator->block_x - 1;
+		int block_y = iterator->block_y;
+
+		if (iterator->block_x > iterator->max_block_x)
+		{
+			iterator->block_x = iterator->min_block_x;
+			iterator->block_y++;
+		}
+
+		if (run_start <= run_end)
+		{
+			run->min_x = (run_start * HIZ_BLOCK_SIZE > iterator->bounds.min_x) ? run_start * HIZ_BLOCK_SIZE : iterator->bounds.min_x;
+			run->min_y = (block_y * HIZ_BLOCK_SIZE > iterator->bounds.min_y) ? block_y * HIZ_BLOCK_SIZE : iterator->bounds.min_y;
+			run->max_x = ((run_end + 1) * HIZ_BLOCK_SIZE - 1 < iterator->bounds.max_x) ? (run_end + 1) * HIZ_BLOCK_SIZE - 1 : iterator->bounds.max_x;
+			run->max_y = ((block_y + 1) * HIZ_BLOCK_SIZE - 1 < iterator->bounds.max_y) ? (block_y + 1) * HIZ_BLOCK_SIZE - 1 : iterator->bounds.max_y;
+			mark_dirty(*run);
+			return true;
+		}
+	}
+
+	iterator->done = true;
+	return false;
+}
+
+/* Function to free the depth hierarchy */
+void hiz_destroy(void)
+{
+	free(fine_max_depth);
+	free(coarse_max_depth);
+	free(fine_dirty);
+	free(coarse_dirty);
+	fine_max_depth = NULL;
+	coarse_max_depth = NULL;
+	fine_dirty = NULL;
+	coarse_dirty = NULL;
+}
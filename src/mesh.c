@@ -3,15 +3,6 @@
 #include "array.h"
 #include "mesh.h"
 
-/* Global mesh variable */
-mesh_t mesh = {
-    .vertices = NULL,
-    .faces = NULL,
-	.rotation = { 0.0f, 0.0f, 0.0f },
-	.scale = { 1.0f, 1.0f, 1.0f },
-	.translation = { 0.0f, 0.0f, 0.0f }
-};
-
 /* Cube vertices */
 vec3_t cube_vertices[N_CUBE_VERTICES] = {
     {.x = -1, .y = -1, .z = -1 }, /* 1 */
@@ -46,28 +37,38 @@ face_t cube_faces[N_CUBE_FACES] = {
 };
 
 /* Function to load cube mesh data */
-void load_cube_mesh_data(void)
+bool load_cube_mesh_data(mesh_t* mesh)
 {
-    for (int i = 0; i < N_CUBE_VERTICES; i++)
+    memset(mesh, 0, sizeof(mesh_t));
+    if (!vertex_buffer_init(&mesh->vertices, cube_vertices, N_CUBE_VERTICES))
     {
-        vec3_t cube_vertex = cube_vertices[i];
-        array_push(mesh.vertices, cube_vertex);
+        return false;
     }
+    mesh->bounds = bounds_from_points(mesh->vertices.x, mesh->vertices.y, mesh->vertices.z, mesh->vertices.count);
     for (int i = 0; i < N_CUBE_FACES; i++)
     {
         face_t cube_face = cube_faces[i];
-        array_push(mesh.faces, cube_face);
+        array_push(mesh->faces, cube_face);
     }
+    return true;
 }
 
 /* Function to load mesh data from an OBJ file */
-void load_obj_file_data(char* filename)
+bool load_obj_file_data(mesh_t* mesh, const char* filename)
 {
+    memset(mesh, 0, sizeof(mesh_t));
+
     FILE* file;
     file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening %s.\n", filename);
+        return false;
+    }
     char line[1024];
 
 	tex2_t* uvs = NULL;
+	vec3_t* positions = NULL;
 
     while (fgets(line, 1024, file))
     {
@@ -76,7 +77,7 @@ void load_obj_file_data(char* filename)
         {
             vec3_t vertex;
             sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+            array_push(positions, vertex);
         }
 		if (strncmp(line, "vt", 2) == 0)        // Texture coordinates
         {
@@ -105,10 +106,26 @@ void load_obj_file_data(char* filename)
 				.c_uv = uvs[texture_indices[2] - 1],
 				.color = 0xFFFFFFFF
             };
-            array_push(mesh.faces, face);
+            array_push(mesh->faces, face);
         }
     }
 
+	/* Keep the positions as one array per coordinate for the batched vertex transform */
+	bool loaded = vertex_buffer_init(&mesh->vertices, positions, array_length(positions));
+
+	/* Bound the mesh once, so whole frames of it off screen are skipped before touching a face */
+	mesh->bounds = bounds_from_points(mesh->vertices.x, mesh->vertices.y, mesh->vertices.z, mesh->vertices.count);
+
+	array_free(positions);
 	array_free(uvs);
     fclose(file);
+    return loaded;
+}
+
+/* Function to free the vertices and faces of a mesh */
+void free_mesh(mesh_t* mesh)
+{
+    array_free(mesh->faces);
+    vertex_buffer_destroy(&mesh->vertices);
+    memset(mesh, 0, sizeof(mesh_t));
 }
\ No newline at end of file
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "array.h"
+#include "camera.h"
+#include "display.h"
+#include "vector.h"
+#include "matrix.h"
+#include "clipping.h"
+#include "light.h"
+#include "mesh.h"
+#include "scene.h"
+#include "bvh.h"
+#include "tiles.h"
+#include "rasterizer.h"
+#include "depth.h"
+#include "hiz.h"
+#include "visibility.h"
+#include "wireframe.h"
+#include "dirty.h"
+#include "render_target.h"
+#include "stats.h"
+#include "vertex.h"
+#include "pipeline.h"
+
+/* Array of triangles that should be rendered frame by frame, grown to hold the triangles of every instance */
+static triangle_t* triangles_to_render = NULL;
+static int triangles_to_render_capacity = 0;
+int num_triangles_to_render = 0;
+
+/* A face facing the camera on its way through the stages of pipeline_update: its normal in camera space and the clip-space planes it crosses */
+typedef struct
+{
+	vec3_t normal;
+	int face_index;
+	uint8_t outcodes;
+} transformed_face_t;
+
+static transformed_face_t* transformed_faces = NULL;
+static int transformed_faces_capacity = 0;
+
+/* A triangle in clip space left over after clipping a visible face, the face itself when it needed no clipping */
+typedef struct
+{
+	vec4_t points[3];
+	tex2_t texcoords[3];
+	int visible_face;   /* index into transformed_faces */
+	int fan_index;      /* position in the fan the face was clipped into, 0 for the first triangle */
+	bool clipped;
+} clipped_triangle_t;
+
+static clipped_triangle_t* clipped_triangles = NULL;
+static int clipped_triangles_capacity = 0;
+
+/* The vertices of the instance being updated in camera and clip space, transformed once per frame and shared by the faces */
+static transformed_vertices_t transformed_vertices = { 0 };
+
+mat4_t projection_matrix;
+mat4_t view_matrix;
+
+/* Function to create the render target and everything the pipeline needs to draw into it, with depth stored in a format,
+   reversed_depth stores -1/w instead of 1 - 1/w in the float format */
+bool pipeline_init(int width, int height, enum depth_format format, bool reversed_depth)
+{
+	/* Allocate the color buffer of the render target */
+	if (!render_target_init(width, height))
+	{
+		return false;
+	}
+
+	/* Split the render target into tiles and start one rasterizer thread per CPU core */
+	if (!tiles_init(0))
+	{
+		return false;
+	}
+
+	/* Track the tiles every frame draws into, so clears and uploads can skip the others.
+	   Everything starts out dirty, so the clears of the first frame cover the whole target. */
+	if (!dirty_init())
+	{
+		return false;
+	}
+
+	/* DEPTH_UNORM24 and DEPTH_UNORM16 trade precision for memory traffic against 32 bit floats,
+	   reversed-Z stores -1/w so distant surfaces keep more float precision */
+	if (!depth_init(format, reversed_depth))
+	{
+		return false;
+	}
+
+	/* Keep the farthest depth of every 8x8 and 64x64 block to reject hidden triangles early */
+	if (!hiz_init())
+	{
+		return false;
+	}
+
+	/* Triangle ids of the deferred texturing mode */
+	if (!visibility_init())
+	{
+		return false;
+	}
+
+	/* Pick the widest pixel and vertex kernels this CPU can run, for the depth format */
+	rasterizer_select_isa(rasterizer_detect_isa());
+	vertex_select_isa(rasterizer_detect_isa());
+
+	// Initialize the perspective projection matrix
+	float fov = M_PI / 3.0f;  // 60 degrees or 180/3 degrees
+	float aspect = (float)render_target.height / (float)render_target.width;
+	float near = 1.0f;
+	float far = 20.f;
+	projection_matrix = mat4_make_perspective(fov, aspect, near, far);
+
+	return true;
+}
+
+/* Divides a clip-space position by w and maps it onto the render target, keeping w for the perspective correct interpolation */
+static vec4_t project_to_screen(vec4_t point)
+{
+	// Perform perspective division
+	if (point.w != 0)
+	{
+		point.x /= point.w;
+		point.y /= point.w;
+		point.z /= point.w;
+	}
+
+	/* Invert the y-axis to have the origin on the top-left corner */
+	point.y *= -1;
+
+	// Scale into the view
+	point.x *= 0.5f * render_target.width;
+	point.y *= 0.5f * render_target.height;
+
+	/* Translate the projected points to the middle of the screen */
+	point.x += 0.5f * render_target.width;
+	point.y += 0.5f * render_target.height;
+	return point;
+}
+
+/* The wireframe is only collected in the render modes drawing it */
+static bool render_mode_draws_wireframe(void)
+{
+	return render_mode == RENDER_WIRE || render_mode == RENDER_FILL_WIRE || render_mode == RENDER_WIRE_VERTEX || render_mode == RENDER_TEXTURED_WIRE;
+}
+
+/* Takes the next slot of the triangles to render, growing the array when it is full, returns NULL if it cannot grow */
+static triangle_t* next_triangle_to_render(void)
+{
+	if (num_triangles_to_render == triangles_to_render_capacity)
+	{
+		int capacity = (triangles_to_render_capacity > 0) ? triangles_to_render_capacity * 2 : 16384;
+		triangle_t* grown = (triangle_t*)realloc(triangles_to_render, sizeof(triangle_t) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the triangles to render.\n");
+			return NULL;
+		}
+		triangles_to_render = grown;
+		triangles_to_render_capacity = capacity;
+	}
+	return &triangles_to_render[num_triangles_to_render++];
+}
+
+/* Radius of the bounding sphere of a mesh on screen in pixels, unbounded when the camera is inside the sphere */
+static float projected_radius(const bounds_t* bounds, const mat4_t* world_view_matrix)
+{
+	vec4_t center = mat4_mul_vec4(*world_view_matrix, (vec4_t){ bounds->center.x, bounds->center.y, bounds->center.z, 1.0f });
+
+	// The sphere grows with the largest scale of the matrix
+	float scale = 0.0f;
+	for (int column = 0; column < 3; column++)
+	{
+		const float (*m)[4] = world_view_matrix->m;
+		scale = fmaxf(scale, sqrtf(m[0][column] * m[0][column] + m[1][column] * m[1][column] + m[2][column] * m[2][column]));
+	}
+	float radius = bounds->radius * scale;
+	if (center.z <= radius)
+	{
+		return FLT_MAX;
+	}
+	return radius * projection_matrix.m[1][1] * 0.5f * (float)render_target.height / center.z;
+}
+
+/* Transforms, culls, clips and projects one instance into the triangles to render, returns the time its last stage ended.
+   The visibility is the one of its world box, an instance whose box is inside the frustum needs no test of its own */
+static uint64_t update_instance(scene_instance_t* instance, enum frustum_visibility visibility, uint64_t stage_start)
+{
+	const scene_asset_t* asset = &scene.assets[instance->asset];
+	const bounds_t* bounds = &asset->lods[0].mesh.bounds;
+
+	// Create a World matrix to apply scale, rotation, and translation to the mesh
+	mat4_t world_matrix = scene_instance_world_matrix(instance);
+
+	// Combine the world and view matrices, so every vertex goes from model space to camera space with one multiplication
+	mat4_t world_view_matrix = mat4_mul_mat4(view_matrix, world_matrix);
+
+	/* Test the tighter model-space bounds of the mesh when the world box crosses the frustum, skip every face of an instance outside it and the clipping of an instance inside it */
+	if (visibility != FRUSTUM_INSIDE)
+	{
+		mat4_t world_view_projection_matrix = mat4_mul_mat4(projection_matrix, world_view_matrix);
+		frustum_t frustum = frustum_from_matrix(&world_view_projection_matrix);
+		visibility = frustum_test_bounds(&frustum, bounds);
+	}
+	if (visibility == FRUSTUM_OUTSIDE)
+	{
+		stats_add_count(COUNTER_INSTANCES_CULLED, 1);
+		return stats_end_stage(STAGE_TRANSFORM, stage_start);
+	}
+
+	/* Draw the coarsest level of detail whose error is still too small to see at the size of the instance on screen */
+	const scene_lod_t* lod = &asset->lods[scene_select_lod(instance, projected_radius(bounds, &world_view_matrix))];
+	const mesh_t* mesh = &lod->mesh;
+
+	int num_faces = array_length(mesh->faces);
+	int num_vertices = mesh->vertices.count;
+	stats_add_count(COUNTER_TRIANGLES_IN, num_faces);
+	if (num_faces > transformed_faces_capacity)
+	{
+		transformed_face_t* grown = (transformed_face_t*)realloc(transformed_faces, sizeof(transformed_face_t) * num_faces * 2);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the transformed faces.\n");
+			return stage_start;
+		}
+		transformed_faces = grown;
+		transformed_faces_capacity = num_faces * 2;
+	}
+	if (!transformed_vertices_reserve(&transformed_vertices, num_vertices))
+	{
+		return stage_start;
+	}
+	bool needs_clipping = (visibility != FRUSTUM_INSIDE);
+	bool draw_wireframe = render_mode_draws_wireframe() && wireframe_begin_instance(&lod->wireframe);
+
+	/* Transform every vertex of the mesh into camera and clip space once, in batches, the faces sharing it index into the result */
+	vertex_transform(&mesh->vertices, &world_view_matrix, &projection_matrix, &transformed_vertices);
+	stage_start = stats_end_stage(STAGE_TRANSFORM, stage_start);
+
+	/* Drop the faces outside the frustum, gather the vertices of the others, compute their normals and keep the faces looking at the camera */
+	const uint8_t* outcodes = transformed_vertices.outcodes;
+	int num_visible_faces = 0;
+	int num_outside_faces = 0;
+	for (int i = 0; i < num_faces; i++)
+	{
+		face_t mesh_face = mesh->faces[i];
+
+		// All three vertices outside the same plane
+		if (needs_clipping && (outcodes[mesh_face.a] & outcodes[mesh_face.b] & outcodes[mesh_face.c]))
+		{
+			num_outside_faces++;
+			continue;
+		}
+
+		int vertex_indices[3] = { mesh_face.a, mesh_face.b, mesh_face.c };
+		vec3_t face_vertices[3];
+		for (int j = 0; j < 3; j++)
+		{
+			int index = vertex_indices[j];
+			face_vertices[j] = (vec3_t){ transformed_vertices.view_x[index], transformed_vertices.view_y[index], transformed_vertices.view_z[index] };
+		}
+
+        /* Check backface culling */
+        vec3_t vector_a = face_vertices[0]; /*   A   */
+        vec3_t vector_b = face_vertices[1]; /*  / \  */
+        vec3_t vector_c = face_vertices[2]; /* C---B */
+
+        /* Get the vector subtraction of B-A and C-A */
+        vec3_t vector_ab = vec3_sub(vector_b, vector_a);
+        vec3_t vector_ac = vec3_sub(vector_c, vector_a);
+        vec3_normalize(&vector_ab);
+        vec3_normalize(&vector_ac);
+
+        /* Compute the face normal (using cross product to find perpendicular) */
+        vec3_t normal = vec3_cross(vector_ab, vector_ac);
+        vec3_normalize(&normal);
+
+        /* Find the vector between vertex A in the triangle and the camera origin */
+		vec3_t origin = { 0, 0, 0 };
+        vec3_t camera_ray = vec3_sub(origin, vector_a);
+
+        /* Calculate how aligned the camera ray is with the face normal (using dot product) */
+        float dot_normal_camera = vec3_dot(normal, camera_ray);
+
+        if (culling_mode == CULLING_BACKFACE)
+        {
+            /* Bypass the triangles that are looking away from the camera */
+            if (dot_normal_camera < 0)
+            {
+                continue;
+            }
+        }
+
+		transformed_face_t* transformed = &transformed_faces[num_visible_faces];
+		transformed->normal = normal;
+		transformed->face_index = i;
+		transformed->outcodes = needs_clipping ? (outcodes[mesh_face.a] | outcodes[mesh_face.b] | outcodes[mesh_face.c]) : 0;
+		num_visible_faces++;
+	}
+	stats_add_count(COUNTER_TRIANGLES_CULLED, num_faces - num_outside_faces - num_visible_faces);
+	stage_start = stats_end_stage(STAGE_CULL, stage_start);
+
+	/* Clip the faces crossing a frustum plane in homogeneous space into fans of triangles, the faces outside one were dropped before culling */
+	int num_clipped_faces = num_outside_faces;
+	int num_clipped_triangles = 0;
+	for (int i = 0; i < num_visible_faces; i++)
+	{
+		const transformed_face_t* transformed = &transformed_faces[i];
+		face_t mesh_face = mesh->faces[transformed->face_index];
+		int vertex_indices[3] = { mesh_face.a, mesh_face.b, mesh_face.c };
+		tex2_t face_uvs[3] = { mesh_face.a_uv, mesh_face.b_uv, mesh_face.c_uv };
+
+		clip_vertex_t corners[3];
+		for (int j = 0; j < 3; j++)
+		{
+			int index = vertex_indices[j];
+			corners[j].position = (vec4_t){ transformed_vertices.clip_x[index], transformed_vertices.clip_y[index], transformed_vertices.clip_z[index], transformed_vertices.clip_w[index] };
+			corners[j].uv = face_uvs[j];
+		}
+
+		// Faces crossing only the sides of the screen, and not beyond the guard band, are left to the scissor of the rasterizer
+		uint8_t planes = 0;
+		if (transformed->outcodes != 0)
+		{
+			num_clipped_faces++;
+			planes = clip_planes_outside(corners[0].position) | clip_planes_outside(corners[1].position) | clip_planes_outside(corners[2].position);
+		}
+
+		// A fan of a polygon clipped against every plane has at most MAX_NUM_POLY_VERTICES - 2 triangles
+		if (num_clipped_triangles + MAX_NUM_POLY_VERTICES > clipped_triangles_capacity)
+		{
+			int capacity = (clipped_triangles_capacity > 0) ? clipped_triangles_capacity * 2 : num_visible_faces + MAX_NUM_POLY_VERTICES;
+			clipped_triangle_t* grown = (clipped_triangle_t*)realloc(clipped_triangles, sizeof(clipped_triangle_t) * capacity);
+			if (!grown)
+			{
+				fprintf(stderr, "Error allocating the clipped triangles.\n");
+				break;
+			}
+			clipped_triangles = grown;
+			clipped_triangles_capacity = capacity;
+		}
+
+		if (planes == 0)
+		{
+			clipped_triangle_t* triangle = &clipped_triangles[num_clipped_triangles++];
+			for (int j = 0; j < 3; j++)
+			{
+				triangle->points[j] = corners[j].position;
+				triangle->texcoords[j] = corners[j].uv;
+			}
+			triangle->visible_face = i;
+			triangle->fan_index = 0;
+			triangle->clipped = false;
+			continue;
+		}
+
+		/* Create a polygon from the original transformed triangle to be clipped */
+		polygon_t polygon = create_polygon_from_triangle(corners[0], corners[1], corners[2]);
+
+		// Clip the polygon against the planes its vertices lie outside of
+		clip_polygon(&polygon, planes);
+
+		/* Break the clipped polygon up into a fan of triangles around its first vertex */
+		for (int k = 0; k < polygon.num_vertices - 2; k++)
+		{
+			const clip_vertex_t* fan[3] = { &polygon.vertices[0], &polygon.vertices[k + 1], &polygon.vertices[k + 2] };
+			clipped_triangle_t* triangle = &clipped_triangles[num_clipped_triangles++];
+			for (int j = 0; j < 3; j++)
+			{
+				triangle->points[j] = fan[j]->position;
+				triangle->texcoords[j] = fan[j]->uv;
+			}
+			triangle->visible_face = i;
+			triangle->fan_index = k;
+			triangle->clipped = true;
+		}
+	}
+	stats_add_count(COUNTER_TRIANGLES_CLIPPED, num_clipped_faces);
+	stage_start = stats_end_stage(STAGE_CLIP, stage_start);
+
+	/* Project, light and pick the mipmap level of the clipped triangles into the triangles to render */
+	for (int i = 0; i < num_clipped_triangles; i++)
+	{
+		const clipped_triangle_t* clipped = &clipped_triangles[i];
+		const transformed_face_t* transformed = &transformed_faces[clipped->visible_face];
+		face_t mesh_face = mesh->faces[transformed->face_index];
+		vec3_t normal = transformed->normal;
+
+		vec4_t projected_points[3];
+
+        /* Loop all three vertices to perform projection */
+        for (int j = 0; j < 3; j++)
+        {
+            projected_points[j] = project_to_screen(clipped->points[j]);
+        }
+
+		/* Mark the edges and vertices of the face for the wireframe, once per face, with its own corners even when it was clipped */
+		if (draw_wireframe && clipped->fan_index == 0)
+		{
+			if (clipped->clipped)
+			{
+				int vertex_indices[3] = { mesh_face.a, mesh_face.b, mesh_face.c };
+				vec4_t corner_points[3];
+				for (int j = 0; j < 3; j++)
+				{
+					int index = vertex_indices[j];
+					corner_points[j] = project_to_screen((vec4_t){ transformed_vertices.clip_x[index], transformed_vertices.clip_y[index], transformed_vertices.clip_z[index], transformed_vertices.clip_w[index] });
+				}
+				wireframe_add_face(transformed->face_index, corner_points);
+			}
+			else
+			{
+				wireframe_add_face(transformed->face_index, projected_points);
+			}
+		}
+
+		// Calculate the shade intensity based on how alligned the normal is with the inverse of the light direction
+		float light_intensity_factor = -vec3_dot(normal, light.direction);
+		
+		// Calculate the triangle color based on the light direction
+		uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);
+
+		// Pick the mipmap level from how many texels the triangle maps onto each of its pixels
+		const tex2_t* uvs = clipped->texcoords;
+		float uv_area = fabsf((uvs[1].u - uvs[0].u) * (uvs[2].v - uvs[0].v) - (uvs[2].u - uvs[0].u) * (uvs[1].v - uvs[0].v));
+		float screen_area = fabsf((projected_points[1].x - projected_points[0].x) * (projected_points[2].y - projected_points[0].y) -
+			(projected_points[2].x - projected_points[0].x) * (projected_points[1].y - projected_points[0].y));
+
+        triangle_t projected_triangle = {
+            .points = {
+                { projected_points[0].x, projected_points[0].y, projected_points[0].z, projected_points[0].w },
+				{ projected_points[1].x, projected_points[1].y, projected_points[1].z, projected_points[1].w },
+				{ projected_points[2].x, projected_points[2].y, projected_points[2].z, projected_points[2].w },
+			},
+            .texcoords = { { uvs[0].u, uvs[0].v },
+                           { uvs[1].u, uvs[1].v },
+                           { uvs[2].u, uvs[2].v }
+            },
+			.color = triangle_color,
+			.light_intensity = light_intensity_factor,
+			.texture = &asset->texture.levels[texture_select_level(&asset->texture, uv_area, screen_area)]
+        };
+
+        /* Save the projected triangle in the array of triangles to render */
+		triangle_t* slot = next_triangle_to_render();
+		if (!slot)
+		{
+			break;
+		}
+		*slot = projected_triangle;
+    }
+	if (draw_wireframe)
+	{
+		wireframe_end_instance();
+	}
+	return stats_end_stage(STAGE_PROJECT, stage_start);
+}
+
+/* Function to transform, light and project every instance of the scene into the triangles of the next frame */
+void pipeline_update(void)
+{
+	stats_begin_frame();
+	uint64_t stage_start = stats_now();
+
+    /* Initialize the array of triangles to render */
+	num_triangles_to_render = 0;
+	wireframe_begin_frame();
+
+	// Create view matrix
+	vec3_t up_direction = { 0.f, 1.f, 0.f };
+
+	// Initialize the target vector to be looking down the positive z-axis
+    vec3_t target = { 0, 0, 1.0f };
+	mat4_t camera_yaw_rotation = mat4_make_rotation_y(camera.yaw);
+	camera.direction = vec3_from_vec4(mat4_mul_vec4(camera_yaw_rotation, vec4_from_vec3(target)));
+
+	// Offset the target to be relative to the camera's current position
+	target = vec3_add(camera.position, camera.direction);
+
+	view_matrix = mat4_look_at(camera.position, target, up_direction);
+
+	/* Find the instances whose world boxes reach into the frustum, the others are never looked at */
+	mat4_t view_projection_matrix = mat4_mul_mat4(projection_matrix, view_matrix);
+	frustum_t frustum = frustum_from_matrix(&view_projection_matrix);
+	if (!bvh_update())
+	{
+		// Without a tree every instance is tested on its own
+		for (int i = 0; i < scene.num_instances; i++)
+		{
+			stage_start = update_instance(&scene.instances[i], FRUSTUM_INTERSECTING, stage_start);
+		}
+		return;
+	}
+	const bvh_hit_t* hits;
+	int num_hits = bvh_query_frustum(&frustum, &hits);
+	stats_add_count(COUNTER_INSTANCES_CULLED, scene.num_instances - num_hits);
+
+	/* The instances share the view matrix and the per-frame scratch arrays, each one runs through every stage in turn */
+	for (int i = 0; i < num_hits; i++)
+	{
+		stage_start = update_instance(&scene.instances[hits[i].instance], hits[i].visibility, stage_start);
+	}
+}
+
+/* Function to draw the triangles of the frame into the render target */
+void pipeline_render(void)
+{
+	uint64_t stage_start = stats_now();
+
+	/* Start from the background, only the tiles the last frame drew into are cleared */
+    clear_color_buffer(0xFF000000);
+	clear_depth_buffer();
+	stage_start = stats_end_stage(STAGE_CLEAR, stage_start);
+
+    draw_grid();
+
+	/* Rasterize the filled and textured triangles in parallel, one screen tile per thread at a time */
+	if (render_mode == RENDER_FILL || render_mode == RENDER_FILL_WIRE)
+	{
+		tiles_render_triangles(triangles_to_render, num_triangles_to_render, TILE_SHADE_FLAT);
+	}
+
+	if (render_mode == RENDER_TEXTURED || render_mode == RENDER_TEXTURED_WIRE)
+	{
+		tiles_render_triangles(triangles_to_render, num_triangles_to_render, TILE_SHADE_TEXTURED);
+	}
+
+	/* Rasterize ids and depth only, then texture and light each visible pixel once */
+	if (render_mode == RENDER_VISIBILITY)
+	{
+		visibility_render(triangles_to_render, num_triangles_to_render);
+	}
+
+	/* Draw every visible edge and vertex once on top */
+	if (render_mode_draws_wireframe())
+	{
+		wireframe_render(0xFFFFFFFF, render_mode == RENDER_WIRE_VERTEX, 0xFFFF0000);
+	}
+	stats_end_stage(STAGE_RASTER, stage_start);
+}
+
+/* Function to stop the rasterizer threads and free the render target */
+void pipeline_destroy(void)
+{
+	tiles_destroy();
+	hiz_destroy();
+	visibility_destroy();
+	dirty_destroy();
+	depth_destroy();
+	render_target_destroy();
+
+	free(transformed_faces);
+	transformed_faces = NULL;
+	transformed_faces_capacity = 0;
+	transformed_vertices_destroy(&transformed_vertices);
+	free(clipped_triangles);
+	clipped_triangles = NULL;
+	clipped_triangles_capacity = 0;
+	free(triangles_to_render);
+	triangles_to_render = NULL;
+	triangles_to_render_capacity = 0;
+	num_triangles_to_render = 0;
+	wireframe_destroy();
+	bvh_destroy();
+}
@@ -0,0 +1,483 @@
+#include <stdlib.h>
+#include <math.h>
+#include <SDL.h>
+#include "rasterizer.h"
+#include "texture.h"
+
+/* Kernels used by the triangle draw functions */
+fill_kernel_t fill_triangle_kernel = NULL;
+const texture_kernel_t* texture_triangle_kernels = NULL;
+
+const char* const raster_isa_names[RASTER_ISA_COUNT] = { "scalar", "sse2", "avx2" };
+
+/* Rounds a screen coordinate to the nearest sub-pixel step */
+static int64_t snap_to_subpixel(float coordinate)
+{
+	return (int64_t)floorf(coordinate * SUBPIXEL_ONE + 0.5f);
+}
+
+/* Rounds a sub-pixel coordinate down to whole pixels */
+static int64_t subpixel_floor(int64_t coordinate)
+{
+	return (coordinate >= 0) ? coordinate / SUBPIXEL_ONE : -((-coordinate + SUBPIXEL_ONE - 1) / SUBPIXEL_ONE);
+}
+
+/* Function to snap triangle ABC to the sub-pixel grid and set up its edge equations, returns false if no pixel is covered */
+bool setup_triangle_edges(triangle_edges_t* edges, vec4_t a, vec4_t b, vec4_t c, rect_t clip)
+{
+	vec4_t vertices[3] = { a, b, c };
+	int64_t x[3];
+	int64_t y[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		// The negated test also rejects NaN coordinates
+		if (!(fabsf(vertices[i].x) <= MAX_RASTER_COORDINATE && fabsf(vertices[i].y) <= MAX_RASTER_COORDINATE))
+		{
+			return false;
+		}
+		x[i] = snap_to_subpixel(vertices[i].x);
+		y[i] = snap_to_subpixel(vertices[i].y);
+	}
+
+	int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (area == 0)
+	{
+		return false;
+	}
+
+	// Pixels are sampled at their centers, find the ones inside the sub-pixel bounding box
+	int64_t min_sx = (x[0] < x[1]) ? ((x[0] < x[2]) ? x[0] : x[2]) : ((x[1] < x[2]) ? x[1] : x[2]);
+	int64_t min_sy = (y[0] < y[1]) ? ((y[0] < y[2]) ? y[0] : y[2]) : ((y[1] < y[2]) ? y[1] : y[2]);
+	int64_t max_sx = (x[0] > x[1]) ? ((x[0] > x[2]) ? x[0] : x[2]) : ((x[1] > x[2]) ? x[1] : x[2]);
+	int64_t max_sy = (y[0] > y[1]) ? ((y[0] > y[2]) ? y[0] : y[2]) : ((y[1] > y[2]) ? y[1] : y[2]);
+
+	int64_t min_x = -subpixel_floor(SUBPIXEL_ONE / 2 - min_sx);
+	int64_t min_y = -subpixel_floor(SUBPIXEL_ONE / 2 - min_sy);
+	int64_t max_x = subpixel_floor(max_sx - SUBPIXEL_ONE / 2);
+	int64_t max_y = subpixel_floor(max_sy - SUBPIXEL_ONE / 2);
+
+	// Clip the bounding box against the clip rectangle
+	edges->min_x = (int)((min_x > clip.min_x) ? min_x : clip.min_x);
+	edges->min_y = (int)((min_y > clip.min_y) ? min_y : clip.min_y);
+	edges->max_x = (int)((max_x < clip.max_x) ? max_x : clip.max_x);
+	edges->max_y = (int)((max_y < clip.max_y) ? max_y : clip.max_y);
+	edges->clip_max_x = clip.max_x;
+
+	if (edges->min_x > edges->max_x || edges->min_y > edges->max_y)
+	{
+		return false;
+	}
+
+	// Flip the edges of clockwise triangles so the inside is always positive
+	int64_t orientation = (area > 0) ? 1 : -1;
+	double inv_area = 1.0 / (double)(area * orientation);
+
+	int64_t origin_x = (int64_t)edges->min_x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+	int64_t origin_y = (int64_t)edges->min_y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+
+	// The SIMD kernels also evaluate a few lanes past the right end of the box
+	int64_t span_x = (int64_t)edges->max_x - edges->min_x + 16;
+	int64_t span_y = (int64_t)edges->max_y - edges->min_y;
+	edges->fits_32bit = true;
+
+	for (int i = 0; i < 3; i++)
+	{
+		// Edge i is the one opposite to vertex i, so its value is the (unnormalized) barycentric weight of that vertex
+		int from = (i + 1) % 3;
+		int to = (i + 2) % 3;
+
+		// E(x, y) = (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x)
+		int64_t step_x = orientation * (y[from] - y[to]);
+		int64_t step_y = orientation * (x[to] - x[from]);
+		int64_t origin = step_x * (origin_x - x[from]) + step_y * (origin_y - y[from]);
+
+		edges->edge_dx[i] = step_x * SUBPIXEL_ONE;
+		edges->edge_dy[i] = step_y * SUBPIXEL_ONE;
+		edges->edge_dx_reciprocal[i] = (step_x != 0) ? 1.0 / (double)edges->edge_dx[i] : 0.0;
+
+		edges->weight_origin[i] = (float)(origin * inv_area);
+		edges->weight_dx[i] = (float)(edges->edge_dx[i] * inv_area);
+		edges->weight_dy[i] = (float)(edges->edge_dy[i] * inv_area);
+
+		// Top-left fill rule: a pixel exactly on an edge only belongs to this triangle if the edge is a left edge,
+		// with the inside to its right, or a top edge, horizontal with the inside below it
+		bool top_left = (step_x > 0) || (step_x == 0 && step_y > 0);
+		edges->edge_origin[i] = top_left ? origin : origin - 1;
+
+		// The edge function is linear, so its extremes over the box are at the corners
+		for (int corner = 0; corner < 4; corner++)
+		{
+			int64_t value = edges->edge_origin[i] +
+				((corner & 1) ? edges->edge_dx[i] * span_x : 0) +
+				((corner & 2) ? edges->edge_dy[i] * span_y : 0);
+			if (value >= (INT64_C(1) << 30) || value <= -(INT64_C(1) << 30))
+			{
+				edges->fits_32bit = false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Function to compute the screen-space gradients of an attribute with values f0, f1 and f2 at the vertices */
+attribute_plane_t setup_attribute_plane(const triangle_edges_t* edges, float f0, float f1, float f2)
+{
+	attribute_plane_t plane = {
+		.origin = edges->weight_origin[0] * f0 + edges->weight_origin[1] * f1 + edges->weight_origin[2] * f2,
+		.dx = edges->weight_dx[0] * f0 + edges->weight_dx[1] * f1 + edges->weight_dx[2] * f2,
+		.dy = edges->weight_dy[0] * f0 + edges->weight_dy[1] * f1 + edges->weight_dy[2] * f2
+	};
+	return plane;
+}
+
+/* Function to narrow set up edges to the part of their bounding box inside rect, returns false if nothing is left */
+bool narrow_triangle_edges(const triangle_edges_t* edges, rect_t rect, triangle_edges_t* narrowed)
+{
+	*narrowed = *edges;
+	narrowed->min_x = (rect.min_x > edges->min_x) ? rect.min_x : edges->min_x;
+	narrowed->min_y = (rect.min_y > edges->min_y) ? rect.min_y : edges->min_y;
+	narrowed->max_x = (rect.max_x < edges->max_x) ? rect.max_x : edges->max_x;
+	narrowed->max_y = (rect.max_y < edges->max_y) ? rect.max_y : edges->max_y;
+
+	if (narrowed->min_x > narrowed->max_x || narrowed->min_y > narrowed->max_y)
+	{
+		return false;
+	}
+
+	int offset_x = narrowed->min_x - edges->min_x;
+	int offset_y = narrowed->min_y - edges->min_y;
+	for (int i = 0; i < 3; i++)
+	{
+		narrowed->edge_origin[i] += edges->edge_dx[i] * offset_x + edges->edge_dy[i] * offset_y;
+		narrowed->weight_origin[i] += edges->weight_dx[i] * offset_x + edges->weight_dy[i] * offset_y;
+	}
+
+	return true;
+}
+
+/* Function to move the origin of an attribute plane along with edges narrowed by narrow_triangle_edges */
+attribute_plane_t narrow_attribute_plane(const triangle_edges_t* edges, const triangle_edges_t* narrowed, const attribute_plane_t* plane)
+{
+	attribute_plane_t moved = *plane;
+	moved.origin += plane->dx * (narrowed->min_x - edges->min_x) + plane->dy * (narrowed->min_y - edges->min_y);
+	return moved;
+}
+
+/* Function to find the widest instruction set supported by both the build and the CPU */
+enum raster_isa rasterizer_detect_isa(void)
+{
+#ifdef RASTERIZER_X86
+	if (SDL_HasAVX2())
+	{
+		return RASTER_ISA_AVX2;
+	}
+	if (SDL_HasSSE2())
+	{
+		return RASTER_ISA_SSE2;
+	}
+#endif
+	return RASTER_ISA_SCALAR;
+}
+
+/* Function to switch the pixel kernels to the ones for the depth format, falls back to narrower ones the CPU cannot run.
+   Call it again after depth_init changes the format. */
+enum raster_isa rasterizer_select_isa(enum raster_isa isa)
+{
+	enum raster_isa supported = rasterizer_detect_isa();
+	if (isa > supported)
+	{
+		isa = supported;
+	}
+
+	switch (isa)
+	{
+#ifdef RASTERIZER_X86
+	case RASTER_ISA_AVX2:
+		fill_triangle_kernel = fill_triangle_avx2[depth_format];
+		texture_triangle_kernels = texture_triangle_avx2[depth_format];
+		break;
+	case RASTER_ISA_SSE2:
+		fill_triangle_kernel = fill_triangle_sse2[depth_format];
+		texture_triangle_kernels = texture_triangle_sse2[depth_format];
+		break;
+#endif
+	default:
+		isa = RASTER_ISA_SCALAR;
+		fill_triangle_kernel = fill_triangle_scalar[depth_format];
+		texture_triangle_kernels = texture_triangle_scalar[depth_format];
+		break;
+	}
+
+	return isa;
+}
+
+/* Function to find the covered pixels [*start, *end] of a row from its edge function values at min_x, returns false if there are none */
+bool triangle_row_span(const triangle_edges_t* edges, const int64_t edge_row[3], int* start, int* end)
+{
+	int64_t width = (int64_t)edges->max_x - edges->min_x;
+	int64_t first = 0;
+	int64_t last = width;
+
+	// Every edge function is linear along the row, so the pixels where it is not negative form a half line.
+	// Its end is estimated with the reciprocal of the step, then corrected exactly with the integer edge function,
+	// so the truncated estimate is good enough and needs no rounding call.
+	for (int i = 0; i < 3; i++)
+	{
+		int64_t value = edge_row[i];
+		int64_t step = edges->edge_dx[i];
+
+		if (step > 0)
+		{
+			if (value >= 0)
+			{
+				continue;
+			}
+			double estimate = -(double)value * edges->edge_dx_reciprocal[i];
+			if (estimate > (double)(width + 1))
+			{
+				return false;
+			}
+			int64_t enter = (int64_t)estimate;
+			while (value + step * enter < 0) enter++;
+			while (enter > 0 && value + step * (enter - 1) >= 0) enter--;
+			first = (enter > first) ? enter : first;
+		}
+		else if (step < 0)
+		{
+			if (value < 0)
+			{
+				return false;
+			}
+			double estimate = -(double)value * edges->edge_dx_reciprocal[i];
+			int64_t leave = (estimate < (double)width) ? (int64_t)estimate : width;
+			while (leave >= 0 && value + step * leave < 0) leave--;
+			while (leave < width && value + step * (leave + 1) >= 0) leave++;
+			last = (leave < last) ? leave : last;
+		}
+		else if (value < 0)
+		{
+			return false;
+		}
+	}
+
+	if (first > last)
+	{
+		return false;
+	}
+
+	*start = edges->min_x + (int)first;
+	*end = edges->min_x + (int)last;
+	return true;
+}
+
+/* Covers a narrow triangle with per-pixel edge tests, only 1/w is needed for the depth test */
+DEPTH_INLINE void fill_narrow_triangle_scalar(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	const float far = depth_far;
+	uint32_t tested = 0;
+	uint32_t written = 0;
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		int64_t e0 = edge_row[0];
+		int64_t e1 = edge_row[1];
+		int64_t e2 = edge_row[2];
+		float interpolated_reciprocal_w = reciprocal_w_row;
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		for (int x = edges->min_x; x <= edges->max_x; x++)
+		{
+			// The pixel is covered when no edge function is negative, so none of their sign bits is set
+			if ((e0 | e1 | e2) >= 0)
+			{
+				was_inside = true;
+				tested++;
+
+				// Adjust the 1/w so the pixels that are closer to the camera have a smaller value
+				if (depth_test_pixel(depth_values, x, far - interpolated_reciprocal_w, format))
+				{
+					color_row[x] = color;
+					written++;
+				}
+			}
+			else if (was_inside)
+			{
+				// A triangle is convex, once we leave it there is nothing else on this row
+				break;
+			}
+
+			e0 += edges->edge_dx[0];
+			e1 += edges->edge_dx[1];
+			e2 += edges->edge_dx[2];
+			interpolated_reciprocal_w += reciprocal_w->dx;
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += tested;
+	counts->written += written;
+}
+
+/* Scalar kernel of flat colored triangles, walks the covered span of every row with only the depth test left per pixel */
+DEPTH_INLINE void fill_triangle_scalar_body(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	if (edges->max_x - edges->min_x < SPAN_MIN_WIDTH)
+	{
+		fill_narrow_triangle_scalar(edges, reciprocal_w, color, counts, format);
+		return;
+	}
+
+	const float far = depth_far;
+	uint32_t tested = 0;
+	uint32_t written = 0;
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		int start, end;
+		if (triangle_row_span(edges, edge_row, &start, &end))
+		{
+			uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+			void* depth_values = depth_row(y, format);
+
+			// Adjust the 1/w so the pixels that are closer to the camera have a smaller value
+			float depth_start = far - (reciprocal_w_row + reciprocal_w->dx * (start - edges->min_x));
+			tested += end - start + 1;
+
+			if (format == DEPTH_FLOAT32)
+			{
+				// Branchless so the compiler can vectorize it, the whole span belongs to this triangle's clip rectangle
+				float* float_row = (float*)depth_values;
+				for (int x = start; x <= end; x++)
+				{
+					float depth = depth_start - reciprocal_w->dx * (x - start);
+					bool closer = depth < float_row[x];
+					float_row[x] = closer ? depth : float_row[x];
+					color_row[x] = closer ? color : color_row[x];
+					written += closer;
+				}
+			}
+			else
+			{
+				for (int x = start; x <= end; x++)
+				{
+					if (depth_test_pixel(depth_values, x, depth_start - reciprocal_w->dx * (x - start), format))
+					{
+						color_row[x] = color;
+						written++;
+					}
+				}
+			}
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += tested;
+	counts->written += written;
+}
+
+/* Scalar kernel of perspective correct textured triangles */
+DEPTH_INLINE void texture_triangle_scalar_body(
+	const triangle_edges_t* edges,
+	const attribute_plane_t* reciprocal_w,
+	const attribute_plane_t* u_over_w,
+	const attribute_plane_t* v_over_w,
+	const texture_level_t* texture,
+	pixel_counts_t* counts,
+	enum depth_format format,
+	enum texture_wrap wrap)
+{
+	const float far = depth_far;
+	uint32_t tested = 0;
+	uint32_t written = 0;
+	// A local copy, stores to the color buffer could alias the level and reload its fields for every pixel
+	const texture_level_t level = *texture;
+	const int tex_width = level.width;
+	const int tex_height = level.height;
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	float u_over_w_row = u_over_w->origin;
+	float v_over_w_row = v_over_w->origin;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		int64_t e0 = edge_row[0];
+		int64_t e1 = edge_row[1];
+		int64_t e2 = edge_row[2];
+		float interpolated_reciprocal_w = reciprocal_w_row;
+		float interpolated_u = u_over_w_row;
+		float interpolated_v = v_over_w_row;
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		for (int x = edges->min_x; x <= edges->max_x; x++)
+		{
+			// The pixel is covered when no edge function is negative, so none of their sign bits is set
+			if ((e0 | e1 | e2) >= 0)
+			{
+				was_inside = true;
+				tested++;
+
+				// Test the depth first so hidden pixels never pay for the texture lookup
+				if (depth_test_pixel(depth_values, x, far - interpolated_reciprocal_w, format))
+				{
+					// Divide the interpolated u and v by the interpolated reciprocal w, one divide for both
+					float w = 1.0f / interpolated_reciprocal_w;
+					float u = interpolated_u * w;
+					float v = interpolated_v * w;
+
+					// Maps the u and v coordinates to the texture space (width and height)
+					int tex_x = texture_wrap_coordinate((int)(u * tex_width), tex_width, wrap);
+					int tex_y = texture_wrap_coordinate((int)(v * tex_height), tex_height, wrap);
+
+					color_row[x] = level.texels[texel_index(&level, tex_x, tex_y)];
+					written++;
+				}
+			}
+			else if (was_inside)
+			{
+				break;
+			}
+
+			e0 += edges->edge_dx[0];
+			e1 += edges->edge_dx[1];
+			e2 += edges->edge_dx[2];
+			interpolated_reciprocal_w += reciprocal_w->dx;
+			interpolated_u += u_over_w->dx;
+			interpolated_v += v_over_w->dx;
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+		u_over_w_row += u_over_w->dy;
+		v_over_w_row += v_over_w->dy;
+	}
+
+	counts->tested += tested;
+	counts->written += written;
+}
+
+DEFINE_FILL_KERNELS(fill_triangle_scalar, fill_triangle_scalar_body);
+DEFINE_TEXTURE_KERNELS(texture_triangle_scalar, texture_triangle_scalar_body);
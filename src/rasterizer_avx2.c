@@ -0,0 +1,384 @@
+#include "rasterizer.h"
+
+#ifdef RASTERIZER_X86
+
+#include <immintrin.h>
+#include "texture.h"
+
+/* Lanes of a group that still lie inside the bounding box, so the row tail needs no scalar loop */
+static __m256i lanes_in_range(int x, int max_x)
+{
+	const __m256i lane_index = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32(max_x - x + 1), lane_index);
+}
+
+/* Edge function values of 8 consecutive pixels, starting with value, the set up guarantees they fit 32 bits */
+static __m256i edge_lanes_avx2(int64_t value, int64_t step)
+{
+	const __m256i lane_index = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	return _mm256_add_epi32(_mm256_set1_epi32((int32_t)value), _mm256_mullo_epi32(lane_index, _mm256_set1_epi32((int32_t)step)));
+}
+
+/* Sum of the 8 lanes of a counter, lanes count a pixel by subtracting the all ones mask of its lane */
+static uint32_t lane_sum_avx2(__m256i lanes)
+{
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+/* Integer modulo of the texel coordinates through a float reciprocal, the hot loop has no integer divide */
+static __m256i wrap_texel_avx2(__m256i coord, __m256i size, __m256 inv_size)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	__m256 quotient = _mm256_floor_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(coord), inv_size));
+	__m256i wrapped = _mm256_sub_epi32(coord, _mm256_mullo_epi32(_mm256_cvttps_epi32(quotient), size));
+
+	// The float quotient can be off by one next to multiples of the size, fix those lanes up
+	wrapped = _mm256_add_epi32(wrapped, _mm256_and_si256(_mm256_cmpgt_epi32(zero, wrapped), size));
+	wrapped = _mm256_sub_epi32(wrapped, _mm256_andnot_si256(_mm256_cmpgt_epi32(size, wrapped), size));
+
+	// Coordinates too large for a float to hold exactly are only kept inside the texture
+	wrapped = _mm256_max_epi32(wrapped, zero);
+	return _mm256_min_epi32(wrapped, _mm256_sub_epi32(size, _mm256_set1_epi32(1)));
+}
+
+/* Stored depth of 8 pixels from their float depth, as 32 bit lanes: the float bits or the quantized integers */
+DEPTH_INLINE __m256i depth_encode_avx2(__m256 depth, enum depth_format format)
+{
+	if (format == DEPTH_FLOAT32)
+	{
+		return _mm256_castps_si256(depth);
+	}
+
+	// Clamped in the same order as depth_quantize, so NaN ends up on the far plane
+	const __m256 max = _mm256_set1_ps((format == DEPTH_UNORM16) ? (float)DEPTH_UNORM16_MAX : (float)DEPTH_UNORM24_MAX);
+	__m256 scaled = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(depth, max), max), _mm256_setzero_ps());
+	return _mm256_cvttps_epi32(scaled);
+}
+
+/* Stored depth of the 8 pixels at x as 32 bit lanes, only the lanes in owned are read.
+   There are no masked 16 bit loads, groups whole inside the clip rectangle are loaded in one go and the others lane by lane. */
+DEPTH_INLINE __m256i depth_load_avx2(const void* row, int x, __m256i owned, bool whole, enum depth_format format)
+{
+	if (format != DEPTH_UNORM16)
+	{
+		return _mm256_maskload_epi32((const int*)row + x, owned);
+	}
+
+	const uint16_t* pixels = (const uint16_t*)row + x;
+	if (whole)
+	{
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)pixels));
+	}
+
+	int32_t lanes[8];
+	int owned_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(owned));
+	for (int lane = 0; lane < 8; lane++)
+	{
+		lanes[lane] = (owned_lanes & (1 << lane)) ? pixels[lane] : 0;
+	}
+	return _mm256_loadu_si256((const __m256i*)lanes);
+}
+
+/* Lanes where the new depth is closer than the stored one */
+DEPTH_INLINE __m256i depth_closer_avx2(__m256i depth, __m256i old_depth, enum depth_format format)
+{
+	if (format == DEPTH_FLOAT32)
+	{
+		return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(depth), _mm256_castsi256_ps(old_depth), _CMP_LT_OQ));
+	}
+	return _mm256_cmpgt_epi32(old_depth, depth);
+}
+
+/* Writes the depth of the lanes in mask. Groups of 16 bit depth whole inside the clip rectangle are blended
+   with old_depth and written in one go, every lane of them is ours to write. */
+DEPTH_INLINE void depth_store_avx2(void* row, int x, __m256i mask, __m256i depth, __m256i old_depth, bool whole, enum depth_format format)
+{
+	if (format != DEPTH_UNORM16)
+	{
+		_mm256_maskstore_epi32((int*)row + x, mask, depth);
+		return;
+	}
+
+	uint16_t* pixels = (uint16_t*)row + x;
+	if (whole)
+	{
+		__m256i blended = _mm256_blendv_epi8(old_depth, depth, mask);
+		_mm_storeu_si128((__m128i*)pixels, _mm_packus_epi32(_mm256_castsi256_si128(blended), _mm256_extracti128_si256(blended, 1)));
+		return;
+	}
+
+	int32_t lanes[8];
+	int written_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+	_mm256_storeu_si256((__m256i*)lanes, depth);
+	for (int lane = 0; lane < 8; lane++)
+	{
+		if (written_lanes & (1 << lane))
+		{
+			pixels[lane] = (uint16_t)lanes[lane];
+		}
+	}
+}
+
+/* Covers a narrow triangle 8 pixels at a time with the edge functions, cheaper than solving its short rows for their span */
+DEPTH_INLINE void fill_narrow_triangle_avx2(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	const __m256 lane_offsets = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	const __m256i minus_one = _mm256_set1_epi32(-1);
+	const __m256 far8 = _mm256_set1_ps(depth_far);
+	const __m256i color8 = _mm256_set1_epi32((int)color);
+
+	// Increments of the edge functions and 1/w over a whole group of 8 pixels
+	const __m256i e0_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[0] * 8));
+	const __m256i e1_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[1] * 8));
+	const __m256i e2_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[2] * 8));
+	const __m256 reciprocal_w_step = _mm256_set1_ps(reciprocal_w->dx * 8.0f);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	__m256i tested_lanes = _mm256_setzero_si256();
+	__m256i written_lanes = _mm256_setzero_si256();
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		__m256i e0 = edge_lanes_avx2(edge_row[0], edges->edge_dx[0]);
+		__m256i e1 = edge_lanes_avx2(edge_row[1], edges->edge_dx[1]);
+		__m256i e2 = edge_lanes_avx2(edge_row[2], edges->edge_dx[2]);
+		__m256 interpolated_reciprocal_w = _mm256_add_ps(_mm256_set1_ps(reciprocal_w_row), _mm256_mul_ps(lane_offsets, _mm256_set1_ps(reciprocal_w->dx)));
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		for (int x = edges->min_x; x <= edges->max_x; x += 8)
+		{
+			// A lane is covered when none of its edge functions has the sign bit set
+			__m256i inside = _mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(e0, e1), e2), minus_one);
+			__m256i covered = _mm256_and_si256(inside, lanes_in_range(x, edges->max_x));
+			bool whole = (x + 7 <= edges->clip_max_x);
+
+			if (_mm256_movemask_ps(_mm256_castsi256_ps(covered)))
+			{
+				was_inside = true;
+
+				// Masked loads and stores never touch pixels outside the clip rectangle, which may belong to another thread
+				__m256i depth = depth_encode_avx2(_mm256_sub_ps(far8, interpolated_reciprocal_w), format);
+				__m256i old_depth = depth_load_avx2(depth_values, x, covered, whole, format);
+				__m256i mask = _mm256_and_si256(covered, depth_closer_avx2(depth, old_depth, format));
+				tested_lanes = _mm256_sub_epi32(tested_lanes, covered);
+				written_lanes = _mm256_sub_epi32(written_lanes, mask);
+
+				depth_store_avx2(depth_values, x, mask, depth, old_depth, whole, format);
+				_mm256_maskstore_epi32((int*)&color_row[x], mask, color8);
+			}
+			else if (was_inside)
+			{
+				// A triangle is convex, once we leave it there is nothing else on this row
+				break;
+			}
+
+			e0 = _mm256_add_epi32(e0, e0_step);
+			e1 = _mm256_add_epi32(e1, e1_step);
+			e2 = _mm256_add_epi32(e2, e2_step);
+			interpolated_reciprocal_w = _mm256_add_ps(interpolated_reciprocal_w, reciprocal_w_step);
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += lane_sum_avx2(tested_lanes);
+	counts->written += lane_sum_avx2(written_lanes);
+}
+
+/* 8 pixels wide kernel of flat colored triangles, walks the covered span of every row with only the depth test left per pixel */
+DEPTH_INLINE void fill_triangle_avx2_body(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	if (edges->max_x - edges->min_x < SPAN_MIN_WIDTH && edges->fits_32bit)
+	{
+		fill_narrow_triangle_avx2(edges, reciprocal_w, color, counts, format);
+		return;
+	}
+
+	const __m256 lane_offsets = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	const __m256i color8 = _mm256_set1_epi32((int)color);
+	const __m256 depth_dx = _mm256_set1_ps(reciprocal_w->dx);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	__m256i written_lanes = _mm256_setzero_si256();
+	uint32_t tested = 0;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		int start, end;
+		if (triangle_row_span(edges, edge_row, &start, &end))
+		{
+			uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+			void* depth_values = depth_row(y, format);
+			__m256 depth_start = _mm256_set1_ps(depth_far - (reciprocal_w_row + reciprocal_w->dx * (start - edges->min_x)));
+			tested += end - start + 1;
+
+			// Every pixel of the span is covered, only the last group needs masking to stay inside it
+			for (int x = start; x <= end; x += 8)
+			{
+				bool whole = (x + 7 <= edges->clip_max_x);
+				__m256i in_span = lanes_in_range(x, end);
+				__m256 offsets = _mm256_add_ps(_mm256_set1_ps((float)(x - start)), lane_offsets);
+				__m256i depth = depth_encode_avx2(_mm256_sub_ps(depth_start, _mm256_mul_ps(depth_dx, offsets)), format);
+				__m256i old_depth = depth_load_avx2(depth_values, x, in_span, whole, format);
+				__m256i mask = _mm256_and_si256(in_span, depth_closer_avx2(depth, old_depth, format));
+				written_lanes = _mm256_sub_epi32(written_lanes, mask);
+
+				depth_store_avx2(depth_values, x, mask, depth, old_depth, whole, format);
+				_mm256_maskstore_epi32((int*)&color_row[x], mask, color8);
+			}
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += tested;
+	counts->written += lane_sum_avx2(written_lanes);
+}
+
+/* 8 pixels wide kernel of perspective correct textured triangles, texels are gathered in one go */
+DEPTH_INLINE void texture_triangle_avx2_body(
+	const triangle_edges_t* edges,
+	const attribute_plane_t* reciprocal_w,
+	const attribute_plane_t* u_over_w,
+	const attribute_plane_t* v_over_w,
+	const texture_level_t* texture,
+	pixel_counts_t* counts,
+	enum depth_format format,
+	enum texture_wrap wrap)
+{
+	const __m256 lane_offsets = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	const __m256i minus_one = _mm256_set1_epi32(-1);
+	const __m256 far8 = _mm256_set1_ps(depth_far);
+	// A local copy, stores to the color buffer could alias the level and reload its fields for every pixel
+	const texture_level_t level = *texture;
+	const int tex_width = level.width;
+	const int tex_height = level.height;
+	const __m256 tex_width8 = _mm256_set1_ps((float)tex_width);
+	const __m256 tex_height8 = _mm256_set1_ps((float)tex_height);
+	const __m256 inv_tex_width8 = _mm256_set1_ps(1.0f / tex_width);
+	const __m256 inv_tex_height8 = _mm256_set1_ps(1.0f / tex_height);
+	const __m256i tex_width8i = _mm256_set1_epi32(tex_width);
+	const __m256i tex_height8i = _mm256_set1_epi32(tex_height);
+	const __m256i tex_width_mask8 = _mm256_set1_epi32(tex_width - 1);
+	const __m256i tex_height_mask8 = _mm256_set1_epi32(tex_height - 1);
+
+	const __m256i e0_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[0] * 8));
+	const __m256i e1_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[1] * 8));
+	const __m256i e2_step = _mm256_set1_epi32((int32_t)(edges->edge_dx[2] * 8));
+	const __m256 reciprocal_w_step = _mm256_set1_ps(reciprocal_w->dx * 8.0f);
+	const __m256 u_step = _mm256_set1_ps(u_over_w->dx * 8.0f);
+	const __m256 v_step = _mm256_set1_ps(v_over_w->dx * 8.0f);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	float u_over_w_row = u_over_w->origin;
+	float v_over_w_row = v_over_w->origin;
+	__m256i tested_lanes = _mm256_setzero_si256();
+	__m256i written_lanes = _mm256_setzero_si256();
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		__m256i e0 = edge_lanes_avx2(edge_row[0], edges->edge_dx[0]);
+		__m256i e1 = edge_lanes_avx2(edge_row[1], edges->edge_dx[1]);
+		__m256i e2 = edge_lanes_avx2(edge_row[2], edges->edge_dx[2]);
+		__m256 interpolated_reciprocal_w = _mm256_add_ps(_mm256_set1_ps(reciprocal_w_row), _mm256_mul_ps(lane_offsets, _mm256_set1_ps(reciprocal_w->dx)));
+		__m256 interpolated_u = _mm256_add_ps(_mm256_set1_ps(u_over_w_row), _mm256_mul_ps(lane_offsets, _mm256_set1_ps(u_over_w->dx)));
+		__m256 interpolated_v = _mm256_add_ps(_mm256_set1_ps(v_over_w_row), _mm256_mul_ps(lane_offsets, _mm256_set1_ps(v_over_w->dx)));
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		for (int x = edges->min_x; x <= edges->max_x; x += 8)
+		{
+			// A lane is covered when none of its edge functions has the sign bit set
+			__m256i inside = _mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(e0, e1), e2), minus_one);
+			__m256i covered = _mm256_and_si256(inside, lanes_in_range(x, edges->max_x));
+			bool whole = (x + 7 <= edges->clip_max_x);
+
+			if (_mm256_movemask_ps(_mm256_castsi256_ps(covered)))
+			{
+				was_inside = true;
+
+				__m256i depth = depth_encode_avx2(_mm256_sub_ps(far8, interpolated_reciprocal_w), format);
+				__m256i old_depth = depth_load_avx2(depth_values, x, covered, whole, format);
+				__m256i mask_i = _mm256_and_si256(covered, depth_closer_avx2(depth, old_depth, format));
+				tested_lanes = _mm256_sub_epi32(tested_lanes, covered);
+				written_lanes = _mm256_sub_epi32(written_lanes, mask_i);
+
+				if (_mm256_movemask_ps(_mm256_castsi256_ps(mask_i)))
+				{
+
+					// Perspective correct u and v of all 8 pixels, mapped and wrapped to texel coordinates
+					__m256 w = _mm256_div_ps(_mm256_set1_ps(1.0f), interpolated_reciprocal_w);
+					__m256 u = _mm256_mul_ps(interpolated_u, w);
+					__m256 v = _mm256_mul_ps(interpolated_v, w);
+					__m256i tex_x = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(u, tex_width8)));
+					__m256i tex_y = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(v, tex_height8)));
+					if (wrap == TEXTURE_WRAP_POW2)
+					{
+						tex_x = _mm256_and_si256(tex_x, tex_width_mask8);
+						tex_y = _mm256_and_si256(tex_y, tex_height_mask8);
+					}
+					else
+					{
+						tex_x = wrap_texel_avx2(tex_x, tex_width8i, inv_tex_width8);
+						tex_y = wrap_texel_avx2(tex_y, tex_height8i, inv_tex_height8);
+					}
+
+					// Only the lanes that pass the depth test gather their texel, at the sum of its column and row offsets in the tiled layout
+					__m256i column_offsets = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), level.column_offsets, tex_x, mask_i, 4);
+					__m256i row_offsets = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), level.row_offsets, tex_y, mask_i, 4);
+					__m256i texel_indices = _mm256_add_epi32(column_offsets, row_offsets);
+					__m256i texels = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)level.texels, texel_indices, mask_i, 4);
+
+					depth_store_avx2(depth_values, x, mask_i, depth, old_depth, whole, format);
+					_mm256_maskstore_epi32((int*)&color_row[x], mask_i, texels);
+				}
+			}
+			else if (was_inside)
+			{
+				break;
+			}
+
+			e0 = _mm256_add_epi32(e0, e0_step);
+			e1 = _mm256_add_epi32(e1, e1_step);
+			e2 = _mm256_add_epi32(e2, e2_step);
+			interpolated_reciprocal_w = _mm256_add_ps(interpolated_reciprocal_w, reciprocal_w_step);
+			interpolated_u = _mm256_add_ps(interpolated_u, u_step);
+			interpolated_v = _mm256_add_ps(interpolated_v, v_step);
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+		u_over_w_row += u_over_w->dy;
+		v_over_w_row += v_over_w->dy;
+	}
+
+	counts->tested += lane_sum_avx2(tested_lanes);
+	counts->written += lane_sum_avx2(written_lanes);
+}
+
+DEFINE_FILL_KERNELS(fill_triangle_avx2, fill_triangle_avx2_body);
+DEFINE_TEXTURE_KERNELS(texture_triangle_avx2, texture_triangle_avx2_body);
+
+#endif /* RASTERIZER_X86 */
@@ -0,0 +1,401 @@
+#include "rasterizer.h"
+
+#ifdef RASTERIZER_X86
+
+#include <stdlib.h>
+#include <emmintrin.h>
+#include "texture.h"
+
+/* Edge function values of 4 consecutive pixels, starting with value, the set up guarantees they fit 32 bits */
+static __m128i edge_lanes_sse2(int64_t value, int64_t step)
+{
+	int32_t e = (int32_t)value;
+	int32_t s = (int32_t)step;
+	return _mm_set_epi32(e + 3 * s, e + 2 * s, e + s, e);
+}
+
+/* Sum of the 4 lanes of a counter, lanes count a pixel by subtracting the all ones mask of its lane */
+static uint32_t lane_sum_sse2(__m128i lanes)
+{
+	lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+	lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(lanes);
+}
+
+/* Stored depth of 4 pixels from their float depth, as 32 bit lanes: the float bits or the quantized integers */
+DEPTH_INLINE __m128i depth_encode_sse2(__m128 depth, enum depth_format format)
+{
+	if (format == DEPTH_FLOAT32)
+	{
+		return _mm_castps_si128(depth);
+	}
+
+	// Clamped in the same order as depth_quantize, so NaN ends up on the far plane
+	const __m128 max = _mm_set1_ps((format == DEPTH_UNORM16) ? (float)DEPTH_UNORM16_MAX : (float)DEPTH_UNORM24_MAX);
+	__m128 scaled = _mm_max_ps(_mm_min_ps(_mm_mul_ps(depth, max), max), _mm_setzero_ps());
+	return _mm_cvttps_epi32(scaled);
+}
+
+/* Stored depth of the 4 pixels at x, as 32 bit lanes */
+DEPTH_INLINE __m128i depth_load_sse2(const void* row, int x, enum depth_format format)
+{
+	if (format == DEPTH_UNORM16)
+	{
+		return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)((const uint16_t*)row + x)), _mm_setzero_si128());
+	}
+	return _mm_loadu_si128((const __m128i*)((const uint32_t*)row + x));
+}
+
+/* Lanes where the new depth is closer than the stored one */
+DEPTH_INLINE __m128i depth_closer_sse2(__m128i depth, __m128i old_depth, enum depth_format format)
+{
+	if (format == DEPTH_FLOAT32)
+	{
+		return _mm_castps_si128(_mm_cmplt_ps(_mm_castsi128_ps(depth), _mm_castsi128_ps(old_depth)));
+	}
+	return _mm_cmplt_epi32(depth, old_depth);
+}
+
+/* Blends the depth of the lanes in mask in, the whole group lies inside the clip rectangle so it is ours to write */
+DEPTH_INLINE void depth_store_sse2(void* row, int x, __m128i mask, __m128i depth, __m128i old_depth, enum depth_format format)
+{
+	__m128i blended = _mm_or_si128(_mm_and_si128(mask, depth), _mm_andnot_si128(mask, old_depth));
+	if (format == DEPTH_UNORM16)
+	{
+		// SSE2 only packs to signed 16 bits, so the values are moved into that range and back
+		__m128i packed = _mm_packs_epi32(_mm_sub_epi32(blended, _mm_set1_epi32(0x8000)), _mm_setzero_si128());
+		_mm_storel_epi64((__m128i*)((uint16_t*)row + x), _mm_xor_si128(packed, _mm_set1_epi16((short)0x8000)));
+		return;
+	}
+	_mm_storeu_si128((__m128i*)((uint32_t*)row + x), blended);
+}
+
+/* Covers a narrow triangle 4 pixels at a time with the edge functions, cheaper than solving its short rows for their span */
+DEPTH_INLINE void fill_narrow_triangle_sse2(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	const __m128 lane_offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128i minus_one = _mm_set1_epi32(-1);
+	const float far = depth_far;
+	const __m128 far4 = _mm_set1_ps(far);
+	const __m128i color4 = _mm_set1_epi32((int)color);
+
+	// Increments of the edge functions and 1/w over a whole group of 4 pixels
+	const __m128i e0_step = _mm_set1_epi32((int32_t)(edges->edge_dx[0] * 4));
+	const __m128i e1_step = _mm_set1_epi32((int32_t)(edges->edge_dx[1] * 4));
+	const __m128i e2_step = _mm_set1_epi32((int32_t)(edges->edge_dx[2] * 4));
+	const __m128 reciprocal_w_step = _mm_set1_ps(reciprocal_w->dx * 4.0f);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	__m128i tested_lanes = _mm_setzero_si128();
+	__m128i written_lanes = _mm_setzero_si128();
+	uint32_t tested = 0;
+	uint32_t written = 0;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		__m128i e0 = edge_lanes_sse2(edge_row[0], edges->edge_dx[0]);
+		__m128i e1 = edge_lanes_sse2(edge_row[1], edges->edge_dx[1]);
+		__m128i e2 = edge_lanes_sse2(edge_row[2], edges->edge_dx[2]);
+		__m128 interpolated_reciprocal_w = _mm_add_ps(_mm_set1_ps(reciprocal_w_row), _mm_mul_ps(lane_offsets, _mm_set1_ps(reciprocal_w->dx)));
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		int x = edges->min_x;
+		for (; x + 3 <= edges->max_x; x += 4)
+		{
+			// A lane is covered when none of its edge functions has the sign bit set
+			__m128i covered = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), minus_one);
+
+			if (_mm_movemask_epi8(covered))
+			{
+				was_inside = true;
+
+				__m128i depth = depth_encode_sse2(_mm_sub_ps(far4, interpolated_reciprocal_w), format);
+				__m128i old_depth = depth_load_sse2(depth_values, x, format);
+				__m128i mask = _mm_and_si128(covered, depth_closer_sse2(depth, old_depth, format));
+				tested_lanes = _mm_sub_epi32(tested_lanes, covered);
+				written_lanes = _mm_sub_epi32(written_lanes, mask);
+
+				if (_mm_movemask_epi8(mask))
+				{
+					// Blend the passing lanes in, the whole group lies inside the clip rectangle so it is ours to write
+					__m128i old_color = _mm_loadu_si128((const __m128i*)&color_row[x]);
+					depth_store_sse2(depth_values, x, mask, depth, old_depth, format);
+					_mm_storeu_si128((__m128i*)&color_row[x], _mm_or_si128(_mm_and_si128(mask, color4), _mm_andnot_si128(mask, old_color)));
+				}
+			}
+			else if (was_inside)
+			{
+				// A triangle is convex, once we leave it there is nothing else on this row
+				x = edges->max_x + 1;
+				break;
+			}
+
+			e0 = _mm_add_epi32(e0, e0_step);
+			e1 = _mm_add_epi32(e1, e1_step);
+			e2 = _mm_add_epi32(e2, e2_step);
+			interpolated_reciprocal_w = _mm_add_ps(interpolated_reciprocal_w, reciprocal_w_step);
+		}
+
+		// Finish the pixels that do not fill a whole group one by one
+		int32_t s0 = _mm_cvtsi128_si32(e0);
+		int32_t s1 = _mm_cvtsi128_si32(e1);
+		int32_t s2 = _mm_cvtsi128_si32(e2);
+		float s_reciprocal_w = _mm_cvtss_f32(interpolated_reciprocal_w);
+		for (; x <= edges->max_x; x++)
+		{
+			if ((s0 | s1 | s2) >= 0)
+			{
+				tested++;
+				if (depth_test_pixel(depth_values, x, far - s_reciprocal_w, format))
+				{
+					color_row[x] = color;
+					written++;
+				}
+			}
+
+			s0 += (int32_t)edges->edge_dx[0];
+			s1 += (int32_t)edges->edge_dx[1];
+			s2 += (int32_t)edges->edge_dx[2];
+			s_reciprocal_w += reciprocal_w->dx;
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += tested + lane_sum_sse2(tested_lanes);
+	counts->written += written + lane_sum_sse2(written_lanes);
+}
+
+/* 4 pixels wide kernel of flat colored triangles, walks the covered span of every row with only the depth test left per pixel */
+DEPTH_INLINE void fill_triangle_sse2_body(const triangle_edges_t* edges, const attribute_plane_t* reciprocal_w, uint32_t color,
+	pixel_counts_t* counts, enum depth_format format)
+{
+	if (edges->max_x - edges->min_x < SPAN_MIN_WIDTH && edges->fits_32bit)
+	{
+		fill_narrow_triangle_sse2(edges, reciprocal_w, color, counts, format);
+		return;
+	}
+
+	const float far = depth_far;
+	const __m128 lane_offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128i color4 = _mm_set1_epi32((int)color);
+	const __m128 depth_dx = _mm_set1_ps(reciprocal_w->dx);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	__m128i written_lanes = _mm_setzero_si128();
+	uint32_t tested = 0;
+	uint32_t written = 0;
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		int start, end;
+		if (triangle_row_span(edges, edge_row, &start, &end))
+		{
+			uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+			void* depth_values = depth_row(y, format);
+			float depth_start = far - (reciprocal_w_row + reciprocal_w->dx * (start - edges->min_x));
+			tested += end - start + 1;
+
+			// Every pixel of the span is covered, so whole groups are blended in by the depth test alone
+			int x = start;
+			for (; x + 3 <= end; x += 4)
+			{
+				__m128 offsets = _mm_add_ps(_mm_set1_ps((float)(x - start)), lane_offsets);
+				__m128i depth = depth_encode_sse2(_mm_sub_ps(_mm_set1_ps(depth_start), _mm_mul_ps(depth_dx, offsets)), format);
+				__m128i old_depth = depth_load_sse2(depth_values, x, format);
+				__m128i mask = depth_closer_sse2(depth, old_depth, format);
+				written_lanes = _mm_sub_epi32(written_lanes, mask);
+				__m128i old_color = _mm_loadu_si128((const __m128i*)&color_row[x]);
+
+				depth_store_sse2(depth_values, x, mask, depth, old_depth, format);
+				_mm_storeu_si128((__m128i*)&color_row[x], _mm_or_si128(_mm_and_si128(mask, color4), _mm_andnot_si128(mask, old_color)));
+			}
+
+			// Finish the pixels that do not fill a whole group one by one
+			for (; x <= end; x++)
+			{
+				if (depth_test_pixel(depth_values, x, depth_start - reciprocal_w->dx * (x - start), format))
+				{
+					color_row[x] = color;
+					written++;
+				}
+			}
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+	}
+
+	counts->tested += tested;
+	counts->written += written + lane_sum_sse2(written_lanes);
+}
+
+/* 4 pixels wide kernel of perspective correct textured triangles, texels are fetched one lane at a time */
+DEPTH_INLINE void texture_triangle_sse2_body(
+	const triangle_edges_t* edges,
+	const attribute_plane_t* reciprocal_w,
+	const attribute_plane_t* u_over_w,
+	const attribute_plane_t* v_over_w,
+	const texture_level_t* texture,
+	pixel_counts_t* counts,
+	enum depth_format format,
+	enum texture_wrap wrap)
+{
+	const __m128 lane_offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128i minus_one = _mm_set1_epi32(-1);
+	const float far = depth_far;
+	const __m128 far4 = _mm_set1_ps(far);
+	// A local copy, stores to the color buffer could alias the level and reload its fields for every pixel
+	const texture_level_t level = *texture;
+	const int tex_width = level.width;
+	const int tex_height = level.height;
+	const __m128 tex_width4 = _mm_set1_ps((float)tex_width);
+	const __m128 tex_height4 = _mm_set1_ps((float)tex_height);
+
+	const __m128i e0_step = _mm_set1_epi32((int32_t)(edges->edge_dx[0] * 4));
+	const __m128i e1_step = _mm_set1_epi32((int32_t)(edges->edge_dx[1] * 4));
+	const __m128i e2_step = _mm_set1_epi32((int32_t)(edges->edge_dx[2] * 4));
+	const __m128 reciprocal_w_step = _mm_set1_ps(reciprocal_w->dx * 4.0f);
+	const __m128 u_step = _mm_set1_ps(u_over_w->dx * 4.0f);
+	const __m128 v_step = _mm_set1_ps(v_over_w->dx * 4.0f);
+
+	int64_t edge_row[3] = { edges->edge_origin[0], edges->edge_origin[1], edges->edge_origin[2] };
+	float reciprocal_w_row = reciprocal_w->origin;
+	float u_over_w_row = u_over_w->origin;
+	float v_over_w_row = v_over_w->origin;
+	__m128i tested_lanes = _mm_setzero_si128();
+	__m128i written_lanes = _mm_setzero_si128();
+	uint32_t tested = 0;
+	uint32_t written = 0;
+
+	int tex_x[4];
+	int tex_y[4];
+	uint32_t texels[4] = { 0, 0, 0, 0 };
+
+	for (int y = edges->min_y; y <= edges->max_y; y++)
+	{
+		__m128i e0 = edge_lanes_sse2(edge_row[0], edges->edge_dx[0]);
+		__m128i e1 = edge_lanes_sse2(edge_row[1], edges->edge_dx[1]);
+		__m128i e2 = edge_lanes_sse2(edge_row[2], edges->edge_dx[2]);
+		__m128 interpolated_reciprocal_w = _mm_add_ps(_mm_set1_ps(reciprocal_w_row), _mm_mul_ps(lane_offsets, _mm_set1_ps(reciprocal_w->dx)));
+		__m128 interpolated_u = _mm_add_ps(_mm_set1_ps(u_over_w_row), _mm_mul_ps(lane_offsets, _mm_set1_ps(u_over_w->dx)));
+		__m128 interpolated_v = _mm_add_ps(_mm_set1_ps(v_over_w_row), _mm_mul_ps(lane_offsets, _mm_set1_ps(v_over_w->dx)));
+
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+		void* depth_values = depth_row(y, format);
+
+		bool was_inside = false;
+		int x = edges->min_x;
+		for (; x + 3 <= edges->max_x; x += 4)
+		{
+			// A lane is covered when none of its edge functions has the sign bit set
+			__m128i covered = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), minus_one);
+
+			if (_mm_movemask_epi8(covered))
+			{
+				was_inside = true;
+
+				__m128i depth = depth_encode_sse2(_mm_sub_ps(far4, interpolated_reciprocal_w), format);
+				__m128i old_depth = depth_load_sse2(depth_values, x, format);
+				__m128i mask = _mm_and_si128(covered, depth_closer_sse2(depth, old_depth, format));
+				int lanes = _mm_movemask_ps(_mm_castsi128_ps(mask));
+				tested_lanes = _mm_sub_epi32(tested_lanes, covered);
+				written_lanes = _mm_sub_epi32(written_lanes, mask);
+
+				if (lanes)
+				{
+					// Perspective correct u and v of all 4 pixels, mapped to texel coordinates
+					__m128 w = _mm_div_ps(_mm_set1_ps(1.0f), interpolated_reciprocal_w);
+					__m128 u = _mm_mul_ps(interpolated_u, w);
+					__m128 v = _mm_mul_ps(interpolated_v, w);
+					_mm_storeu_si128((__m128i*)tex_x, _mm_cvttps_epi32(_mm_mul_ps(u, tex_width4)));
+					_mm_storeu_si128((__m128i*)tex_y, _mm_cvttps_epi32(_mm_mul_ps(v, tex_height4)));
+
+					// SSE2 has no gather, so only the lanes that pass the depth test fetch their texel
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if (lanes & (1 << lane))
+						{
+							int wrapped_x = texture_wrap_coordinate(tex_x[lane], tex_width, wrap);
+							int wrapped_y = texture_wrap_coordinate(tex_y[lane], tex_height, wrap);
+							texels[lane] = level.texels[texel_index(&level, wrapped_x, wrapped_y)];
+						}
+					}
+
+					__m128i colors = _mm_loadu_si128((const __m128i*)texels);
+					__m128i old_color = _mm_loadu_si128((const __m128i*)&color_row[x]);
+					depth_store_sse2(depth_values, x, mask, depth, old_depth, format);
+					_mm_storeu_si128((__m128i*)&color_row[x], _mm_or_si128(_mm_and_si128(mask, colors), _mm_andnot_si128(mask, old_color)));
+				}
+			}
+			else if (was_inside)
+			{
+				x = edges->max_x + 1;
+				break;
+			}
+
+			e0 = _mm_add_epi32(e0, e0_step);
+			e1 = _mm_add_epi32(e1, e1_step);
+			e2 = _mm_add_epi32(e2, e2_step);
+			interpolated_reciprocal_w = _mm_add_ps(interpolated_reciprocal_w, reciprocal_w_step);
+			interpolated_u = _mm_add_ps(interpolated_u, u_step);
+			interpolated_v = _mm_add_ps(interpolated_v, v_step);
+		}
+
+		// Finish the pixels that do not fill a whole group one by one
+		int32_t s0 = _mm_cvtsi128_si32(e0);
+		int32_t s1 = _mm_cvtsi128_si32(e1);
+		int32_t s2 = _mm_cvtsi128_si32(e2);
+		float s_reciprocal_w = _mm_cvtss_f32(interpolated_reciprocal_w);
+		float s_u = _mm_cvtss_f32(interpolated_u);
+		float s_v = _mm_cvtss_f32(interpolated_v);
+		for (; x <= edges->max_x; x++)
+		{
+			if ((s0 | s1 | s2) >= 0)
+			{
+				tested++;
+				if (depth_test_pixel(depth_values, x, far - s_reciprocal_w, format))
+				{
+					float s_w = 1.0f / s_reciprocal_w;
+					int wrapped_x = texture_wrap_coordinate((int)((s_u * s_w) * tex_width), tex_width, wrap);
+					int wrapped_y = texture_wrap_coordinate((int)((s_v * s_w) * tex_height), tex_height, wrap);
+					color_row[x] = level.texels[texel_index(&level, wrapped_x, wrapped_y)];
+					written++;
+				}
+			}
+
+			s0 += (int32_t)edges->edge_dx[0];
+			s1 += (int32_t)edges->edge_dx[1];
+			s2 += (int32_t)edges->edge_dx[2];
+			s_reciprocal_w += reciprocal_w->dx;
+			s_u += u_over_w->dx;
+			s_v += v_over_w->dx;
+		}
+
+		edge_row[0] += edges->edge_dy[0];
+		edge_row[1] += edges->edge_dy[1];
+		edge_row[2] += edges->edge_dy[2];
+		reciprocal_w_row += reciprocal_w->dy;
+		u_over_w_row += u_over_w->dy;
+		v_over_w_row += v_over_w->dy;
+	}
+
+	counts->tested += tested + lane_sum_sse2(tested_lanes);
+	counts->written += written + lane_sum_sse2(written_lanes);
+}
+
+DEFINE_FILL_KERNELS(fill_triangle_sse2, fill_triangle_sse2_body);
+DEFINE_TEXTURE_KERNELS(texture_triangle_sse2, texture_triangle_sse2_body);
+
+#endif /* RASTERIZER_X86 */
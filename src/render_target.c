@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "render_target.h"
+
+render_target_t render_target = { 800, 600, NULL, NULL };
+
+/* Function to size the render target and allocate its color buffer */
+bool render_target_init(int width, int height)
+{
+	render_target_destroy();
+
+	render_target.width = width;
+	render_target.height = height;
+	render_target.color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+	if (!render_target.color_buffer)
+	{
+		fprintf(stderr, "Error allocating the color buffer.\n");
+		return false;
+	}
+	return true;
+}
+
+/* Function to free the color buffer of the render target */
+void render_target_destroy(void)
+{
+	free(render_target.color_buffer);
+	render_target.color_buffer = NULL;
+}
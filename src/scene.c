@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "array.h"
+#include "simplify.h"
+#include "scene.h"
+
+/* Global scene variable */
+scene_t scene = { 0 };
+
+/* Simplifies the loaded mesh of an asset into its coarser levels of detail, an asset keeps working with fewer of them */
+static void build_lods(scene_asset_t* asset)
+{
+	const mesh_t* mesh = &asset->lods[0].mesh;
+	int target_faces[SCENE_MAX_LODS - 1];
+	int num_targets = 0;
+	for (int faces = array_length(mesh->faces) / SCENE_LOD_FACE_RATIO; faces >= SCENE_LOD_MIN_FACES && num_targets < SCENE_MAX_LODS - 1; faces /= SCENE_LOD_FACE_RATIO)
+	{
+		target_faces[num_targets++] = faces;
+	}
+
+	mesh_t levels[SCENE_MAX_LODS - 1];
+	float errors[SCENE_MAX_LODS - 1];
+	int num_levels = mesh_simplify(mesh, target_faces, num_targets, SCENE_LOD_MAX_ERROR * mesh->bounds.radius, levels, errors);
+	for (int i = 0; i < num_levels; i++)
+	{
+		scene_lod_t* lod = &asset->lods[asset->num_lods];
+		lod->mesh = levels[i];
+		if (!wireframe_init(&lod->wireframe, lod->mesh.faces, array_length(lod->mesh.faces), lod->mesh.vertices.count))
+		{
+			for (int j = i; j < num_levels; j++)
+			{
+				free_mesh(&levels[j]);
+			}
+			return;
+		}
+
+		// The farthest an original vertex is from the level shrinks on screen along with the bounding sphere, it stays within SCENE_LOD_ERROR_PIXELS up to this radius
+		lod->max_radius = (errors[i] > 0.0f) ? SCENE_LOD_ERROR_PIXELS * mesh->bounds.radius / errors[i] : FLT_MAX;
+		asset->num_lods++;
+	}
+}
+
+/* Frees every level of detail of an asset */
+static void free_lods(scene_asset_t* asset)
+{
+	for (int i = 0; i < asset->num_lods; i++)
+	{
+		free_mesh(&asset->lods[i].mesh);
+		wireframe_free(&asset->lods[i].wireframe);
+	}
+	asset->num_lods = 0;
+}
+
+/* Function to load a model and its texture as a new asset, returns its index or -1 if either cannot be loaded */
+int scene_load_asset(const char* obj_filename, const char* png_filename)
+{
+	if (scene.num_assets == scene.assets_capacity)
+	{
+		int capacity = (scene.assets_capacity > 0) ? scene.assets_capacity * 2 : 4;
+		scene_asset_t* grown = (scene_asset_t*)realloc(scene.assets, sizeof(scene_asset_t) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the scene assets.\n");
+			return -1;
+		}
+		scene.assets = grown;
+		scene.assets_capacity = capacity;
+	}
+
+	scene_asset_t* asset = &scene.assets[scene.num_assets];
+	memset(asset, 0, sizeof(scene_asset_t));
+	if (!load_png_texture_data(&asset->texture, png_filename))
+	{
+		fprintf(stderr, "Error loading %s.\n", png_filename);
+		return -1;
+	}
+	scene_lod_t* loaded = &asset->lods[0];
+	if (!load_obj_file_data(&loaded->mesh, obj_filename))
+	{
+		free_texture(&asset->texture);
+		return -1;
+	}
+
+	/* Every edge shared by two faces is only drawn once in the wireframe modes */
+	if (!wireframe_init(&loaded->wireframe, loaded->mesh.faces, array_length(loaded->mesh.faces), loaded->mesh.vertices.count))
+	{
+		free_mesh(&loaded->mesh);
+		free_texture(&asset->texture);
+		return -1;
+	}
+	loaded->max_radius = FLT_MAX;
+	asset->num_lods = 1;
+
+	/* Instances far away draw a simplified mesh, with a fraction of the vertices to transform and faces to set up */
+	build_lods(asset);
+
+	return scene.num_assets++;
+}
+
+/* Function to place a new instance of an asset at the origin, unrotated and unscaled, returns its index or -1 */
+int scene_add_instance(int asset)
+{
+	if (asset < 0 || asset >= scene.num_assets)
+	{
+		return -1;
+	}
+
+	if (scene.num_instances == scene.instances_capacity)
+	{
+		int capacity = (scene.instances_capacity > 0) ? scene.instances_capacity * 2 : 16;
+		scene_instance_t* grown = (scene_instance_t*)realloc(scene.instances, sizeof(scene_instance_t) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the scene instances.\n");
+			return -1;
+		}
+		scene.instances = grown;
+		scene.instances_capacity = capacity;
+	}
+
+	scene_instance_t* instance = &scene.instances[scene.num_instances];
+	instance->asset = asset;
+	instance->rotation = (vec3_t){ 0.0f, 0.0f, 0.0f };
+	instance->scale = (vec3_t){ 1.0f, 1.0f, 1.0f };
+	instance->translation = (vec3_t){ 0.0f, 0.0f, 0.0f };
+	instance->moved = false;
+	instance->lod = 0;
+	scene.layout_version++;
+	return scene.num_instances++;
+}
+
+/* Function to tell the scene an instance was moved, rotated or scaled, its bounds are refit before the next frame */
+void scene_instance_moved(int instance)
+{
+	if (instance < 0 || instance >= scene.num_instances || scene.instances[instance].moved)
+	{
+		return;
+	}
+
+	if (scene.num_moved_instances == scene.moved_instances_capacity)
+	{
+		int capacity = (scene.moved_instances_capacity > 0) ? scene.moved_instances_capacity * 2 : 16;
+		int* grown = (int*)realloc(scene.moved_instances, sizeof(int) * capacity);
+		if (!grown)
+		{
+			// Without room to remember it, the whole layout is treated as changed
+			fprintf(stderr, "Error allocating the moved instances.\n");
+			scene.layout_version++;
+			return;
+		}
+		scene.moved_instances = grown;
+		scene.moved_instances_capacity = capacity;
+	}
+	scene.instances[instance].moved = true;
+	scene.moved_instances[scene.num_moved_instances++] = instance;
+}
+
+/* Function to pick the level of detail of an instance from the radius of its bounding sphere on screen, in pixels, returns it */
+int scene_select_lod(scene_instance_t* instance, float projected_radius)
+{
+	const scene_asset_t* asset = &scene.assets[instance->asset];
+	int lod = (instance->lod < asset->num_lods) ? instance->lod : asset->num_lods - 1;
+
+	// Go finer as soon as the level is too coarse for the size, but coarser only once the size is clearly below where the next level starts
+	while (lod > 0 && projected_radius > asset->lods[lod].max_radius)
+	{
+		lod--;
+	}
+	while (lod + 1 < asset->num_lods && projected_radius <= asset->lods[lod + 1].max_radius * (1.0f - SCENE_LOD_HYSTERESIS))
+	{
+		lod++;
+	}
+	instance->lod = lod;
+	return lod;
+}
+
+/* Function to build the world matrix of an instance: scale, then rotation, then translation */
+mat4_t scene_instance_world_matrix(const scene_instance_t* instance)
+{
+	// Create scale, rotation, and translation matrices that will be applied to the mesh vertices
+	mat4_t scale_matrix = mat4_make_scale(instance->scale.x, instance->scale.y, instance->scale.z);
+	mat4_t translation_matrix = mat4_make_translation(instance->translation.x, instance->translation.y, instance->translation.z);
+	mat4_t rotation_matrix_x = mat4_make_rotation_x(instance->rotation.x);
+	mat4_t rotation_matrix_y = mat4_make_rotation_y(instance->rotation.y);
+	mat4_t rotation_matrix_z = mat4_make_rotation_z(instance->rotation.z);
+
+	// Order of transformations: Scale -> Rotation -> Translation
+	// [T]*[R]*[S]*v
+	mat4_t world_matrix = mat4_identity();
+	world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
+	world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+	return world_matrix;
+}
+
+/* Function to remove every instance, keeping the assets loaded */
+void scene_clear_instances(void)
+{
+	scene.num_instances = 0;
+	scene.num_moved_instances = 0;
+	scene.layout_version++;
+}
+
+/* Function to free every asset and instance of the scene */
+void scene_destroy(void)
+{
+	for (int i = 0; i < scene.num_assets; i++)
+	{
+		free_lods(&scene.assets[i]);
+		free_texture(&scene.assets[i].texture);
+	}
+	free(scene.assets);
+	free(scene.instances);
+	free(scene.moved_instances);
+
+	// The version keeps counting, so a spatial index built for the old scene never matches a new one
+	unsigned int layout_version = scene.layout_version;
+	memset(&scene, 0, sizeof(scene_t));
+	scene.layout_version = layout_version + 1;
+}
@@ -0,0 +1,922 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "array.h"
+#include "simplify.h"
+
+/* A face may turn by at most this much when one of its corners moves, as the cosine between its normals before and after */
+#define SIMPLIFY_MIN_NORMAL_COS 0.2f
+
+/* A level is only kept when it has at most this fraction of the faces of the level before it */
+#define SIMPLIFY_MIN_REDUCTION 0.75f
+
+/* Symmetric 4x4 matrix summing the weighted squared distances to a set of planes: aa ab ac ad bb bc bd cc cd dd, and the sum of the weights */
+typedef struct
+{
+	double q[10];
+	double weight;
+} quadric_t;
+
+/* Face being simplified, removed once one of its edges collapsed */
+typedef struct
+{
+	int v[3];
+	tex2_t uv[3];
+	uint32_t color;
+	bool removed;
+} simplify_face_t;
+
+/* Candidate collapse moving vertex from onto vertex to, stale once either of them changed after it was queued */
+typedef struct
+{
+	double cost;
+	int from;
+	int to;
+	unsigned int from_version;
+	unsigned int to_version;
+} collapse_t;
+
+/* Neighbor of a vertex: how many faces share the edge to it, and whether the texture coordinates jump across the edge */
+typedef struct
+{
+	int vertex;
+	int faces;
+	tex2_t uv;          /* of the center vertex in the first face of the edge */
+	tex2_t neighbor_uv; /* of the neighbor in the first face of the edge */
+	bool seam;
+} ring_entry_t;
+
+/* Everything the simplification works on, the corners of the faces around every vertex are kept in a linked list */
+typedef struct
+{
+	vec3_t* positions;
+	quadric_t* quadrics;
+	unsigned int* versions;
+	bool* removed;
+	int* collapsed_into;    /* vertex a removed vertex was moved onto, -1 while it is live */
+	int num_vertices;
+	simplify_face_t* faces;
+	int num_faces;
+	int live_faces;
+	int* first_corner;  /* corner f * 3 + k is corner k of face f, -1 ends a list */
+	int* next_corner;
+	unsigned int* marks;
+	unsigned int mark;
+	collapse_t* heap;
+	int heap_size;
+	int heap_capacity;
+	int heap_pushes;    /* since the heap was last compacted */
+	ring_entry_t* ring;
+	int ring_size;
+	int ring_capacity;
+} simplifier_t;
+
+static void quadric_add_plane(quadric_t* quadric, double a, double b, double c, double d, double weight)
+{
+	double* q = quadric->q;
+	q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+	q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+	q[7] += weight * c * c; q[8] += weight * c * d;
+	q[9] += weight * d * d;
+	quadric->weight += weight;
+}
+
+/* Weighted sum of the squared distances of a point to the planes of a quadric */
+static double quadric_error(const quadric_t* quadric, vec3_t p)
+{
+	const double* q = quadric->q;
+	double x = p.x;
+	double y = p.y;
+	double z = p.z;
+	return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+		+ q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+		+ q[7] * z * z + 2.0 * q[8] * z
+		+ q[9];
+}
+
+static bool uv_equal(tex2_t a, tex2_t b)
+{
+	return a.u == b.u && a.v == b.v;
+}
+
+static vec3_t face_normal(vec3_t a, vec3_t b, vec3_t c)
+{
+	return vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+}
+
+/* Cost of moving vertex from onto vertex to: the mean squared distance of the new position to the original surface around both */
+static double collapse_cost(const simplifier_t* s, int from, int to)
+{
+	vec3_t p = s->positions[to];
+	double weight = s->quadrics[from].weight + s->quadrics[to].weight;
+	double cost = quadric_error(&s->quadrics[from], p) + quadric_error(&s->quadrics[to], p);
+	return (cost > 0.0 && weight > 0.0) ? cost / weight : 0.0;
+}
+
+/* A queued collapse whose vertices were removed or changed since it was queued */
+static bool collapse_is_stale(const simplifier_t* s, const collapse_t* collapse)
+{
+	return s->removed[collapse->from] || s->removed[collapse->to]
+		|| s->versions[collapse->from] != collapse->from_version || s->versions[collapse->to] != collapse->to_version;
+}
+
+/* Places a collapse at position i of the heap and moves it down below its cheaper children */
+static void heap_sift_down(simplifier_t* s, int i, collapse_t collapse)
+{
+	for (;;)
+	{
+		int child = 2 * i + 1;
+		if (child >= s->heap_size)
+		{
+			break;
+		}
+		if (child + 1 < s->heap_size && s->heap[child + 1].cost < s->heap[child].cost)
+		{
+			child++;
+		}
+		if (s->heap[child].cost >= collapse.cost)
+		{
+			break;
+		}
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	s->heap[i] = collapse;
+}
+
+/* Drops the stale collapses from the heap and restores the heap order of the others */
+static void heap_compact(simplifier_t* s)
+{
+	int size = 0;
+	for (int i = 0; i < s->heap_size; i++)
+	{
+		if (!collapse_is_stale(s, &s->heap[i]))
+		{
+			s->heap[size++] = s->heap[i];
+		}
+	}
+	s->heap_size = size;
+	s->heap_pushes = 0;
+	for (int i = size / 2 - 1; i >= 0; i--)
+	{
+		heap_sift_down(s, i, s->heap[i]);
+	}
+}
+
+static bool heap_push(simplifier_t* s, int from, int to)
+{
+	// Every collapse leaves the queued collapses of its two vertices stale, once the heap took in as many new ones as it held
+	// after the last compaction most of it is usually stale, and dropping those is cheaper than popping them one by one
+	if (s->heap_pushes >= s->heap_size && s->heap_size >= 1024)
+	{
+		heap_compact(s);
+	}
+	if (s->heap_size == s->heap_capacity)
+	{
+		heap_compact(s);
+		if (s->heap_size >= s->heap_capacity / 2)
+		{
+			int capacity = (s->heap_capacity > 0) ? s->heap_capacity * 2 : 1024;
+			collapse_t* grown = (collapse_t*)realloc(s->heap, sizeof(collapse_t) * capacity);
+			if (!grown)
+			{
+				return false;
+			}
+			s->heap = grown;
+			s->heap_capacity = capacity;
+		}
+	}
+
+	collapse_t collapse = { collapse_cost(s, from, to), from, to, s->versions[from], s->versions[to] };
+	s->heap_pushes++;
+	int i = s->heap_size++;
+	while (i > 0 && s->heap[(i - 1) / 2].cost > collapse.cost)
+	{
+		s->heap[i] = s->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	s->heap[i] = collapse;
+	return true;
+}
+
+static collapse_t heap_pop(simplifier_t* s)
+{
+	collapse_t top = s->heap[0];
+	collapse_t last = s->heap[--s->heap_size];
+	if (s->heap_size > 0)
+	{
+		heap_sift_down(s, 0, last);
+	}
+	return top;
+}
+
+/* Collects the neighbors of a vertex and the edges to them into s->ring, returns false if it cannot be allocated */
+static bool gather_ring(simplifier_t* s, int center)
+{
+	s->ring_size = 0;
+	for (int corner = s->first_corner[center]; corner >= 0; corner = s->next_corner[corner])
+	{
+		const simplify_face_t* face = &s->faces[corner / 3];
+		if (face->removed)
+		{
+			continue;
+		}
+		int k = corner % 3;
+		for (int side = 1; side <= 2; side++)
+		{
+			int neighbor = face->v[(k + side) % 3];
+			tex2_t neighbor_uv = face->uv[(k + side) % 3];
+			ring_entry_t* entry = NULL;
+			for (int i = 0; i < s->ring_size; i++)
+			{
+				if (s->ring[i].vertex == neighbor)
+				{
+					entry = &s->ring[i];
+					break;
+				}
+			}
+
+			if (entry)
+			{
+				entry->faces++;
+				entry->seam = entry->seam || !uv_equal(entry->uv, face->uv[k]) || !uv_equal(entry->neighbor_uv, neighbor_uv);
+				continue;
+			}
+			if (s->ring_size == s->ring_capacity)
+			{
+				int capacity = (s->ring_capacity > 0) ? s->ring_capacity * 2 : 32;
+				ring_entry_t* grown = (ring_entry_t*)realloc(s->ring, sizeof(ring_entry_t) * capacity);
+				if (!grown)
+				{
+					return false;
+				}
+				s->ring = grown;
+				s->ring_capacity = capacity;
+			}
+			s->ring[s->ring_size++] = (ring_entry_t){ neighbor, 1, face->uv[k], neighbor_uv, false };
+		}
+	}
+	return true;
+}
+
+/* An edge on an open border, a UV seam, or shared by more than two faces */
+static bool is_feature_edge(const ring_entry_t* entry)
+{
+	return entry->faces != 2 || entry->seam;
+}
+
+static bool face_has_vertex(const simplify_face_t* face, int vertex)
+{
+	return face->v[0] == vertex || face->v[1] == vertex || face->v[2] == vertex;
+}
+
+/* Checks that moving vertex from onto vertex to keeps the mesh manifold, its seams and borders in place and its faces facing the same way.
+   Fills the texture coordinates the corners of from take on: map_from[i] becomes map_to[i] */
+static bool check_collapse(simplifier_t* s, int from, int to, tex2_t map_from[2], tex2_t map_to[2], int* map_size)
+{
+	if (!gather_ring(s, from))
+	{
+		return false;
+	}
+
+	// A vertex on a seam or border may only slide along it, and only where a single seam or border passes through it
+	int num_features = 0;
+	bool is_neighbor = false;
+	bool along_feature = false;
+	for (int i = 0; i < s->ring_size; i++)
+	{
+		const ring_entry_t* entry = &s->ring[i];
+		if (entry->faces > 2)
+		{
+			return false;
+		}
+		if (is_feature_edge(entry))
+		{
+			num_features++;
+		}
+		if (entry->vertex == to)
+		{
+			is_neighbor = true;
+			along_feature = is_feature_edge(entry);
+		}
+	}
+	if (!is_neighbor || (num_features != 0 && !(num_features == 2 && along_feature)))
+	{
+		return false;
+	}
+
+	// The faces on the edge tell which texture coordinates of to every corner of from continues into
+	int num_shared = 0;
+	*map_size = 0;
+	for (int corner = s->first_corner[from]; corner >= 0; corner = s->next_corner[corner])
+	{
+		const simplify_face_t* face = &s->faces[corner / 3];
+		if (face->removed || !face_has_vertex(face, to))
+		{
+			continue;
+		}
+		num_shared++;
+		tex2_t from_uv = face->uv[corner % 3];
+		tex2_t to_uv = face->uv[(face->v[0] == to) ? 0 : (face->v[1] == to) ? 1 : 2];
+		int i = 0;
+		while (i < *map_size && !uv_equal(map_from[i], from_uv))
+		{
+			i++;
+		}
+		if (i < *map_size)
+		{
+			if (!uv_equal(map_to[i], to_uv))
+			{
+				return false;
+			}
+			continue;
+		}
+		if (*map_size == 2)
+		{
+			return false;
+		}
+		map_from[*map_size] = from_uv;
+		map_to[*map_size] = to_uv;
+		(*map_size)++;
+	}
+
+	// Only the vertices across the shared faces may be neighbors of both, anything else would fold two sheets of the surface together
+	unsigned int from_mark = ++s->mark;
+	unsigned int counted_mark = ++s->mark;
+	for (int i = 0; i < s->ring_size; i++)
+	{
+		s->marks[s->ring[i].vertex] = from_mark;
+	}
+	int num_common = 0;
+	for (int corner = s->first_corner[to]; corner >= 0; corner = s->next_corner[corner])
+	{
+		const simplify_face_t* face = &s->faces[corner / 3];
+		if (face->removed)
+		{
+			continue;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			int vertex = face->v[k];
+			if (vertex != from && vertex != to && s->marks[vertex] == from_mark)
+			{
+				s->marks[vertex] = counted_mark;
+				num_common++;
+			}
+		}
+	}
+	if (num_common != num_shared)
+	{
+		return false;
+	}
+
+	// Every face kept has to carry its texture over and must not flip or collapse to a line
+	vec3_t target = s->positions[to];
+	for (int corner = s->first_corner[from]; corner >= 0; corner = s->next_corner[corner])
+	{
+		const simplify_face_t* face = &s->faces[corner / 3];
+		if (face->removed || face_has_vertex(face, to))
+		{
+			continue;
+		}
+		int k = corner % 3;
+		int i = 0;
+		while (i < *map_size && !uv_equal(map_from[i], face->uv[k]))
+		{
+			i++;
+		}
+		if (i == *map_size)
+		{
+			return false;
+		}
+
+		vec3_t p[3] = { s->positions[face->v[0]], s->positions[face->v[1]], s->positions[face->v[2]] };
+		vec3_t before = face_normal(p[0], p[1], p[2]);
+		p[k] = target;
+		vec3_t after = face_normal(p[0], p[1], p[2]);
+		float before_length = vec3_length(before);
+		float after_length = vec3_length(after);
+		if (before_length > 0.0f && vec3_dot(before, after) < SIMPLIFY_MIN_NORMAL_COS * before_length * after_length)
+		{
+			return false;
+		}
+		if (after_length <= 1e-6f * before_length)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Moves vertex from onto vertex to, drops the faces on the edge between them, and queues the collapses of the edges now around to */
+static bool apply_collapse(simplifier_t* s, int from, int to, const tex2_t map_from[2], const tex2_t map_to[2], int map_size)
+{
+	for (int corner = s->first_corner[from]; corner >= 0; corner = s->next_corner[corner])
+	{
+		simplify_face_t* face = &s->faces[corner / 3];
+		if (face->removed)
+		{
+			continue;
+		}
+		if (face_has_vertex(face, to))
+		{
+			face->removed = true;
+			s->live_faces--;
+			continue;
+		}
+		int k = corner % 3;
+		face->v[k] = to;
+		for (int i = 0; i < map_size; i++)
+		{
+			if (uv_equal(map_from[i], face->uv[k]))
+			{
+				face->uv[k] = map_to[i];
+				break;
+			}
+		}
+	}
+
+	// Relink the live corners of both vertices into the list of to
+	int head = -1;
+	int lists[2] = { s->first_corner[to], s->first_corner[from] };
+	for (int l = 0; l < 2; l++)
+	{
+		int corner = lists[l];
+		while (corner >= 0)
+		{
+			int next = s->next_corner[corner];
+			if (!s->faces[corner / 3].removed)
+			{
+				s->next_corner[corner] = head;
+				head = corner;
+			}
+			corner = next;
+		}
+	}
+	s->first_corner[to] = head;
+	s->first_corner[from] = -1;
+
+	for (int i = 0; i < 10; i++)
+	{
+		s->quadrics[to].q[i] += s->quadrics[from].q[i];
+	}
+	s->quadrics[to].weight += s->quadrics[from].weight;
+	s->removed[from] = true;
+	s->collapsed_into[from] = to;
+
+	// Only the edges of to changed cost, the others are checked for flips and folds again when they come up, so only they are queued again and the old entries go stale
+	s->versions[to]++;
+	if (!gather_ring(s, to))
+	{
+		return false;
+	}
+	for (int i = 0; i < s->ring_size; i++)
+	{
+		if (!heap_push(s, to, s->ring[i].vertex) || !heap_push(s, s->ring[i].vertex, to))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Point of a triangle closest to p, from the region of the triangle p projects into */
+static vec3_t closest_point_on_triangle(vec3_t p, vec3_t a, vec3_t b, vec3_t c)
+{
+	vec3_t ab = vec3_sub(b, a);
+	vec3_t ac = vec3_sub(c, a);
+	vec3_t ap = vec3_sub(p, a);
+	float d1 = vec3_dot(ab, ap);
+	float d2 = vec3_dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+	{
+		return a;
+	}
+
+	vec3_t bp = vec3_sub(p, b);
+	float d3 = vec3_dot(ab, bp);
+	float d4 = vec3_dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+	{
+		return b;
+	}
+
+	vec3_t cp = vec3_sub(p, c);
+	float d5 = vec3_dot(ab, cp);
+	float d6 = vec3_dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+	{
+		return c;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		return vec3_add(a, vec3_mul(ab, d1 / (d1 - d3)));
+	}
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		return vec3_add(a, vec3_mul(ac, d2 / (d2 - d6)));
+	}
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		return vec3_add(b, vec3_mul(vec3_sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+	}
+
+	float denominator = 1.0f / (va + vb + vc);
+	return vec3_add(a, vec3_add(vec3_mul(ab, vb * denominator), vec3_mul(ac, vc * denominator)));
+}
+
+/* Distance of a point to the closest live face with a corner on a vertex, or on one of the neighbors of the vertex */
+static float distance_around_vertex(simplifier_t* s, int center, vec3_t p)
+{
+	float nearest = FLT_MAX;
+	unsigned int searched_mark = ++s->mark;
+	for (int corner = s->first_corner[center]; corner >= 0; corner = s->next_corner[corner])
+	{
+		const simplify_face_t* center_face = &s->faces[corner / 3];
+		if (center_face->removed)
+		{
+			continue;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			// The center and every neighbor are shared by several faces, their faces are only searched once
+			int vertex = center_face->v[k];
+			if (s->marks[vertex] == searched_mark)
+			{
+				continue;
+			}
+			s->marks[vertex] = searched_mark;
+			for (int around = s->first_corner[vertex]; around >= 0; around = s->next_corner[around])
+			{
+				const simplify_face_t* face = &s->faces[around / 3];
+				if (face->removed)
+				{
+					continue;
+				}
+				vec3_t closest = closest_point_on_triangle(p, s->positions[face->v[0]], s->positions[face->v[1]], s->positions[face->v[2]]);
+				float distance = vec3_length(vec3_sub(p, closest));
+				nearest = (distance < nearest) ? distance : nearest;
+			}
+		}
+	}
+	return nearest;
+}
+
+/* Largest distance of a removed vertex to the surface left, searched around the vertex it ended up on.
+   The live vertices keep their positions on the original surface, so this bounds how far the two surfaces are apart at the vertices. */
+static float surface_deviation(simplifier_t* s)
+{
+	float deviation = 0.0f;
+	for (int v = 0; v < s->num_vertices; v++)
+	{
+		if (!s->removed[v])
+		{
+			continue;
+		}
+
+		// Follow the collapses to the live vertex, and point every vertex passed on the way straight at it
+		int target = v;
+		while (s->collapsed_into[target] >= 0)
+		{
+			target = s->collapsed_into[target];
+		}
+		for (int passed = v; s->collapsed_into[passed] >= 0 && s->collapsed_into[passed] != target;)
+		{
+			int next = s->collapsed_into[passed];
+			s->collapsed_into[passed] = target;
+			passed = next;
+		}
+
+		float distance = distance_around_vertex(s, target, s->positions[v]);
+		if (distance < FLT_MAX)
+		{
+			deviation = (distance > deviation) ? distance : deviation;
+		}
+	}
+	return deviation;
+}
+
+/* Copies the live faces and the vertices they use into a mesh of their own */
+static bool extract_level(const simplifier_t* s, mesh_t* level)
+{
+	memset(level, 0, sizeof(mesh_t));
+	int* remap = (int*)malloc(sizeof(int) * (s->num_vertices + 1));
+	vec3_t* positions = (vec3_t*)malloc(sizeof(vec3_t) * (s->num_vertices + 1));
+	if (!remap || !positions)
+	{
+		free(remap);
+		free(positions);
+		return false;
+	}
+	for (int i = 0; i < s->num_vertices; i++)
+	{
+		remap[i] = -1;
+	}
+
+	int num_positions = 0;
+	for (int f = 0; f < s->num_faces; f++)
+	{
+		const simplify_face_t* face = &s->faces[f];
+		if (face->removed)
+		{
+			continue;
+		}
+		int indices[3];
+		for (int k = 0; k < 3; k++)
+		{
+			if (remap[face->v[k]] < 0)
+			{
+				remap[face->v[k]] = num_positions;
+				positions[num_positions++] = s->positions[face->v[k]];
+			}
+			indices[k] = remap[face->v[k]];
+		}
+		face_t level_face = {
+			.a = indices[0],
+			.b = indices[1],
+			.c = indices[2],
+			.a_uv = face->uv[0],
+			.b_uv = face->uv[1],
+			.c_uv = face->uv[2],
+			.color = face->color
+		};
+		array_push(level->faces, level_face);
+	}
+
+	bool extracted = vertex_buffer_init(&level->vertices, positions, num_positions);
+	level->bounds = bounds_from_points(level->vertices.x, level->vertices.y, level->vertices.z, level->vertices.count);
+	free(remap);
+	free(positions);
+	if (!extracted)
+	{
+		free_mesh(level);
+	}
+	return extracted;
+}
+
+/* Position of a vertex with its index, sorted to find the vertices sharing a position */
+typedef struct
+{
+	vec3_t position;
+	int index;
+} weld_entry_t;
+
+static int compare_weld_entries(const void* a, const void* b)
+{
+	const weld_entry_t* p = (const weld_entry_t*)a;
+	const weld_entry_t* q = (const weld_entry_t*)b;
+	if (p->position.x != q->position.x) return (p->position.x < q->position.x) ? -1 : 1;
+	if (p->position.y != q->position.y) return (p->position.y < q->position.y) ? -1 : 1;
+	if (p->position.z != q->position.z) return (p->position.z < q->position.z) ? -1 : 1;
+	return p->index - q->index;
+}
+
+/* Maps every vertex to the first one at the same position, OBJ files repeat a position on both sides of a UV seam
+   and the two sides have to move together, or cracks would open up along the seam */
+static bool weld_positions(const vec3_t* positions, int count, int* welded)
+{
+	weld_entry_t* entries = (weld_entry_t*)malloc(sizeof(weld_entry_t) * (count + 1));
+	if (!entries)
+	{
+		return false;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		entries[i] = (weld_entry_t){ positions[i], i };
+	}
+	qsort(entries, count, sizeof(weld_entry_t), compare_weld_entries);
+	for (int i = 0; i < count; i++)
+	{
+		bool same = i > 0 && memcmp(&entries[i - 1].position, &entries[i].position, sizeof(vec3_t)) == 0;
+		welded[entries[i].index] = same ? welded[entries[i - 1].index] : entries[i].index;
+	}
+	free(entries);
+	return true;
+}
+
+/* Sets up the faces, corner lists and quadrics of a mesh, and queues the collapse of every edge both ways */
+static bool simplifier_init(simplifier_t* s, const mesh_t* mesh)
+{
+	memset(s, 0, sizeof(simplifier_t));
+	int num_vertices = mesh->vertices.count;
+	int num_faces = array_length(mesh->faces);
+	s->num_vertices = num_vertices;
+	s->num_faces = num_faces;
+	s->positions = (vec3_t*)malloc(sizeof(vec3_t) * (num_vertices + 1));
+	s->quadrics = (quadric_t*)calloc(num_vertices + 1, sizeof(quadric_t));
+	s->versions = (unsigned int*)calloc(num_vertices + 1, sizeof(unsigned int));
+	s->removed = (bool*)calloc(num_vertices + 1, sizeof(bool));
+	s->collapsed_into = (int*)malloc(sizeof(int) * (num_vertices + 1));
+	s->marks = (unsigned int*)calloc(num_vertices + 1, sizeof(unsigned int));
+	s->first_corner = (int*)malloc(sizeof(int) * (num_vertices + 1));
+	s->faces = (simplify_face_t*)malloc(sizeof(simplify_face_t) * (num_faces + 1));
+	s->next_corner = (int*)malloc(sizeof(int) * (3 * num_faces + 1));
+	int* welded = (int*)malloc(sizeof(int) * (num_vertices + 1));
+	if (!s->positions || !s->quadrics || !s->versions || !s->removed || !s->collapsed_into || !s->marks || !s->first_corner || !s->faces || !s->next_corner
+		|| !welded)
+	{
+		free(welded);
+		return false;
+	}
+
+	for (int i = 0; i < num_vertices; i++)
+	{
+		s->positions[i] = (vec3_t){ mesh->vertices.x[i], mesh->vertices.y[i], mesh->vertices.z[i] };
+		s->first_corner[i] = -1;
+		s->collapsed_into[i] = -1;
+	}
+	if (!weld_positions(s->positions, num_vertices, welded))
+	{
+		free(welded);
+		return false;
+	}
+
+	// Faces with repeated or missing vertices are dropped, every other one adds its plane to the quadrics of its corners, weighted by its area
+	for (int f = 0; f < num_faces; f++)
+	{
+		const face_t* mesh_face = &mesh->faces[f];
+		simplify_face_t* face = &s->faces[f];
+		*face = (simplify_face_t){ { mesh_face->a, mesh_face->b, mesh_face->c }, { mesh_face->a_uv, mesh_face->b_uv, mesh_face->c_uv }, mesh_face->color, false };
+		bool valid = true;
+		for (int k = 0; k < 3; k++)
+		{
+			valid = valid && face->v[k] >= 0 && face->v[k] < num_vertices;
+			face->v[k] = valid ? welded[face->v[k]] : face->v[k];
+		}
+		if (!valid || face->v[0] == face->v[1] || face->v[1] == face->v[2] || face->v[2] == face->v[0])
+		{
+			face->removed = true;
+			continue;
+		}
+		s->live_faces++;
+		for (int k = 0; k < 3; k++)
+		{
+			s->next_corner[3 * f + k] = s->first_corner[face->v[k]];
+			s->first_corner[face->v[k]] = 3 * f + k;
+		}
+
+		vec3_t normal = face_normal(s->positions[face->v[0]], s->positions[face->v[1]], s->positions[face->v[2]]);
+		float area = 0.5f * vec3_length(normal);
+		if (area > 0.0f)
+		{
+			vec3_normalize(&normal);
+			double d = -vec3_dot(normal, s->positions[face->v[0]]);
+			for (int k = 0; k < 3; k++)
+			{
+				quadric_add_plane(&s->quadrics[face->v[k]], normal.x, normal.y, normal.z, d, area);
+			}
+		}
+	}
+
+	free(welded);
+
+	// Seams and borders also add a plane standing on them, so sliding along them is cheap and moving away from them is not
+	for (int u = 0; u < num_vertices; u++)
+	{
+		if (!gather_ring(s, u))
+		{
+			return false;
+		}
+		unsigned int feature_mark = ++s->mark;
+		for (int i = 0; i < s->ring_size; i++)
+		{
+			if (s->ring[i].vertex > u && is_feature_edge(&s->ring[i]))
+			{
+				s->marks[s->ring[i].vertex] = feature_mark;
+			}
+		}
+		for (int corner = s->first_corner[u]; corner >= 0; corner = s->next_corner[corner])
+		{
+			const simplify_face_t* face = &s->faces[corner / 3];
+			int k = corner % 3;
+			vec3_t normal = face_normal(s->positions[face->v[0]], s->positions[face->v[1]], s->positions[face->v[2]]);
+			if (!(vec3_length(normal) > 0.0f))
+			{
+				continue;
+			}
+			vec3_normalize(&normal);
+			for (int side = 1; side <= 2; side++)
+			{
+				int w = face->v[(k + side) % 3];
+				if (s->marks[w] != feature_mark)
+				{
+					continue;
+				}
+				vec3_t edge = vec3_sub(s->positions[w], s->positions[u]);
+				vec3_t edge_normal = vec3_cross(edge, normal);
+				float edge_length = vec3_length(edge);
+				if (vec3_length(edge_normal) > 0.0f)
+				{
+					vec3_normalize(&edge_normal);
+					double d = -vec3_dot(edge_normal, s->positions[u]);
+					double weight = (double)edge_length * edge_length;
+					quadric_add_plane(&s->quadrics[u], edge_normal.x, edge_normal.y, edge_normal.z, d, weight);
+					quadric_add_plane(&s->quadrics[w], edge_normal.x, edge_normal.y, edge_normal.z, d, weight);
+				}
+			}
+		}
+	}
+
+	// Every edge is queued once, from its vertex with the smaller index, even though two faces share it
+	for (int u = 0; u < num_vertices; u++)
+	{
+		if (!gather_ring(s, u))
+		{
+			return false;
+		}
+		for (int i = 0; i < s->ring_size; i++)
+		{
+			int w = s->ring[i].vertex;
+			if (w > u && (!heap_push(s, u, w) || !heap_push(s, w, u)))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void simplifier_destroy(simplifier_t* s)
+{
+	free(s->positions);
+	free(s->quadrics);
+	free(s->versions);
+	free(s->removed);
+	free(s->collapsed_into);
+	free(s->marks);
+	free(s->first_corner);
+	free(s->next_corner);
+	free(s->faces);
+	free(s->heap);
+	free(s->ring);
+	memset(s, 0, sizeof(simplifier_t));
+}
+
+/* Function to simplify a mesh into coarser levels in one pass, levels[i] gets at most target_faces[i] faces where the collapses allow it,
+   and errors[i] the largest distance of an original vertex to its surface, in model units. No collapse moves the surface by more than
+   max_error, as the root mean square distance to the planes of the faces it replaces.
+   Returns the number of levels made, the chain stops at the first level that cannot be made noticeably coarser than the one before */
+int mesh_simplify(const mesh_t* mesh, const int* target_faces, int num_targets, float max_error, mesh_t* levels, float* errors)
+{
+	simplifier_t s;
+	if (!simplifier_init(&s, mesh))
+	{
+		fprintf(stderr, "Error allocating the mesh simplification.\n");
+		simplifier_destroy(&s);
+		return 0;
+	}
+
+	int num_levels = 0;
+	int previous_faces = s.live_faces;
+	double max_cost = (double)max_error * max_error;
+	bool failed = false;
+	for (int target = 0; target < num_targets && !failed; target++)
+	{
+		// Collapse the cheapest edges first, skipping the queued collapses whose vertices changed since and the ones breaking the mesh
+		while (s.live_faces > target_faces[target] && s.heap_size > 0)
+		{
+			collapse_t collapse = heap_pop(&s);
+			if (collapse.cost > max_cost)
+			{
+				// Every collapse left costs at least as much, the surface would visibly change shape
+				s.heap_size = 0;
+				break;
+			}
+			if (collapse_is_stale(&s, &collapse))
+			{
+				continue;
+			}
+
+			tex2_t map_from[2];
+			tex2_t map_to[2];
+			int map_size;
+			if (!check_collapse(&s, collapse.from, collapse.to, map_from, map_to, &map_size))
+			{
+				continue;
+			}
+			if (!apply_collapse(&s, collapse.from, collapse.to, map_from, map_to, map_size))
+			{
+				fprintf(stderr, "Error allocating the mesh simplification.\n");
+				failed = true;
+				break;
+			}
+		}
+
+		if (failed || s.live_faces > (int)(SIMPLIFY_MIN_REDUCTION * (float)previous_faces) || !extract_level(&s, &levels[num_levels]))
+		{
+			break;
+		}
+		errors[num_levels] = surface_deviation(&s);
+		previous_faces = s.live_faces;
+		num_levels++;
+	}
+
+	simplifier_destroy(&s);
+	return num_levels;
+}
@@ -0,0 +1,151 @@
+#include <string.h>
+#include <SDL.h>
+#include "stats.h"
+
+const char* const stats_stage_names[STAGE_COUNT] = {
+	"transform", "cull", "clip", "project", "clear", "raster", "present"
+};
+
+const char* const stats_counter_names[COUNTER_COUNT] = {
+	"bvh_nodes_visited", "instances_culled", "triangles_in", "triangles_culled", "triangles_clipped", "triangles_rasterized", "pixels_tested", "pixels_written"
+};
+
+/* Ring buffer of the last frames, current is the frame that is being recorded */
+static frame_stats_t history[STATS_HISTORY];
+static int current = 0;
+static int recorded = 0;
+static uint64_t next_frame = 0;
+
+/* Milliseconds per tick of the performance counter */
+static double ms_per_tick = 0.0;
+
+/* Function to start recording a new frame, overwriting the oldest one once the ring buffer is full */
+void stats_begin_frame(void)
+{
+	if (ms_per_tick == 0.0)
+	{
+		ms_per_tick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+
+	current = (recorded == 0) ? 0 : (current + 1) % STATS_HISTORY;
+	recorded = (recorded < STATS_HISTORY) ? recorded + 1 : STATS_HISTORY;
+
+	memset(&history[current], 0, sizeof(frame_stats_t));
+	history[current].frame = next_frame++;
+}
+
+/* Function to read the timer the stages are measured with */
+uint64_t stats_now(void)
+{
+	return SDL_GetPerformanceCounter();
+}
+
+/* Function to add the time since start to a stage of the current frame, returns the current time to start the next stage with */
+uint64_t stats_end_stage(enum stats_stage stage, uint64_t start)
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+	history[current].stage_ms[stage] += (double)(now - start) * ms_per_tick;
+	return now;
+}
+
+/* Function to add to a counter of the current frame */
+void stats_add_count(enum stats_counter counter, uint64_t count)
+{
+	history[current].counters[counter] += count;
+}
+
+/* Function to get the number of frames in the ring buffer */
+int stats_frame_count(void)
+{
+	return recorded;
+}
+
+/* Function to get a recorded frame, 0 is the current one, returns NULL for frames that are no longer kept */
+const frame_stats_t* stats_frame(int frames_ago)
+{
+	if (frames_ago < 0 || frames_ago >= recorded)
+	{
+		return NULL;
+	}
+	return &history[(current - frames_ago + STATS_HISTORY) % STATS_HISTORY];
+}
+
+/* Function to average the last frames in the ring buffer, returns how many were averaged */
+int stats_average(int frames, frame_stats_t* average)
+{
+	memset(average, 0, sizeof(frame_stats_t));
+	frames = (frames < recorded) ? frames : recorded;
+	if (frames <= 0)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < frames; i++)
+	{
+		const frame_stats_t* frame = stats_frame(i);
+		for (int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			average->stage_ms[stage] += frame->stage_ms[stage];
+		}
+		for (int counter = 0; counter < COUNTER_COUNT; counter++)
+		{
+			average->counters[counter] += frame->counters[counter];
+		}
+	}
+
+	// The counters are rounded to the nearest whole count
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		average->stage_ms[stage] /= frames;
+	}
+	for (int counter = 0; counter < COUNTER_COUNT; counter++)
+	{
+		average->counters[counter] = (average->counters[counter] + frames / 2) / frames;
+	}
+	average->frame = stats_frame(0)->frame;
+	return frames;
+}
+
+/* Prints one row of the table of stats_dump */
+static void print_frame(FILE* file, const char* label, const frame_stats_t* frame)
+{
+	fprintf(file, "%-10s", label);
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		fprintf(file, " %10.3f", frame->stage_ms[stage]);
+	}
+	for (int counter = 0; counter < COUNTER_COUNT; counter++)
+	{
+		fprintf(file, " %20llu", (unsigned long long)frame->counters[counter]);
+	}
+	fprintf(file, "\n");
+}
+
+/* Function to print every frame in the ring buffer and their average */
+void stats_dump(FILE* file)
+{
+	fprintf(file, "%-10s", "frame");
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		fprintf(file, " %10s", stats_stage_names[stage]);
+	}
+	for (int counter = 0; counter < COUNTER_COUNT; counter++)
+	{
+		fprintf(file, " %20s", stats_counter_names[counter]);
+	}
+	fprintf(file, "\n");
+
+	char label[32];
+	for (int i = recorded - 1; i >= 0; i--)
+	{
+		const frame_stats_t* frame = stats_frame(i);
+		snprintf(label, sizeof(label), "%llu", (unsigned long long)frame->frame);
+		print_frame(file, label, frame);
+	}
+
+	frame_stats_t average;
+	if (stats_average(recorded, &average) > 0)
+	{
+		print_frame(file, "average", &average);
+	}
+}
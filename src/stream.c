@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "render_target.h"
+#include "stream.h"
+
+/* The open stream, frame holds one converted frame until it is written */
+static FILE* stream_file = NULL;
+static enum stream_format stream_format = STREAM_Y4M;
+static int stream_width = 0;
+static int stream_height = 0;
+static uint8_t* frame = NULL;
+static size_t frame_size = 0;
+
+/* Function to start a stream of frames of the size of the render target, a path of "-" writes to stdout */
+bool stream_open(const char* path, enum stream_format format, int frames_per_second)
+{
+	stream_close();
+
+	stream_format = format;
+	stream_width = render_target.width;
+	stream_height = render_target.height;
+
+	// A Y4M frame is the full size luma plane followed by the two chroma planes at half the size, rounded up
+	int chroma_width = (stream_width + 1) / 2;
+	int chroma_height = (stream_height + 1) / 2;
+	frame_size = (format == STREAM_Y4M) ?
+		(size_t)stream_width * stream_height + 2 * (size_t)chroma_width * chroma_height :
+		(size_t)stream_width * stream_height * 3;
+	frame = (uint8_t*)malloc(frame_size);
+	if (!frame)
+	{
+		fprintf(stderr, "Error allocating the stream frame.\n");
+		return false;
+	}
+
+	if (strcmp(path, "-") == 0)
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		stream_file = stdout;
+	}
+	else
+	{
+		stream_file = fopen(path, "wb");
+	}
+	if (!stream_file)
+	{
+		fprintf(stderr, "Error opening %s.\n", path);
+		free(frame);
+		frame = NULL;
+		return false;
+	}
+
+	if (format == STREAM_Y4M && fprintf(stream_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", stream_width, stream_height, frames_per_second) < 0)
+	{
+		fprintf(stderr, "Error writing the stream header.\n");
+		stream_close();
+		return false;
+	}
+	return true;
+}
+
+/* Converts the color buffer into BT.601 studio range planes, the chroma is averaged over blocks of 2x2 pixels */
+static void convert_y4m(void)
+{
+	const uint32_t* pixels = render_target.color_buffer;
+	int chroma_width = (stream_width + 1) / 2;
+	int chroma_height = (stream_height + 1) / 2;
+	uint8_t* luma = frame;
+	uint8_t* blue_difference = luma + (size_t)stream_width * stream_height;
+	uint8_t* red_difference = blue_difference + (size_t)chroma_width * chroma_height;
+
+	for (int i = 0; i < stream_width * stream_height; i++)
+	{
+		// RGBA32 pixels have red in the lowest byte
+		int r = pixels[i] & 0xFF;
+		int g = (pixels[i] >> 8) & 0xFF;
+		int b = (pixels[i] >> 16) & 0xFF;
+		luma[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	}
+
+	for (int y = 0; y < chroma_height; y++)
+	{
+		// The last row and column are repeated when the size is odd
+		int y0 = 2 * y;
+		int y1 = (y0 + 1 < stream_height) ? y0 + 1 : y0;
+		for (int x = 0; x < chroma_width; x++)
+		{
+			int x0 = 2 * x;
+			int x1 = (x0 + 1 < stream_width) ? x0 + 1 : x0;
+			uint32_t block[4] = {
+				pixels[stream_width * y0 + x0], pixels[stream_width * y0 + x1],
+				pixels[stream_width * y1 + x0], pixels[stream_width * y1 + x1]
+			};
+
+			int r = 0;
+			int g = 0;
+			int b = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				r += block[i] & 0xFF;
+				g += (block[i] >> 8) & 0xFF;
+				b += (block[i] >> 16) & 0xFF;
+			}
+			blue_difference[chroma_width * y + x] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+			red_difference[chroma_width * y + x] = (uint8_t)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+		}
+	}
+}
+
+/* Converts the color buffer into packed RGB */
+static void convert_ppm(void)
+{
+	const uint32_t* pixels = render_target.color_buffer;
+	for (int i = 0; i < stream_width * stream_height; i++)
+	{
+		frame[3 * i + 0] = (uint8_t)pixels[i];
+		frame[3 * i + 1] = (uint8_t)(pixels[i] >> 8);
+		frame[3 * i + 2] = (uint8_t)(pixels[i] >> 16);
+	}
+}
+
+/* Function to write the color buffer of the render target as the next frame of the stream */
+bool stream_write_frame(void)
+{
+	if (!stream_file || render_target.width != stream_width || render_target.height != stream_height)
+	{
+		fprintf(stderr, "Error writing a frame: no stream is open for a render target of this size.\n");
+		return false;
+	}
+
+	int written;
+	if (stream_format == STREAM_Y4M)
+	{
+		convert_y4m();
+		written = fputs("FRAME\n", stream_file);
+	}
+	else
+	{
+		convert_ppm();
+		written = fprintf(stream_file, "P6\n%d %d\n255\n", stream_width, stream_height);
+	}
+
+	// Flush every frame, so a reader at the other end of a pipe gets it right away
+	if (written < 0 || fwrite(frame, 1, frame_size, stream_file) != frame_size || fflush(stream_file) != 0)
+	{
+		fprintf(stderr, "Error writing a frame to the stream.\n");
+		return false;
+	}
+	return true;
+}
+
+/* Function to flush and close the stream */
+bool stream_close(void)
+{
+	bool closed = true;
+	if (stream_file == stdout)
+	{
+		closed = (fflush(stream_file) == 0);
+	}
+	else if (stream_file)
+	{
+		closed = (fclose(stream_file) == 0);
+	}
+	stream_file = NULL;
+
+	free(frame);
+	frame = NULL;
+	return closed;
+}
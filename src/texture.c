@@ -1,22 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "texture.h"
 
-int tex_width = 64;
-int tex_height = 64;
+/* Spreads the low bits of a coordinate inside a tile over the even bits, half of a Morton index */
+static int spread_tile_bits(int v)
+{
+	int spread = 0;
+	for (int bit = 0; bit < TEXTURE_TILE_BITS; bit++)
+	{
+		spread |= ((v >> bit) & 1) << (2 * bit);
+	}
+	return spread;
+}
+
+/* Copies row-major texels into a level in the tiled layout, together with its offset tables, returns false if it cannot be allocated */
+static bool swizzle_level(texture_level_t* level, const uint32_t* texels, int width, int height)
+{
+	int tiles_x = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+	int tiles_y = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+	int tile_texels = TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+
+	level->texels = (uint32_t*)calloc((size_t)tiles_x * tiles_y * tile_texels, sizeof(uint32_t));
+	level->column_offsets = (int*)malloc(sizeof(int) * width);
+	level->row_offsets = (int*)malloc(sizeof(int) * height);
+	level->width = width;
+	level->height = height;
+	level->wrap = ((width & (width - 1)) == 0 && (height & (height - 1)) == 0) ? TEXTURE_WRAP_POW2 : TEXTURE_WRAP_NPOT;
+	if (!level->texels || !level->column_offsets || !level->row_offsets)
+	{
+		return false;
+	}
+
+	// x fills the even bits of the index inside a tile and y the odd ones, tiles are stored row by row
+	for (int x = 0; x < width; x++)
+	{
+		level->column_offsets[x] = (x / TEXTURE_TILE_SIZE) * tile_texels + spread_tile_bits(x);
+	}
+	for (int y = 0; y < height; y++)
+	{
+		level->row_offsets[y] = (y / TEXTURE_TILE_SIZE) * tiles_x * tile_texels + (spread_tile_bits(y) << 1);
+	}
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			level->texels[texel_index(level, x, y)] = texels[(width * y) + x];
+		}
+	}
+	return true;
+}
+
+/* Averages 2x2 blocks of row-major texels into a level half the size, channel by channel.
+   Odd sizes repeat their last row or column, so every texel of the source still counts. */
+static void downsample_texels(uint32_t* halved, const uint32_t* texels, int width, int height)
+{
+	int halved_width = (width > 1) ? width / 2 : 1;
+	int halved_height = (height > 1) ? height / 2 : 1;
+
+	for (int y = 0; y < halved_height; y++)
+	{
+		const uint32_t* row0 = &texels[width * (2 * y)];
+		const uint32_t* row1 = &texels[width * ((2 * y + 1 < height) ? 2 * y + 1 : height - 1)];
+		for (int x = 0; x < halved_width; x++)
+		{
+			int x0 = 2 * x;
+			int x1 = (x0 + 1 < width) ? x0 + 1 : width - 1;
+
+			uint32_t texel = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				uint32_t sum = ((row0[x0] >> shift) & 0xFF) + ((row0[x1] >> shift) & 0xFF)
+					+ ((row1[x0] >> shift) & 0xFF) + ((row1[x1] >> shift) & 0xFF);
+				texel |= ((sum + 2) / 4) << shift;
+			}
+			halved[(halved_width * y) + x] = texel;
+		}
+	}
+}
+
+/* Builds the mipmap chain of row-major texels down to a single texel, returns false if it cannot be allocated */
+static bool build_texture_levels(texture_t* texture, const uint32_t* texels, int width, int height)
+{
+	free_texture(texture);
+
+	// Every level is downsampled from the row-major copy of the one before it, then swizzled
+	uint32_t* scratch = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+	uint32_t* halved = (uint32_t*)malloc(sizeof(uint32_t) * ((width + 1) / 2) * ((height + 1) / 2));
+	bool built = (scratch != NULL && halved != NULL);
+	if (built)
+	{
+		memcpy(scratch, texels, sizeof(uint32_t) * width * height);
+	}
+
+	while (built && texture->level_count < TEXTURE_MAX_LEVELS)
+	{
+		built = swizzle_level(&texture->levels[texture->level_count], scratch, width, height);
+		texture->level_count++;
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
 
-upng_t* png_texture = NULL;
-uint32_t* mesh_texture = NULL;
+		downsample_texels(halved, scratch, width, height);
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
 
-void load_png_texture_data(const char* filename)
+		uint32_t* swap = scratch;
+		scratch = halved;
+		halved = swap;
+	}
+
+	free(scratch);
+	free(halved);
+	if (!built)
+	{
+		free_texture(texture);
+	}
+	return built;
+}
+
+/* Function to decode a PNG file into the levels of a mipmap chain, swizzled into the tiled layout, returns false if it cannot be loaded */
+bool load_png_texture_data(texture_t* texture, const char* filename)
 {
-    png_texture = upng_new_from_file(filename);
+	memset(texture, 0, sizeof(texture_t));
+
+	// The decoded image is only needed until it is swizzled into the levels
+	upng_t* png_texture = upng_new_from_file(filename);
 	if (png_texture != NULL)
 	{
 		upng_decode(png_texture);
 		if (upng_get_error(png_texture) == UPNG_EOK)
 		{
-			tex_width = upng_get_width(png_texture);
-			tex_height = upng_get_height(png_texture);
-			mesh_texture = (uint32_t*)upng_get_buffer(png_texture);
+			const uint32_t* texels = (const uint32_t*)upng_get_buffer(png_texture);
+			if (!build_texture_levels(texture, texels, upng_get_width(png_texture), upng_get_height(png_texture)))
+			{
+				fprintf(stderr, "Error allocating the texture.\n");
+			}
 		}
+		upng_free(png_texture);
+	}
+	return texture->level_count > 0;
+}
+
+/* Function to pick the mipmap level of a triangle from twice its area in texture coordinates and on the screen */
+int texture_select_level(const texture_t* texture, float uv_area, float screen_area)
+{
+	if (texture->level_count == 0 || !(screen_area > 0.0f))
+	{
+		return 0;
+	}
+
+	// Texels covered per pixel, every level covers a quarter of the texels of the one before it
+	float texels_per_pixel = uv_area * texture->levels[0].width * texture->levels[0].height / screen_area;
+
+	// The level where a texel is at least as large as a pixel on average, rounded toward the sharper level
+	int level = 0;
+	while (texels_per_pixel >= 4.0f && level < texture->level_count - 1)
+	{
+		texels_per_pixel *= 0.25f;
+		level++;
+	}
+	return level;
+}
+
+/* Function to free the mipmap chain */
+void free_texture(texture_t* texture)
+{
+	for (int i = 0; i < texture->level_count; i++)
+	{
+		free(texture->levels[i].texels);
+		free(texture->levels[i].column_offsets);
+		free(texture->levels[i].row_offsets);
 	}
+	memset(texture, 0, sizeof(texture_t));
 }
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <SDL.h>
+#include "display.h"
+#include "tiles.h"
+#include "stats.h"
+
+/* Tile grid covering the color buffer */
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+static int num_tiles = 0;
+
+/* Binned triangle indices, tile t owns tile_triangles[tile_offsets[t]] up to tile_triangles[tile_offsets[t + 1]] */
+static int* tile_offsets = NULL;
+static int* tile_triangles = NULL;
+static int tile_triangles_capacity = 0;
+
+/* Pixels tested and written in every tile, only the thread rasterizing a tile touches its counts */
+static pixel_counts_t* tile_pixel_counts = NULL;
+
+/* Worker pool, the calling thread also rasterizes so there is one worker less than threads */
+static SDL_Thread** workers = NULL;
+static int num_workers = 0;
+static SDL_sem* work_ready = NULL;
+static SDL_sem* work_done = NULL;
+static SDL_atomic_t next_tile;
+static bool workers_quit = false;
+
+/* Work of the current dispatch, run once for every tile */
+static void (*job_function)(int tile) = NULL;
+static tile_job_t job_callback = NULL;
+
+/* Triangles of the frame that is being rasterized */
+static const triangle_t* job_triangles = NULL;
+static enum tile_shading job_shading = TILE_SHADE_FLAT;
+
+/* Finds the range of tiles overlapped by the bounding box of a triangle, returns false if it is off-screen */
+static bool triangle_tile_bounds(const triangle_t* triangle, int* min_tx, int* min_ty, int* max_tx, int* max_ty)
+{
+	// Truncate like the rasterizer does, clamping in float first so huge coordinates stay representable
+	float min_x = fminf(fminf(triangle->points[0].x, triangle->points[1].x), triangle->points[2].x);
+	float min_y = fminf(fminf(triangle->points[0].y, triangle->points[1].y), triangle->points[2].y);
+	float max_x = fmaxf(fmaxf(triangle->points[0].x, triangle->points[1].x), triangle->points[2].x);
+	float max_y = fmaxf(fmaxf(triangle->points[0].y, triangle->points[1].y), triangle->points[2].y);
+
+	if (max_x < 0.0f || max_y < 0.0f || min_x >= render_target.width || min_y >= render_target.height)
+	{
+		return false;
+	}
+
+	*min_tx = (int)fmaxf(min_x, 0.0f) / TILE_SIZE;
+	*min_ty = (int)fmaxf(min_y, 0.0f) / TILE_SIZE;
+	*max_tx = (int)fminf(max_x, (float)(render_target.width - 1)) / TILE_SIZE;
+	*max_ty = (int)fminf(max_y, (float)(render_target.height - 1)) / TILE_SIZE;
+	return true;
+}
+
+/* Sorts the triangle indices by tile with a counting pass, keeping the submission order inside each tile,
+   returns false if the bins cannot grow to hold them */
+static bool bin_triangles(const triangle_t* triangles, int num_triangles)
+{
+	int min_tx, min_ty, max_tx, max_ty;
+
+	for (int t = 0; t <= num_tiles; t++)
+	{
+		tile_offsets[t] = 0;
+	}
+
+	// Count the triangles of each tile, shifted by one so the prefix sum gives the start offsets
+	for (int i = 0; i < num_triangles; i++)
+	{
+		if (!triangle_tile_bounds(&triangles[i], &min_tx, &min_ty, &max_tx, &max_ty))
+		{
+			continue;
+		}
+		for (int ty = min_ty; ty <= max_ty; ty++)
+		{
+			for (int tx = min_tx; tx <= max_tx; tx++)
+			{
+				tile_offsets[(ty * num_tiles_x) + tx + 1]++;
+			}
+		}
+	}
+
+	for (int t = 0; t < num_tiles; t++)
+	{
+		tile_offsets[t + 1] += tile_offsets[t];
+	}
+
+	if (tile_offsets[num_tiles] > tile_triangles_capacity)
+	{
+		int capacity = tile_offsets[num_tiles] * 2;
+		int* grown = (int*)realloc(tile_triangles, sizeof(int) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the tile bins.\n");
+			return false;
+		}
+		tile_triangles = grown;
+		tile_triangles_capacity = capacity;
+	}
+
+	// Scatter the indices, using the offsets as write cursors and restoring them afterwards
+	for (int i = 0; i < num_triangles; i++)
+	{
+		if (!triangle_tile_bounds(&triangles[i], &min_tx, &min_ty, &max_tx, &max_ty))
+		{
+			continue;
+		}
+		for (int ty = min_ty; ty <= max_ty; ty++)
+		{
+			for (int tx = min_tx; tx <= max_tx; tx++)
+			{
+				tile_triangles[tile_offsets[(ty * num_tiles_x) + tx]++] = i;
+			}
+		}
+	}
+
+	for (int t = num_tiles; t > 0; t--)
+	{
+		tile_offsets[t] = tile_offsets[t - 1];
+	}
+	tile_offsets[0] = 0;
+	return true;
+}
+
+/* Returns the pixels covered by a tile */
+static rect_t tile_rect(int tile)
+{
+	int tile_x = (tile % num_tiles_x) * TILE_SIZE;
+	int tile_y = (tile / num_tiles_x) * TILE_SIZE;
+
+	rect_t rect = {
+		.min_x = tile_x,
+		.min_y = tile_y,
+		.max_x = (tile_x + TILE_SIZE < render_target.width) ? tile_x + TILE_SIZE - 1 : render_target.width - 1,
+		.max_y = (tile_y + TILE_SIZE < render_target.height) ? tile_y + TILE_SIZE - 1 : render_target.height - 1
+	};
+	return rect;
+}
+
+/* Rasterizes every triangle binned into a tile, clipped to the pixels of that tile */
+static void rasterize_tile(int tile)
+{
+	rect_t clip = tile_rect(tile);
+	pixel_counts_t* counts = &tile_pixel_counts[tile];
+
+	for (int i = tile_offsets[tile]; i < tile_offsets[tile + 1]; i++)
+	{
+		const triangle_t* triangle = &job_triangles[tile_triangles[i]];
+
+		if (job_shading == TILE_SHADE_TEXTURED)
+		{
+			draw_textured_triangle_clipped(
+				triangle->points[0].x, triangle->points[0].y, triangle->points[0].z, triangle->points[0].w, triangle->texcoords[0].u, triangle->texcoords[0].v,
+				triangle->points[1].x, triangle->points[1].y, triangle->points[1].z, triangle->points[1].w, triangle->texcoords[1].u, triangle->texcoords[1].v,
+				triangle->points[2].x, triangle->points[2].y, triangle->points[2].z, triangle->points[2].w, triangle->texcoords[2].u, triangle->texcoords[2].v,
+				triangle->texture, clip, counts
+			);
+		}
+		else
+		{
+			draw_filled_triangle_clipped(
+				triangle->points[0].x, triangle->points[0].y, triangle->points[0].z, triangle->points[0].w,
+				triangle->points[1].x, triangle->points[1].y, triangle->points[1].z, triangle->points[1].w,
+				triangle->points[2].x, triangle->points[2].y, triangle->points[2].z, triangle->points[2].w,
+				// Triangle ids start at 1 so that 0 can mark empty pixels
+				(job_shading == TILE_SHADE_TRIANGLE_ID) ? (uint32_t)tile_triangles[i] + 1 : triangle->color, clip, counts
+			);
+		}
+	}
+}
+
+/* Skips the tiles no triangle was binned into */
+static void rasterize_binned_tile(int tile)
+{
+	if (tile_offsets[tile] != tile_offsets[tile + 1])
+	{
+		rasterize_tile(tile);
+	}
+}
+
+/* Hands the pixel rectangle of a tile to the callback of tiles_for_each */
+static void run_tile_callback(int tile)
+{
+	job_callback(tile_rect(tile));
+}
+
+/* Claims tiles until there are none left, a tile is only ever touched by the thread that claimed it */
+static void run_tiles(void)
+{
+	int tile;
+	while ((tile = SDL_AtomicAdd(&next_tile, 1)) < num_tiles)
+	{
+		job_function(tile);
+	}
+}
+
+/* Runs the job on every tile with the worker pool and the calling thread, returning when all are done */
+static void dispatch_tiles(void (*function)(int tile))
+{
+	job_function = function;
+	SDL_AtomicSet(&next_tile, 0);
+
+	for (int i = 0; i < num_workers; i++)
+	{
+		SDL_SemPost(work_ready);
+	}
+
+	run_tiles();
+
+	for (int i = 0; i < num_workers; i++)
+	{
+		SDL_SemWait(work_done);
+	}
+}
+
+static int worker_main(void* data)
+{
+	(void)data;
+
+	for (;;)
+	{
+		SDL_SemWait(work_ready);
+		if (workers_quit)
+		{
+			break;
+		}
+		run_tiles();
+		SDL_SemPost(work_done);
+	}
+	return 0;
+}
+
+/* Function to create the tile grid and the rasterizer worker threads (0 picks one per CPU core) */
+bool tiles_init(int num_threads)
+{
+	num_tiles_x = (render_target.width + TILE_SIZE - 1) / TILE_SIZE;
+	num_tiles_y = (render_target.height + TILE_SIZE - 1) / TILE_SIZE;
+	num_tiles = num_tiles_x * num_tiles_y;
+
+	tile_offsets = (int*)malloc(sizeof(int) * (num_tiles + 1));
+	tile_pixel_counts = (pixel_counts_t*)malloc(sizeof(pixel_counts_t) * num_tiles);
+	if (!tile_offsets || !tile_pixel_counts)
+	{
+		fprintf(stderr, "Error allocating the tile bins.\n");
+		return false;
+	}
+
+	if (num_threads <= 0)
+	{
+		num_threads = SDL_GetCPUCount();
+	}
+
+	// Without the semaphores the calling thread could not wait for the workers, and would read tiles they are still drawing
+	work_ready = SDL_CreateSemaphore(0);
+	work_done = SDL_CreateSemaphore(0);
+	if (!work_ready || !work_done)
+	{
+		fprintf(stderr, "Error creating the tile semaphores.\n");
+		return false;
+	}
+	workers_quit = false;
+
+	num_workers = 0;
+	workers = (SDL_Thread**)malloc(sizeof(SDL_Thread*) * num_threads);
+	if (!workers)
+	{
+		fprintf(stderr, "Error allocating the tile workers.\n");
+		return false;
+	}
+	for (int i = 0; i < num_threads - 1; i++)
+	{
+		workers[num_workers] = SDL_CreateThread(worker_main, "tile_worker", NULL);
+		if (!workers[num_workers])
+		{
+			// Keep going with the threads we got, the calling thread can always do all the work
+			fprintf(stderr, "Error creating tile worker thread.\n");
+			break;
+		}
+		num_workers++;
+	}
+
+	return true;
+}
+
+/* Function to bin the triangles into screen tiles and rasterize the tiles in parallel */
+void tiles_render_triangles(const triangle_t* triangles, int num_triangles, enum tile_shading shading)
+{
+	// Without room for the bins the triangles of this frame are dropped, the next frame tries again
+	if (!bin_triangles(triangles, num_triangles))
+	{
+		return;
+	}
+
+	job_triangles = triangles;
+	job_shading = shading;
+	for (int t = 0; t < num_tiles; t++)
+	{
+		tile_pixel_counts[t].tested = 0;
+		tile_pixel_counts[t].written = 0;
+	}
+	dispatch_tiles(rasterize_binned_tile);
+
+	// Sum the pixels of all tiles once every thread is done with them
+	uint64_t tested = 0;
+	uint64_t written = 0;
+	for (int t = 0; t < num_tiles; t++)
+	{
+		tested += tile_pixel_counts[t].tested;
+		written += tile_pixel_counts[t].written;
+	}
+	stats_add_count(COUNTER_TRIANGLES_RASTERIZED, num_triangles);
+	stats_add_count(COUNTER_PIXELS_TESTED, tested);
+	stats_add_count(COUNTER_PIXELS_WRITTEN, written);
+}
+
+/* Function to run a job on the pixels of every tile in parallel */
+void tiles_for_each(tile_job_t job)
+{
+	job_callback = job;
+	dispatch_tiles(run_tile_callback);
+}
+
+/* Function to stop the worker threads and free the tile bins */
+void tiles_destroy(void)
+{
+	workers_quit = true;
+	for (int i = 0; i < num_workers; i++)
+	{
+		SDL_SemPost(work_ready);
+	}
+	for (int i = 0; i < num_workers; i++)
+	{
+		SDL_WaitThread(workers[i], NULL);
+	}
+
+	free(workers);
+	free(tile_offsets);
+	free(tile_triangles);
+	free(tile_pixel_counts);
+	workers = NULL;
+	tile_offsets = NULL;
+	tile_triangles = NULL;
+	tile_pixel_counts = NULL;
+	tile_triangles_capacity = 0;
+	num_workers = 0;
+
+	SDL_DestroySemaphore(work_ready);
+	SDL_DestroySemaphore(work_done);
+	work_ready = NULL;
+	work_done = NULL;
+}
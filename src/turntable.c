@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+#include "display.h"
+#include "scene.h"
+#include "pipeline.h"
+#include "stream.h"
+
+/*
+ * Renders a model turning once around its vertical axis and streams the frames out as they are rendered:
+ *   3D-Renderer-turntable model.obj texture.png output [width height render_mode frames frames_per_second]
+ * An output ending in .ppm is written as PPM images, anything else as Y4M, and - writes Y4M to stdout, so
+ *   3D-Renderer-turntable crab.obj crab.png - | ffmpeg -i - crab.mp4
+ * encodes the turntable without ever showing a window. The animation steps by a fixed time per frame
+ * instead of the wall clock, so it renders as fast as it can and every run gives the same frames.
+ */
+
+/* Where the model is placed, the same as the windowed renderer */
+#define MODEL_DISTANCE 5.0f
+
+/* Function to pose the model at a frame of the animation: a full turn over all frames, with a slight tilt towards the camera */
+static void animate(scene_instance_t* model, int frame, int frames, int frames_per_second)
+{
+	float seconds = (float)frame / (float)frames_per_second;
+	float turn_speed = 2.0f * (float)M_PI * (float)frames_per_second / (float)frames;
+
+	model->rotation.x = 0.3f;
+	model->rotation.y = turn_speed * seconds;
+	model->translation.z = MODEL_DISTANCE;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s model.obj texture.png output [width height render_mode frames frames_per_second]\n", argv[0]);
+		return 1;
+	}
+
+	int width = (argc > 4) ? atoi(argv[4]) : 800;
+	int height = (argc > 5) ? atoi(argv[5]) : 600;
+	int mode = (argc > 6) ? atoi(argv[6]) : RENDER_TEXTURED;
+	int frames = (argc > 7) ? atoi(argv[7]) : 120;
+	int frames_per_second = (argc > 8) ? atoi(argv[8]) : 30;
+	if (width <= 0 || height <= 0 || mode < 0 || mode >= RENDER_MODE_COUNT || frames <= 0 || frames_per_second <= 0)
+	{
+		fprintf(stderr, "Invalid size, render mode, frame count or frame rate.\n");
+		return 1;
+	}
+
+	const char* output = argv[3];
+	size_t length = strlen(output);
+	enum stream_format format = (length > 4 && strcmp(output + length - 4, ".ppm") == 0) ? STREAM_PPM : STREAM_Y4M;
+
+	if (!pipeline_init(width, height, DEPTH_FLOAT32, false) || scene_add_instance(scene_load_asset(argv[1], argv[2])) < 0 || !stream_open(output, format, frames_per_second))
+	{
+		pipeline_destroy();
+		scene_destroy();
+		return 1;
+	}
+
+	render_mode = (enum render_mode)mode;
+	culling_mode = CULLING_BACKFACE;
+
+	bool written = true;
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < frames && written; frame++)
+	{
+		animate(&scene.instances[0], frame, frames, frames_per_second);
+		scene_instance_moved(0);
+		pipeline_update();
+		pipeline_render();
+		written = stream_write_frame();
+	}
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	written = stream_close() && written;
+
+	// stdout may be the stream, so the summary goes to stderr
+	if (written)
+	{
+		fprintf(stderr, "%d frames of %dx%d in render mode %d: %.3f ms per frame, %.1f times real time\n",
+			frames, width, height, mode, seconds * 1000.0 / frames, (double)frames / frames_per_second / seconds);
+	}
+
+	pipeline_destroy();
+	scene_destroy();
+	return written ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vertex.h"
+
+vertex_kernel_t vertex_transform_kernel = vertex_transform_scalar;
+
+/* Number of elements of an array padded to a whole batch */
+static int padded_count(int count)
+{
+	return (count + VERTEX_BATCH - 1) / VERTEX_BATCH * VERTEX_BATCH;
+}
+
+/* Allocates zeroed memory for arrays, returns the first address of it on VERTEX_ALIGNMENT, *memory is what has to be freed */
+static uint8_t* allocate_aligned(void** memory, size_t bytes)
+{
+	*memory = calloc(bytes + VERTEX_ALIGNMENT - 1, 1);
+	if (!*memory)
+	{
+		return NULL;
+	}
+	uintptr_t address = ((uintptr_t)*memory + VERTEX_ALIGNMENT - 1) & ~(uintptr_t)(VERTEX_ALIGNMENT - 1);
+	return (uint8_t*)address;
+}
+
+/* Function to copy positions into a vertex buffer, replacing what it held */
+bool vertex_buffer_init(vertex_buffer_t* buffer, const vec3_t* positions, int count)
+{
+	vertex_buffer_destroy(buffer);
+
+	// The arrays are a whole number of batches long, so every one of them stays aligned
+	int padded = padded_count(count);
+	float* arrays = (float*)allocate_aligned(&buffer->memory, sizeof(float) * 3 * (padded > 0 ? padded : VERTEX_BATCH));
+	if (!arrays)
+	{
+		fprintf(stderr, "Error allocating the vertex buffer.\n");
+		return false;
+	}
+
+	buffer->x = arrays;
+	buffer->y = arrays + padded;
+	buffer->z = arrays + 2 * padded;
+	buffer->count = count;
+	for (int i = 0; i < count; i++)
+	{
+		buffer->x[i] = positions[i].x;
+		buffer->y[i] = positions[i].y;
+		buffer->z[i] = positions[i].z;
+	}
+	return true;
+}
+
+/* Function to free the arrays of a vertex buffer */
+void vertex_buffer_destroy(vertex_buffer_t* buffer)
+{
+	free(buffer->memory);
+	memset(buffer, 0, sizeof(vertex_buffer_t));
+}
+
+/* Function to make room for transforming count vertices, keeps the arrays when they are large enough */
+bool transformed_vertices_reserve(transformed_vertices_t* transformed, int count)
+{
+	if (count <= transformed->capacity && transformed->memory)
+	{
+		return true;
+	}
+	transformed_vertices_destroy(transformed);
+
+	// Grow by half again, so a mesh growing a little every frame does not reallocate every frame
+	int padded = padded_count(count + count / 2);
+	padded = (padded > 0) ? padded : VERTEX_BATCH;
+	float* arrays = (float*)allocate_aligned(&transformed->memory, (sizeof(float) * 7 + sizeof(uint8_t)) * padded);
+	if (!arrays)
+	{
+		fprintf(stderr, "Error allocating the transformed vertices.\n");
+		return false;
+	}
+
+	transformed->view_x = arrays;
+	transformed->view_y = arrays + padded;
+	transformed->view_z = arrays + 2 * padded;
+	transformed->clip_x = arrays + 3 * padded;
+	transformed->clip_y = arrays + 4 * padded;
+	transformed->clip_z = arrays + 5 * padded;
+	transformed->clip_w = arrays + 6 * padded;
+	transformed->outcodes = (uint8_t*)(arrays + 7 * padded);
+	transformed->capacity = padded;
+	return true;
+}
+
+/* Function to free the arrays of transformed vertices */
+void transformed_vertices_destroy(transformed_vertices_t* transformed)
+{
+	free(transformed->memory);
+	memset(transformed, 0, sizeof(transformed_vertices_t));
+}
+
+/* Function to transform every vertex of a buffer, transformed has to have room for them */
+void vertex_transform(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed)
+{
+	vertex_transform_kernel(vertices, world_view, projection, transformed);
+}
+
+/* Function to switch the vertex kernel, falls back to narrower ones the CPU cannot run */
+enum raster_isa vertex_select_isa(enum raster_isa isa)
+{
+	enum raster_isa supported = rasterizer_detect_isa();
+	if (isa > supported)
+	{
+		isa = supported;
+	}
+
+	switch (isa)
+	{
+#ifdef RASTERIZER_X86
+	case RASTER_ISA_AVX2:
+		vertex_transform_kernel = vertex_transform_avx2;
+		break;
+	case RASTER_ISA_SSE2:
+		vertex_transform_kernel = vertex_transform_sse2;
+		break;
+#endif
+	default:
+		isa = RASTER_ISA_SCALAR;
+		vertex_transform_kernel = vertex_transform_scalar;
+		break;
+	}
+
+	return isa;
+}
+
+/*
+ * Scalar kernel. The world-view matrix is affine, so camera space w is always 1.
+ * The products are summed in the same order as mat4_mul_vec4, so every kernel gives the same bits as it.
+ */
+void vertex_transform_scalar(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed)
+{
+	const float (*m)[4] = world_view->m;
+	const float (*p)[4] = projection->m;
+	for (int i = 0; i < vertices->count; i++)
+	{
+		float x = vertices->x[i];
+		float y = vertices->y[i];
+		float z = vertices->z[i];
+
+		float view_x = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+		float view_y = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+		float view_z = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+
+		float clip_x = p[0][0] * view_x + p[0][1] * view_y + p[0][2] * view_z + p[0][3];
+		float clip_y = p[1][0] * view_x + p[1][1] * view_y + p[1][2] * view_z + p[1][3];
+		float clip_z = p[2][0] * view_x + p[2][1] * view_y + p[2][2] * view_z + p[2][3];
+		float clip_w = p[3][0] * view_x + p[3][1] * view_y + p[3][2] * view_z + p[3][3];
+
+		transformed->view_x[i] = view_x;
+		transformed->view_y[i] = view_y;
+		transformed->view_z[i] = view_z;
+		transformed->clip_x[i] = clip_x;
+		transformed->clip_y[i] = clip_y;
+		transformed->clip_z[i] = clip_z;
+		transformed->clip_w[i] = clip_w;
+		transformed->outcodes[i] = (uint8_t)(
+			(clip_x < -clip_w ? OUTCODE_LEFT : 0) |
+			(clip_x > clip_w ? OUTCODE_RIGHT : 0) |
+			(clip_y < -clip_w ? OUTCODE_BOTTOM : 0) |
+			(clip_y > clip_w ? OUTCODE_TOP : 0) |
+			(clip_z < 0.0f ? OUTCODE_NEAR : 0) |
+			(clip_z > clip_w ? OUTCODE_FAR : 0));
+	}
+}
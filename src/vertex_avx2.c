@@ -0,0 +1,64 @@
+#include "vertex.h"
+
+#ifdef RASTERIZER_X86
+
+#include <immintrin.h>
+
+/* Row of a matrix times 8 positions, summed in the same order as mat4_mul_vec4 with w = 1 */
+static __m256 transform_row_avx2(const float row[4], __m256 x, __m256 y, __m256 z)
+{
+	__m256 sum = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row[0]), x), _mm256_mul_ps(_mm256_set1_ps(row[1]), y));
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(row[2]), z));
+	return _mm256_add_ps(sum, _mm256_set1_ps(row[3]));
+}
+
+/* Outcode bits of the lanes whose mask is set */
+static __m256i outcode_bits_avx2(__m256 mask, int bit)
+{
+	return _mm256_and_si256(_mm256_castps_si256(mask), _mm256_set1_epi32(bit));
+}
+
+/* Function to transform every vertex of a buffer 8 at a time, the padding of the arrays is transformed along */
+void vertex_transform_avx2(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed)
+{
+	const float (*m)[4] = world_view->m;
+	const float (*p)[4] = projection->m;
+	const __m256 zero = _mm256_setzero_ps();
+	for (int i = 0; i < vertices->count; i += 8)
+	{
+		__m256 x = _mm256_load_ps(&vertices->x[i]);
+		__m256 y = _mm256_load_ps(&vertices->y[i]);
+		__m256 z = _mm256_load_ps(&vertices->z[i]);
+
+		__m256 view_x = transform_row_avx2(m[0], x, y, z);
+		__m256 view_y = transform_row_avx2(m[1], x, y, z);
+		__m256 view_z = transform_row_avx2(m[2], x, y, z);
+
+		__m256 clip_x = transform_row_avx2(p[0], view_x, view_y, view_z);
+		__m256 clip_y = transform_row_avx2(p[1], view_x, view_y, view_z);
+		__m256 clip_z = transform_row_avx2(p[2], view_x, view_y, view_z);
+		__m256 clip_w = transform_row_avx2(p[3], view_x, view_y, view_z);
+		__m256 negative_w = _mm256_sub_ps(zero, clip_w);
+
+		_mm256_store_ps(&transformed->view_x[i], view_x);
+		_mm256_store_ps(&transformed->view_y[i], view_y);
+		_mm256_store_ps(&transformed->view_z[i], view_z);
+		_mm256_store_ps(&transformed->clip_x[i], clip_x);
+		_mm256_store_ps(&transformed->clip_y[i], clip_y);
+		_mm256_store_ps(&transformed->clip_z[i], clip_z);
+		_mm256_store_ps(&transformed->clip_w[i], clip_w);
+
+		__m256i outcodes = outcode_bits_avx2(_mm256_cmp_ps(clip_x, negative_w, _CMP_LT_OQ), OUTCODE_LEFT);
+		outcodes = _mm256_or_si256(outcodes, outcode_bits_avx2(_mm256_cmp_ps(clip_x, clip_w, _CMP_GT_OQ), OUTCODE_RIGHT));
+		outcodes = _mm256_or_si256(outcodes, outcode_bits_avx2(_mm256_cmp_ps(clip_y, negative_w, _CMP_LT_OQ), OUTCODE_BOTTOM));
+		outcodes = _mm256_or_si256(outcodes, outcode_bits_avx2(_mm256_cmp_ps(clip_y, clip_w, _CMP_GT_OQ), OUTCODE_TOP));
+		outcodes = _mm256_or_si256(outcodes, outcode_bits_avx2(_mm256_cmp_ps(clip_z, zero, _CMP_LT_OQ), OUTCODE_NEAR));
+		outcodes = _mm256_or_si256(outcodes, outcode_bits_avx2(_mm256_cmp_ps(clip_z, clip_w, _CMP_GT_OQ), OUTCODE_FAR));
+
+		// Narrow the 32 bit lanes to bytes, the codes fit in 6 bits so the saturation never kicks in
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(outcodes), _mm256_extracti128_si256(outcodes, 1));
+		_mm_storel_epi64((__m128i*)&transformed->outcodes[i], _mm_packus_epi16(words, words));
+	}
+}
+
+#endif
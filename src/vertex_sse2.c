@@ -0,0 +1,67 @@
+#include "vertex.h"
+
+#ifdef RASTERIZER_X86
+
+#include <string.h>
+#include <emmintrin.h>
+
+/* Row of a matrix times 4 positions, summed in the same order as mat4_mul_vec4 with w = 1 */
+static __m128 transform_row_sse2(const float row[4], __m128 x, __m128 y, __m128 z)
+{
+	__m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[0]), x), _mm_mul_ps(_mm_set1_ps(row[1]), y));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[2]), z));
+	return _mm_add_ps(sum, _mm_set1_ps(row[3]));
+}
+
+/* Outcode bits of the lanes whose mask is set */
+static __m128i outcode_bits_sse2(__m128 mask, int bit)
+{
+	return _mm_and_si128(_mm_castps_si128(mask), _mm_set1_epi32(bit));
+}
+
+/* Function to transform every vertex of a buffer 4 at a time, the padding of the arrays is transformed along */
+void vertex_transform_sse2(const vertex_buffer_t* vertices, const mat4_t* world_view, const mat4_t* projection, transformed_vertices_t* transformed)
+{
+	const float (*m)[4] = world_view->m;
+	const float (*p)[4] = projection->m;
+	const __m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < vertices->count; i += 4)
+	{
+		__m128 x = _mm_load_ps(&vertices->x[i]);
+		__m128 y = _mm_load_ps(&vertices->y[i]);
+		__m128 z = _mm_load_ps(&vertices->z[i]);
+
+		__m128 view_x = transform_row_sse2(m[0], x, y, z);
+		__m128 view_y = transform_row_sse2(m[1], x, y, z);
+		__m128 view_z = transform_row_sse2(m[2], x, y, z);
+
+		__m128 clip_x = transform_row_sse2(p[0], view_x, view_y, view_z);
+		__m128 clip_y = transform_row_sse2(p[1], view_x, view_y, view_z);
+		__m128 clip_z = transform_row_sse2(p[2], view_x, view_y, view_z);
+		__m128 clip_w = transform_row_sse2(p[3], view_x, view_y, view_z);
+		__m128 negative_w = _mm_sub_ps(zero, clip_w);
+
+		_mm_store_ps(&transformed->view_x[i], view_x);
+		_mm_store_ps(&transformed->view_y[i], view_y);
+		_mm_store_ps(&transformed->view_z[i], view_z);
+		_mm_store_ps(&transformed->clip_x[i], clip_x);
+		_mm_store_ps(&transformed->clip_y[i], clip_y);
+		_mm_store_ps(&transformed->clip_z[i], clip_z);
+		_mm_store_ps(&transformed->clip_w[i], clip_w);
+
+		__m128i outcodes = outcode_bits_sse2(_mm_cmplt_ps(clip_x, negative_w), OUTCODE_LEFT);
+		outcodes = _mm_or_si128(outcodes, outcode_bits_sse2(_mm_cmpgt_ps(clip_x, clip_w), OUTCODE_RIGHT));
+		outcodes = _mm_or_si128(outcodes, outcode_bits_sse2(_mm_cmplt_ps(clip_y, negative_w), OUTCODE_BOTTOM));
+		outcodes = _mm_or_si128(outcodes, outcode_bits_sse2(_mm_cmpgt_ps(clip_y, clip_w), OUTCODE_TOP));
+		outcodes = _mm_or_si128(outcodes, outcode_bits_sse2(_mm_cmplt_ps(clip_z, zero), OUTCODE_NEAR));
+		outcodes = _mm_or_si128(outcodes, outcode_bits_sse2(_mm_cmpgt_ps(clip_z, clip_w), OUTCODE_FAR));
+
+		// Narrow the 32 bit lanes to bytes, the codes fit in 6 bits so the saturation never kicks in
+		outcodes = _mm_packs_epi32(outcodes, outcodes);
+		outcodes = _mm_packus_epi16(outcodes, outcodes);
+		int packed = _mm_cvtsi128_si32(outcodes);
+		memcpy(&transformed->outcodes[i], &packed, 4);
+	}
+}
+
+#endif
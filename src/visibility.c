@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "light.h"
+#include "rasterizer.h"
+#include "texture.h"
+#include "tiles.h"
+#include "visibility.h"
+
+/* Id of the closest triangle of every pixel, 0 where nothing was drawn */
+static uint32_t* visibility_buffer = NULL;
+
+/* Attribute planes of every triangle, set up once per frame for the resolve pass */
+typedef struct
+{
+	int origin_x, origin_y;     /* pixel the planes are evaluated relative to */
+	attribute_plane_t reciprocal_w;
+	attribute_plane_t u_over_w;
+	attribute_plane_t v_over_w;
+	float light_intensity;
+	const texture_level_t* texture;
+} visible_triangle_t;
+
+static visible_triangle_t* visible_triangles = NULL;
+static int visible_triangles_capacity = 0;
+
+/* Function to allocate the triangle id buffer for the current window size */
+bool visibility_init(void)
+{
+	visibility_buffer = (uint32_t*)calloc((size_t)render_target.width * render_target.height, sizeof(uint32_t));
+	if (!visibility_buffer)
+	{
+		fprintf(stderr, "Error allocating the visibility buffer.\n");
+		return false;
+	}
+	return true;
+}
+
+/* Sets up the same perspective correct planes draw_textured_triangle would, once per triangle, returns false if they do not fit */
+static bool setup_visible_triangles(const triangle_t* triangles, int num_triangles)
+{
+	if (num_triangles > visible_triangles_capacity)
+	{
+		int capacity = num_triangles * 2;
+		visible_triangle_t* grown = (visible_triangle_t*)realloc(visible_triangles, sizeof(visible_triangle_t) * capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the visible triangles.\n");
+			return false;
+		}
+		visible_triangles = grown;
+		visible_triangles_capacity = capacity;
+	}
+
+	rect_t screen = { 0, 0, render_target.width - 1, render_target.height - 1 };
+
+	for (int i = 0; i < num_triangles; i++)
+	{
+		const triangle_t* triangle = &triangles[i];
+		visible_triangle_t* visible = &visible_triangles[i];
+
+		// Same sub-pixel set up as the draw functions, so the planes match the pixels in the id buffer
+		const vec4_t* points = triangle->points;
+
+		triangle_edges_t edges;
+		if (!setup_triangle_edges(&edges, points[0], points[1], points[2], screen))
+		{
+			// Triangles that cannot be rasterized never end up in the visibility buffer
+			continue;
+		}
+
+		float w0 = points[0].w;
+		float w1 = points[1].w;
+		float w2 = points[2].w;
+
+		/* Flip the V component to account for inverted UV-Coordinates (V grows downwards) */
+		float v0 = 1.0f - triangle->texcoords[0].v;
+		float v1 = 1.0f - triangle->texcoords[1].v;
+		float v2 = 1.0f - triangle->texcoords[2].v;
+
+		visible->origin_x = edges.min_x;
+		visible->origin_y = edges.min_y;
+		visible->reciprocal_w = setup_attribute_plane(&edges, 1.0f / w0, 1.0f / w1, 1.0f / w2);
+		visible->u_over_w = setup_attribute_plane(&edges, triangle->texcoords[0].u / w0, triangle->texcoords[1].u / w1, triangle->texcoords[2].u / w2);
+		visible->v_over_w = setup_attribute_plane(&edges, v0 / w0, v1 / w1, v2 / w2);
+		visible->light_intensity = triangle->light_intensity;
+		visible->texture = triangle->texture;
+	}
+	return true;
+}
+
+/* Textures and lights the visible pixels of a tile, clearing their ids for the next frame as it goes */
+static void resolve_tile(rect_t tile)
+{
+	for (int y = tile.min_y; y <= tile.max_y; y++)
+	{
+		uint32_t* id_row = &visibility_buffer[render_target.width * y];
+		uint32_t* color_row = &render_target.color_buffer[render_target.width * y];
+
+		for (int x = tile.min_x; x <= tile.max_x; x++)
+		{
+			uint32_t id = id_row[x];
+			if (id == 0)
+			{
+				continue;
+			}
+			id_row[x] = 0;
+
+			const visible_triangle_t* visible = &visible_triangles[id - 1];
+			float dx = (float)(x - visible->origin_x);
+			float dy = (float)(y - visible->origin_y);
+
+			float interpolated_reciprocal_w = visible->reciprocal_w.origin + visible->reciprocal_w.dx * dx + visible->reciprocal_w.dy * dy;
+			float u = (visible->u_over_w.origin + visible->u_over_w.dx * dx + visible->u_over_w.dy * dy) / interpolated_reciprocal_w;
+			float v = (visible->v_over_w.origin + visible->v_over_w.dx * dx + visible->v_over_w.dy * dy) / interpolated_reciprocal_w;
+
+			// Same addressing as the textured kernels, a mask for power of two levels
+			const texture_level_t* texture = visible->texture;
+			int tex_x = texture_wrap_coordinate((int)(u * texture->width), texture->width, texture->wrap);
+			int tex_y = texture_wrap_coordinate((int)(v * texture->height), texture->height, texture->wrap);
+
+			color_row[x] = light_apply_intensity(texture->texels[texel_index(texture, tex_x, tex_y)], visible->light_intensity);
+		}
+	}
+}
+
+/* Function to rasterize triangle ids and depth, then texture and light every visible pixel exactly once */
+void visibility_render(const triangle_t* triangles, int num_triangles)
+{
+	// First pass: the fill kernels write triangle ids into the visibility buffer instead of colors
+	uint32_t* frame_color_buffer = render_target.color_buffer;
+	render_target.color_buffer = visibility_buffer;
+	tiles_render_triangles(triangles, num_triangles, TILE_SHADE_TRIANGLE_ID);
+	render_target.color_buffer = frame_color_buffer;
+
+	// Second pass: only the pixels that survived the depth test pay for the texture and the lighting
+	if (!setup_visible_triangles(triangles, num_triangles))
+	{
+		// The ids still have to be cleared for the next frame, so resolve nothing and clear the whole buffer
+		memset(visibility_buffer, 0, sizeof(uint32_t) * render_target.width * render_target.height);
+		return;
+	}
+	tiles_for_each(resolve_tile);
+}
+
+/* Function to free the triangle id buffer */
+void visibility_destroy(void)
+{
+	free(visibility_buffer);
+	free(visible_triangles);
+	visibility_buffer = NULL;
+	visible_triangles = NULL;
+	visible_triangles_capacity = 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include "window.h"
+#include "render_target.h"
+#include "dirty.h"
+
+/* Global variables */
+SDL_Window* window = NULL;
+SDL_Renderer* renderer = NULL;
+SDL_Texture* color_buffer_texture = NULL;
+
+/* Function to initialize a borderless window covering the display, returns its size */
+bool initialize_window(int* width, int* height)
+{
+    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+    {
+        fprintf(stderr, "Error initializing SDL.\n");
+        return false;
+    }
+
+    /* Set width and height of the SDL window with the max screen resolution */
+    SDL_DisplayMode display_mode;
+    SDL_GetCurrentDisplayMode(0, &display_mode);
+    *width = display_mode.w;
+    *height = display_mode.h;
+
+    /* Create a SDL Window */
+    window = SDL_CreateWindow(
+        NULL,
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        *width,
+        *height,
+        SDL_WINDOW_BORDERLESS
+    );
+    if (!window)
+    {
+        fprintf(stderr, "Error creating SDL window.\n");
+        return false;
+    }
+
+    /* Create a SDL renderer */
+    renderer = SDL_CreateRenderer(window, -1, 0);
+    if (!renderer)
+    {
+        fprintf(stderr, "Error creating SDL renderer.\n");
+        return false;
+    }
+
+    /* Creating a SDL texture that is used to display the color buffer */
+    color_buffer_texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_RGBA32,
+        SDL_TEXTUREACCESS_STREAMING,
+        *width,
+        *height
+    );
+    if (!color_buffer_texture)
+    {
+        fprintf(stderr, "Error creating SDL texture.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* Uploads a changed rectangle of the color buffer to the streaming texture */
+static void upload_run(rect_t run)
+{
+	SDL_Rect rect = { run.min_x, run.min_y, run.max_x - run.min_x + 1, run.max_y - run.min_y + 1 };
+	SDL_UpdateTexture(color_buffer_texture, &rect, &render_target.color_buffer[(render_target.width * rect.y) + rect.x], (int)(render_target.width * sizeof(uint32_t)));
+}
+
+/* Function to render the color buffer of the render target */
+void render_color_buffer(void)
+{
+	// Only the tiles that changed since the last frame are uploaded
+	dirty_for_each_run(upload_run);
+    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+}
+
+/* Function to destroy the window */
+void destroy_window(void)
+{
+    SDL_DestroyTexture(color_buffer_texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
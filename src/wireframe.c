@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "display.h"
+#include "rasterizer.h"
+#include "wireframe.h"
+
+/* Instance whose faces are being marked, and the frame in which every one of its edges and vertices was last marked visible,
+   so nothing has to be cleared between instances */
+static const wireframe_t* current_wireframe = NULL;
+static uint32_t* edge_marks = NULL;
+static uint32_t* vertex_marks = NULL;
+static int edge_marks_capacity = 0;
+static int vertex_marks_capacity = 0;
+static uint32_t current_mark = 0;
+
+/* Projected screen position of every vertex of the current instance, valid for the vertices marked for it */
+static vec4_t* screen_vertices = NULL;
+
+/* Lines and vertices of every instance drawn this frame */
+typedef struct
+{
+	vec4_t a, b;
+} wire_line_t;
+
+static wire_line_t* frame_lines = NULL;
+static int num_frame_lines = 0;
+static int frame_lines_capacity = 0;
+static vec4_t* frame_points = NULL;
+static int num_frame_points = 0;
+static int frame_points_capacity = 0;
+
+/* Edge of a face before deduplication, keyed by its vertices in ascending order */
+typedef struct
+{
+	uint64_t key;
+	int face_edge;  /* face index * 3 + edge index */
+} face_edge_key_t;
+
+/* Orders face edges by their vertex pair */
+static int compare_face_edge_keys(const void* a, const void* b)
+{
+	uint64_t key_a = ((const face_edge_key_t*)a)->key;
+	uint64_t key_b = ((const face_edge_key_t*)b)->key;
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+/* Function to build the unique edges of a mesh, call it again whenever the mesh is reloaded */
+bool wireframe_init(wireframe_t* wireframe, const face_t* faces, int num_faces, int num_vertices)
+{
+	memset(wireframe, 0, sizeof(wireframe_t));
+
+	int num_face_edges = num_faces * 3;
+	face_edge_key_t* keys = (face_edge_key_t*)malloc(sizeof(face_edge_key_t) * (num_face_edges + 1));
+	wireframe->face_edges = (int*)malloc(sizeof(int) * (num_face_edges + 1));
+	wireframe->face_vertices = (int*)malloc(sizeof(int) * (num_face_edges + 1));
+	wireframe->edges = (wire_edge_t*)malloc(sizeof(wire_edge_t) * (num_face_edges + 1));
+	if (!keys || !wireframe->face_edges || !wireframe->face_vertices || !wireframe->edges)
+	{
+		fprintf(stderr, "Error allocating the wireframe edges.\n");
+		free(keys);
+		wireframe_free(wireframe);
+		return false;
+	}
+	wireframe->num_vertices = num_vertices;
+
+	for (int i = 0; i < num_faces; i++)
+	{
+		int vertices[3] = { faces[i].a, faces[i].b, faces[i].c };
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t from = (uint32_t)vertices[j];
+			uint32_t to = (uint32_t)vertices[(j + 1) % 3];
+			keys[i * 3 + j].key = (from < to) ? ((uint64_t)from << 32) | to : ((uint64_t)to << 32) | from;
+			keys[i * 3 + j].face_edge = i * 3 + j;
+			wireframe->face_vertices[i * 3 + j] = vertices[j];
+		}
+	}
+
+	// Sorting brings the copies of every shared edge next to each other
+	qsort(keys, num_face_edges, sizeof(face_edge_key_t), compare_face_edge_keys);
+
+	int num_edges = 0;
+	for (int i = 0; i < num_face_edges; i++)
+	{
+		if (i == 0 || keys[i].key != keys[i - 1].key)
+		{
+			wireframe->edges[num_edges].a = (int)(keys[i].key >> 32);
+			wireframe->edges[num_edges].b = (int)(keys[i].key & 0xFFFFFFFF);
+			num_edges++;
+		}
+		wireframe->face_edges[keys[i].face_edge] = num_edges - 1;
+	}
+	wireframe->num_edges = num_edges;
+	free(keys);
+	return true;
+}
+
+/* Function to free the edge lists of a mesh */
+void wireframe_free(wireframe_t* wireframe)
+{
+	free(wireframe->edges);
+	free(wireframe->face_edges);
+	free(wireframe->face_vertices);
+	memset(wireframe, 0, sizeof(wireframe_t));
+}
+
+/* Function to start a new frame, forgetting the lines of the previous one */
+void wireframe_begin_frame(void)
+{
+	num_frame_lines = 0;
+	num_frame_points = 0;
+	current_wireframe = NULL;
+}
+
+/* Grows a mark array to hold count entries, the new marks start out unmarked */
+static bool reserve_marks(uint32_t** marks, int* capacity, int count)
+{
+	if (count <= *capacity)
+	{
+		return true;
+	}
+	uint32_t* grown = (uint32_t*)realloc(*marks, sizeof(uint32_t) * count);
+	if (!grown)
+	{
+		return false;
+	}
+	memset(grown + *capacity, 0, sizeof(uint32_t) * (count - *capacity));
+	*marks = grown;
+	*capacity = count;
+	return true;
+}
+
+/* Function to start collecting the visible faces of one instance of a mesh */
+bool wireframe_begin_instance(const wireframe_t* wireframe)
+{
+	current_wireframe = NULL;
+	int vertices_before = vertex_marks_capacity;
+	if (!reserve_marks(&edge_marks, &edge_marks_capacity, wireframe->num_edges + 1) ||
+		!reserve_marks(&vertex_marks, &vertex_marks_capacity, wireframe->num_vertices + 1))
+	{
+		fprintf(stderr, "Error allocating the wireframe marks.\n");
+		return false;
+	}
+	if (vertex_marks_capacity > vertices_before || !screen_vertices)
+	{
+		vec4_t* grown = (vec4_t*)realloc(screen_vertices, sizeof(vec4_t) * vertex_marks_capacity);
+		if (!grown)
+		{
+			fprintf(stderr, "Error allocating the wireframe marks.\n");
+			return false;
+		}
+		screen_vertices = grown;
+	}
+
+	current_mark++;
+
+	// Once the counter wraps around, stale marks could look current again
+	if (current_mark == 0)
+	{
+		memset(edge_marks, 0, sizeof(uint32_t) * edge_marks_capacity);
+		memset(vertex_marks, 0, sizeof(uint32_t) * vertex_marks_capacity);
+		current_mark = 1;
+	}
+
+	current_wireframe = wireframe;
+	return true;
+}
+
+/* Function to mark a face of the current instance as visible this frame, with its three projected screen points */
+void wireframe_add_face(int face_index, const vec4_t projected_points[3])
+{
+	if (!current_wireframe)
+	{
+		return;
+	}
+
+	for (int j = 0; j < 3; j++)
+	{
+		int vertex = current_wireframe->face_vertices[face_index * 3 + j];
+		screen_vertices[vertex] = projected_points[j];
+		vertex_marks[vertex] = current_mark;
+		edge_marks[current_wireframe->face_edges[face_index * 3 + j]] = current_mark;
+	}
+}
+
+/* Vertices behind the camera or too far out to convert to pixels are left out of the wireframe */
+static bool screen_vertex_drawable(const vec4_t* point)
+{
+	return point->w > 0.0f && fabsf(point->x) <= MAX_RASTER_COORDINATE && fabsf(point->y) <= MAX_RASTER_COORDINATE;
+}
+
+/* Makes room for count more entries in a frame list, doubling it */
+static bool reserve_frame_list(void** list, int* capacity, int used, int count, size_t item_size)
+{
+	if (used + count <= *capacity)
+	{
+		return true;
+	}
+	int grown_capacity = (*capacity > 0) ? *capacity * 2 : 1024;
+	while (grown_capacity < used + count)
+	{
+		grown_capacity *= 2;
+	}
+	void* grown = realloc(*list, item_size * grown_capacity);
+	if (!grown)
+	{
+		fprintf(stderr, "Error allocating the wireframe lines.\n");
+		return false;
+	}
+	*list = grown;
+	*capacity = grown_capacity;
+	return true;
+}
+
+/* Function to add every edge and vertex of the visible faces of the current instance to the frame, once each */
+void wireframe_end_instance(void)
+{
+	const wireframe_t* wireframe = current_wireframe;
+	current_wireframe = NULL;
+	if (!wireframe)
+	{
+		return;
+	}
+
+	if (reserve_frame_list((void**)&frame_lines, &frame_lines_capacity, num_frame_lines, wireframe->num_edges, sizeof(wire_line_t)))
+	{
+		for (int i = 0; i < wireframe->num_edges; i++)
+		{
+			if (edge_marks[i] != current_mark)
+			{
+				continue;
+			}
+
+			const vec4_t* a = &screen_vertices[wireframe->edges[i].a];
+			const vec4_t* b = &screen_vertices[wireframe->edges[i].b];
+			if (screen_vertex_drawable(a) && screen_vertex_drawable(b))
+			{
+				frame_lines[num_frame_lines].a = *a;
+				frame_lines[num_frame_lines].b = *b;
+				num_frame_lines++;
+			}
+		}
+	}
+
+	if (reserve_frame_list((void**)&frame_points, &frame_points_capacity, num_frame_points, wireframe->num_vertices, sizeof(vec4_t)))
+	{
+		for (int i = 0; i < wireframe->num_vertices; i++)
+		{
+			if (vertex_marks[i] == current_mark && screen_vertex_drawable(&screen_vertices[i]))
+			{
+				frame_points[num_frame_points++] = screen_vertices[i];
+			}
+		}
+	}
+}
+
+/* Function to draw the edges of the frame, and optionally its vertices */
+void wireframe_render(uint32_t edge_color, bool draw_vertices, uint32_t vertex_color)
+{
+	for (int i = 0; i < num_frame_lines; i++)
+	{
+		const vec4_t* a = &frame_lines[i].a;
+		const vec4_t* b = &frame_lines[i].b;
+		draw_line((int)floorf(a->x), (int)floorf(a->y), (int)floorf(b->x), (int)floorf(b->y), edge_color);
+	}
+
+	if (!draw_vertices)
+	{
+		return;
+	}
+
+	for (int i = 0; i < num_frame_points; i++)
+	{
+		const vec4_t* point = &frame_points[i];
+		draw_rect((int)floorf(point->x) - WIREFRAME_VERTEX_SIZE / 2, (int)floorf(point->y) - WIREFRAME_VERTEX_SIZE / 2,
+			WIREFRAME_VERTEX_SIZE, WIREFRAME_VERTEX_SIZE, vertex_color);
+	}
+}
+
+/* Function to free the lines of the frame and the marks of the instances */
+void wireframe_destroy(void)
+{
+	free(edge_marks);
+	free(vertex_marks);
+	free(screen_vertices);
+	free(frame_lines);
+	free(frame_points);
+	edge_marks = NULL;
+	vertex_marks = NULL;
+	screen_vertices = NULL;
+	frame_lines = NULL;
+	frame_points = NULL;
+	edge_marks_capacity = 0;
+	vertex_marks_capacity = 0;
+	num_frame_lines = 0;
+	frame_lines_capacity = 0;
+	num_frame_points = 0;
+	frame_points_capacity = 0;
+	current_wireframe = NULL;
+	current_mark = 0;
+}